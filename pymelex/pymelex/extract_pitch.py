@@ -39,14 +39,15 @@ _ExtractPitch.argtypes = [np.ctypeslib.ndpointer(dtype=np.single, ndim=1,
                           audioInfo_Struct,
                           ctypes.c_int, ctypes.c_int, ctypes.c_int,
                           ctypes.POINTER(libmelex.PitchStratFunc_t),
-                          ctypes.c_int, ctypes.c_int, ctypes.c_char_p]
+                          ctypes.c_int, ctypes.c_int, ctypes.c_int,
+                          ctypes.c_char_p]
 
 _NumSTFTBlocks = libmelex.NumSTFTBlocks
 _NumSTFTBlocks.argtypes = [audioInfo_Struct, ctypes.c_int, ctypes.c_int]
 
 def extract_pitch(audioData, sample_rate, unpadded_window_size,
                   full_window_size, window_interval, pitch_strat, hpsOvr = 2,
-                  verbose = 0, prefix = None):
+                  verbose = 0, prefix = None, num_threads = 1):
     """
     Extracts Pitches from an audio stream
 
@@ -88,6 +89,9 @@ def extract_pitch(audioData, sample_rate, unpadded_window_size,
         STFT is saved at '{prefix}_original.txt'. An other spectrogram that may
         or may not be different (it depends on the callback function) is saved
         at '{prefix}_weighted.txt' after using the callback function.
+    num_threads : int
+        The number of threads that the pitchStrategy may use. Of the built-in
+        pitch strategies, this only has an effect on 'BaNa' and 'BaNaMusic'.
     Returns
     -------
     out_array : `np.ndarray`
@@ -116,6 +120,7 @@ def extract_pitch(audioData, sample_rate, unpadded_window_size,
                          "a known strategy")
 
     hpsOvr = _ensure_pos_int(hpsOvr, "hpsOvr")
+    num_threads = _ensure_pos_int(num_threads, "num_threads")
     verbose = _ensure_int(verbose, "verbose",0,1)
 
     # ensure prefix is either None OR that it involves a real path
@@ -136,8 +141,8 @@ def extract_pitch(audioData, sample_rate, unpadded_window_size,
 
     result = _ExtractPitch(audioData, out_array, audio_info,
 		           unpadded_window_size, full_window_size,
-                           window_interval, callback_ptr, hpsOvr, verbose,
-                           prefix)
+                           window_interval, callback_ptr, hpsOvr,
+                           num_threads, verbose, prefix)
 
     if result <= 0:
         raise RuntimeError("Something went wrong")
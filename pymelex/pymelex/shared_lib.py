@@ -88,7 +88,7 @@ import numpy as np
 _argtypes = [np.ctypeslib.ndpointer(dtype=np.single, ndim=1,
                                     flags=('C_CONTIGUOUS','WRITEABLE')),
              ctypes.c_int, ctypes.c_int, ctypes.c_int, ctypes.c_int,
-             ctypes.c_int,
+             ctypes.c_int, ctypes.c_int,
              np.ctypeslib.ndpointer(dtype=np.single, ndim=1,
                                     flags=('C_CONTIGUOUS','WRITEABLE'))]
 libmelex.register_CFUNCTYPE("PitchStratFunc_t", ctypes.c_int,*_argtypes)
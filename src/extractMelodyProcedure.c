@@ -5,6 +5,7 @@
 #include <limits.h>
 #include <assert.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "extractMelodyProcedure.h"
 #include "pitch/pitchStrat.h"
@@ -16,11 +17,155 @@
 #include "noteCompilation.h"
 #include "tuningAdjustment.h"
 
-struct Midi* ExtractMelody(float** input, audioInfo info,
+// The silence, pitch and transient stages of ExtractMelody only read the
+// input audio and each write their own output. This allows them to be run
+// concurrently. Each stage is described by a pipelineStage, which either runs
+// on its own thread or is deferred until its result is needed.
+struct pipelineStage{
+	void* (*run)(void*);
+	void* data;
+	pthread_t thread;
+	int started; // 1 if the stage is running on its own thread
+};
+
+struct silenceStageData{
+	float** input;
+	audioInfo info;
+	int s_winSize;
+	int s_winInt;
+	int s_mode;
+	SilenceStrategyFunc silenceStrategy;
+	int* activityRanges;
+	int a_size;
+};
+
+struct pitchStageData{
+	float** input;
+	audioInfo info;
+	int p_unpaddedSize;
+	int p_winSize;
+	int p_winInt;
+	PitchStrategyFunc pitchStrategy;
+	int hpsOvr;
+	int numThreads;
+	int verbose;
+	char* prefix;
+	int voicedOnly; // if 1, only the blocks in activityRanges are analyzed
+	int* activityRanges;
+	int a_size;
+	float* freq;
+	int freqSize;
+};
+
+struct onsetStageData{
+	float** input;
+	audioInfo info;
+	const struct detFuncSettings *dfSettings;
+	int voicedOnly; // if 1, only the activityRanges are analyzed
+	int* activityRanges;
+	int a_size;
+	intList* onsets;
+	int o_size;
+};
+
+static void* runSilenceStage(void* arg)
+{
+	struct silenceStageData* d = arg;
+	d->a_size = ExtractSilence(d->input, &(d->activityRanges), d->info,
+				   d->s_winSize, d->s_winInt, d->s_mode,
+				   d->silenceStrategy);
+	return NULL;
+}
+
+static void* runPitchStage(void* arg)
+{
+	struct pitchStageData* d = arg;
+	if (d->voicedOnly){
+		d->freq = malloc(sizeof(float) * NumSTFTBlocks(d->info,
+							       d->p_unpaddedSize,
+							       d->p_winInt));
+		if (d->freq == NULL){
+			d->freqSize = -1;
+			return NULL;
+		}
+		d->freqSize = ExtractVoicedPitch(*(d->input), d->freq, d->info,
+						 d->p_unpaddedSize, d->p_winSize,
+						 d->p_winInt, d->pitchStrategy,
+						 d->hpsOvr, d->numThreads,
+						 d->activityRanges, d->a_size,
+						 d->verbose);
+		return NULL;
+	}
+	d->freqSize = ExtractPitchAndAllocate(d->input, &(d->freq), d->info,
+					      d->p_unpaddedSize, d->p_winSize,
+					      d->p_winInt, d->pitchStrategy,
+					      d->hpsOvr, d->numThreads,
+					      d->verbose, d->prefix);
+	return NULL;
+}
+
+static void* runOnsetStage(void* arg)
+{
+	struct onsetStageData* d = arg;
+
+	// Commenting the following out was part of a quick and dirty solution
+	// to call the TransientDetectionStrategy. To call this strategy, more
+	// correctly (via ExtractOnset), will require some refactoring of the
+	// ExtractOnset function. We need to make the onsetStrategy take it's
+	// own Short Time Fourier Transform, if necessary. Also the
+	// onsetStrategy should probably indicate whether or not offsets are in
+	// the output
+	//int o_size = ExtractOnset(input, &onsets, info, o_unpaddedSize, o_winSize, o_winInt, 
+	//             onsetStrategy, verbose);
+
+	d->o_size = TransientDetection(d->input, d->info.frames,
+				       d->info.samplerate, d->dfSettings,
+				       d->voicedOnly ? d->activityRanges : NULL,
+				       d->a_size, d->onsets);
+	return NULL;
+}
+
+// If concurrent is nonzero, this tries to launch the stage on its own thread.
+// Otherwise (or if the thread could not be created) the stage is deferred
+// until stageFinish is called.
+static void stageStart(struct pipelineStage* stage, int concurrent)
+{
+	stage->started = 0;
+	if (concurrent){
+		stage->started = (pthread_create(&(stage->thread), NULL,
+						 stage->run, stage->data) == 0);
+	}
+}
+
+// Blocks until the stage's result is available.
+static void stageFinish(struct pipelineStage* stage)
+{
+	if (stage->started){
+		pthread_join(stage->thread, NULL);
+		stage->started = 0;
+	} else {
+		stage->run(stage->data);
+	}
+}
+
+// Called on the error path for stages whose result will not be used. Deferred
+// stages are never run, but we still need to wait on running threads.
+static void stageDiscard(struct pipelineStage* stage)
+{
+	if (stage->started){
+		pthread_join(stage->thread, NULL);
+		stage->started = 0;
+	}
+}
+
+int ExtractMelodyNotes(float** input, audioInfo info,
 		int p_unpaddedSize, int p_winSize, int p_winInt, PitchStrategyFunc pitchStrategy,
 		int o_unpaddedSize, int o_winSize, int o_winInt, OnsetStrategyFunc onsetStrategy,
 		int s_winSize, int s_winInt, int s_mode, SilenceStrategyFunc silenceStrategy,
-		int hpsOvr, int tuning, int verbose, char* prefix)
+		int hpsOvr, int tuning, int concurrentStages, int voicedPitch,
+		int voicedOnsets, const struct detFuncSettings *dfSettings, int verbose,
+		char* prefix, int* s_ranges, int s_size, int** outRanges,
+		int** outPitches)
 {
 
 	if(verbose){
@@ -29,31 +174,87 @@ struct Midi* ExtractMelody(float** input, audioInfo info,
 		printf("o_unpad %d,  o_win %d,  o_int %d\n", o_unpaddedSize, o_winSize, o_winInt);
 		printf("s_win %d,  s_int %d,  s_mode %d\n", s_winSize, s_winInt, s_mode);
 		printf("hps %d,  tuning %d,  verbose %d,  prefix %s\n", hpsOvr, tuning, verbose, prefix);
+		printf("concurrent stages %d,  detection function threads %d\n",
+		       concurrentStages, dfSettings->numThreads);
+		printf("voiced pitch %d,  voiced onsets %d\n", voicedPitch,
+		       voicedOnsets);
+	}
+
+	struct silenceStageData sData = {input, info, s_winSize, s_winInt,
+					 s_mode, silenceStrategy, s_ranges,
+					 (s_ranges != NULL) ? s_size : -1};
+	struct pitchStageData pData = {input, info, p_unpaddedSize, p_winSize,
+				       p_winInt, pitchStrategy, hpsOvr,
+				       dfSettings->numThreads, verbose, prefix,
+				       voicedPitch, NULL, 0, NULL, -1};
+	// Make onsets an intList
+	//    - initial size is 20 (might want something different
+	struct onsetStageData oData = {input, info, dfSettings, voicedOnsets,
+				       NULL, 0, intListCreate(20), -1};
+
+	struct pipelineStage silenceStage = {.run = &runSilenceStage,
+					     .data = &sData};
+	struct pipelineStage pitchStage = {.run = &runPitchStage,
+					   .data = &pData};
+	struct pipelineStage onsetStage = {.run = &runOnsetStage,
+					   .data = &oData};
+
+	// The FFTW planner isn't thread safe, so every stage must create its
+	// plans through fftPlanCache, which serializes the planning (executing
+	// a plan is thread safe). Nothing else is shared between the stages.
+	// When the pitch (onset) stage only analyzes the voiced audio, it needs
+	// the activity ranges and is started once the silence stage finishes.
+	// the silence stage is skipped when the caller provides the ranges
+	if(s_ranges == NULL){
+		stageStart(&silenceStage, concurrentStages);
+	}
+	if(!voicedPitch){
+		stageStart(&pitchStage, concurrentStages);
+	}
+	if(!voicedOnsets){
+		stageStart(&onsetStage, concurrentStages);
 	}
 
-	int *activityRanges = NULL;
-	int a_size = ExtractSilence(input, &activityRanges, info, s_winSize,
-				    s_winInt, s_mode, silenceStrategy);
+	if(s_ranges == NULL){
+		stageFinish(&silenceStage);
+	}
+	int *activityRanges = sData.activityRanges;
+	int a_size = sData.a_size;
 	if(a_size == -1){
 		printf("Silence detection failed\n");
 		fflush(NULL);
-		return NULL;
+		stageDiscard(&pitchStage);
+		stageDiscard(&onsetStage);
+		free(pData.freq);
+		intListDestroy(oData.onsets);
+		return -1;
 	}
 	if(verbose){
 		printf("Silence detection complete\n");
 		fflush(NULL);
 	}
+	if(voicedPitch){
+		pData.activityRanges = activityRanges;
+		pData.a_size = a_size;
+		stageStart(&pitchStage, concurrentStages);
+	}
+	if(voicedOnsets){
+		oData.activityRanges = activityRanges;
+		oData.a_size = a_size;
+		stageStart(&onsetStage, concurrentStages);
+	}
 
-	float* freq = NULL;
-	int freqSize = ExtractPitchAndAllocate(input, &freq, info,
-					       p_unpaddedSize, p_winSize,
-					       p_winInt, pitchStrategy,
-					       hpsOvr, verbose, prefix);
+	stageFinish(&pitchStage);
+	float* freq = pData.freq;
+	int freqSize = pData.freqSize;
 	if(freqSize <=0 ){
 		printf("Pitch detection failed\n");
 		fflush(NULL);
+		stageDiscard(&onsetStage);
 		free(activityRanges);
-		return NULL;
+		free(freq);
+		intListDestroy(oData.onsets);
+		return -1;
 	}
 	if(verbose){
 		printf("Pitch detection complete\n");
@@ -63,30 +264,16 @@ struct Midi* ExtractMelody(float** input, audioInfo info,
 		fflush(NULL);
 	}
 
-	// Make onsets an intList
-	//    - initial size is 20 (might want something different
-	intList* onsets = intListCreate(20);
-
-
-	// Commenting the following out was part of a quick and dirty solution
-	// to call the TransientDetectionStrategy. To call this strategy, more
-	// correctly (via ExtractOnset), will require some refactoring of the
-	// ExtractOnset function. We need to make the onsetStrategy take it's
-	// own Short Time Fourier Transform, if necessary. Also the
-	// onsetStrategy should probably indicate whether or not offsets are in
-	// the output
-	//int o_size = ExtractOnset(input, &onsets, info, o_unpaddedSize, o_winSize, o_winInt, 
-	//             onsetStrategy, verbose);
-
-	int o_size = TransientDetectionStrategy(input, info.frames, 0,
-						info.samplerate, onsets);
+	stageFinish(&onsetStage);
+	intList* onsets = oData.onsets;
+	int o_size = oData.o_size;
 	if(o_size == -1){
 		printf("Onset detection failed\n");
 		fflush(NULL);
 		free(activityRanges);
 		free(freq);
 		intListDestroy(onsets);
-		return NULL;
+		return -1;
 	}
 	if(verbose){
 		printf("Onset detection complete\n");
@@ -107,12 +294,12 @@ struct Midi* ExtractMelody(float** input, audioInfo info,
 	if(num_notes == -1){
 		printf("Construct notes failed!\n");
 		fflush(NULL);
-		return NULL;
+		return -1;
 	}
 	else if(num_notes == 0){
 		printf("No notes detected.\n");
 		fflush(NULL);
-		return NULL;
+		return 0;
 	}
 	printf("construct notes\n");
 
@@ -122,7 +309,7 @@ struct Midi* ExtractMelody(float** input, audioInfo info,
 		fflush(NULL);
 		free(noteRanges);
 		free(noteFreq);
-		return NULL;
+		return -1;
 	}
 	int tmp = FrequenciesToNotes(noteFreq, num_notes, &melodyMidi, tuning);
 	if(tmp == -1){
@@ -131,7 +318,7 @@ struct Midi* ExtractMelody(float** input, audioInfo info,
 		free(noteRanges);
 		free(noteFreq);
 		free(melodyMidi);
-		return NULL;
+		return -1;
 	}
 
 	if (prefix !=NULL){
@@ -166,6 +353,34 @@ struct Midi* ExtractMelody(float** input, audioInfo info,
 	printf("printout complete\n");
 	fflush(NULL);
 
+	(*outRanges) = noteRanges;
+	(*outPitches) = melodyMidi;
+	return num_notes;
+}
+
+struct Midi* ExtractMelody(float** input, audioInfo info,
+		int p_unpaddedSize, int p_winSize, int p_winInt, PitchStrategyFunc pitchStrategy,
+		int o_unpaddedSize, int o_winSize, int o_winInt, OnsetStrategyFunc onsetStrategy,
+		int s_winSize, int s_winInt, int s_mode, SilenceStrategyFunc silenceStrategy,
+		int hpsOvr, int tuning, int concurrentStages, int voicedPitch,
+		int voicedOnsets, const struct detFuncSettings *dfSettings, int verbose,
+		char* prefix)
+{
+	int *noteRanges = NULL;
+	int *melodyMidi = NULL;
+	int num_notes = ExtractMelodyNotes(input, info, p_unpaddedSize,
+					   p_winSize, p_winInt, pitchStrategy,
+					   o_unpaddedSize, o_winSize, o_winInt,
+					   onsetStrategy, s_winSize, s_winInt,
+					   s_mode, silenceStrategy, hpsOvr,
+					   tuning, concurrentStages,
+					   voicedPitch, voicedOnsets,
+					   dfSettings, verbose, prefix, NULL, 0,
+					   &noteRanges, &melodyMidi);
+	if(num_notes <= 0){
+		return NULL;
+	}
+
 	struct Midi* midi = GenerateMIDIFromNotes(melodyMidi, noteRanges,
 				     num_notes, info.samplerate, verbose);
 
@@ -185,7 +400,8 @@ struct Midi* ExtractMelody(float** input, audioInfo info,
 int ExtractPitchAndAllocate(float** input, float** pitches, audioInfo info,
 			    int p_unpaddedSize, int p_winSize, int p_winInt,
 			    PitchStrategyFunc pitchStrategy,
-			    int hpsOvr, int verbose, char* prefix)
+			    int hpsOvr, int numThreads, int verbose,
+			    char* prefix)
 {
 	(*pitches) = malloc(sizeof(float) * NumSTFTBlocks(info, p_unpaddedSize,
 							  p_winInt));
@@ -193,45 +409,27 @@ int ExtractPitchAndAllocate(float** input, float** pitches, audioInfo info,
 		return -1;
 	}
 	return ExtractPitch(*input, *pitches, info, p_unpaddedSize, p_winSize,
-			    p_winInt, pitchStrategy, hpsOvr, verbose, prefix);
+			    p_winInt, pitchStrategy, hpsOvr, numThreads, verbose,
+			    prefix);
 }
 
 int ExtractPitch(float* input, float* pitches, audioInfo info,
 		int p_unpaddedSize, int p_winSize, int p_winInt, PitchStrategyFunc pitchStrategy,
-		int hpsOvr, int verbose, char* prefix)
+		int hpsOvr, int numThreads, int verbose, char* prefix)
 {
-	fftwf_complex* p_fftData = NULL;
-	int p_size = STFT_r2c(&input, info, p_unpaddedSize, p_winSize, p_winInt, &p_fftData);
+	float* spectrum = NULL;
+	int p_size = STFT_magnitude(&input, info, p_unpaddedSize, p_winSize,
+				    p_winInt, &spectrum);
 	if(p_size == -1){
 		return -1;
 	}
 	int p_numBlocks = NumSTFTBlocks(info, p_unpaddedSize, p_winInt);
 	if(verbose){
 		printf("numblcks of pitch FFT: %d\n", p_numBlocks);
-		fflush(NULL);
-	}
-
-	float* spectrum = Magnitude(p_fftData, p_size);
-	if(spectrum == NULL){
-		printf("Magnitude failed\n");
-		fflush(NULL);
-		free(p_fftData);
-		return -1;
-	}
-	if(verbose){
 		printf("Magnitude complete\n");
 		fflush(NULL);
 	}
 
-	//double* output = NULL;
-	//STFTinverse(&p_fftData, info, winSize, p_winInt, &output);
-	//if(verbose){
-	//	printf("STFTInverse complete\n");
-	//}
-	free(p_fftData);
-	//SaveAsWav(output, info, stftInverse.wav);
-	//free( output );
-
 	if (prefix !=NULL){
 		// Here we save the original spectra
 		char *spectraFile = malloc(sizeof(char) * (strlen(prefix)+14));
@@ -242,7 +440,8 @@ int ExtractPitch(float* input, float* pitches, audioInfo info,
 	}
 
 	int result = pitchStrategy(spectrum, p_size, p_winSize/2, hpsOvr,
-				   p_winSize, info.samplerate, pitches);
+				   p_winSize, info.samplerate, numThreads,
+				   pitches);
 	if(result <= 0){
 		return result;
 	}
@@ -259,6 +458,95 @@ int ExtractPitch(float* input, float* pitches, audioInfo info,
 	return p_numBlocks;
 }
 
+// Finds the blocks, first up to and including last, whose windows overlap
+// the samples from start up to stop. Returns 0 if no block overlaps them.
+static int voicedBlockRange(int start, int stop, int p_unpaddedSize,
+			    int p_winInt, int numBlocks, int* first, int* last)
+{
+	// block i includes the samples from i*p_winInt up to
+	// i*p_winInt + p_unpaddedSize
+	if (stop <= start){
+		return 0;
+	}
+	(*first) = 0;
+	if (start >= p_unpaddedSize){
+		(*first) = (start - p_unpaddedSize)/p_winInt + 1;
+	}
+	(*last) = (stop - 1)/p_winInt;
+	if ((*last) >= numBlocks){
+		(*last) = numBlocks - 1;
+	}
+	return ((*first) <= (*last));
+}
+
+int ExtractVoicedPitch(float* input, float* pitches, audioInfo info,
+		       int p_unpaddedSize, int p_winSize, int p_winInt,
+		       PitchStrategyFunc pitchStrategy, int hpsOvr,
+		       int numThreads, int* activityRanges, int a_size,
+		       int verbose)
+{
+	int p_numBlocks = NumSTFTBlocks(info, p_unpaddedSize, p_winInt);
+	int voicedBlocks = 0;
+	int first, last, nextFirst, nextLast;
+	int i = 0;
+
+	for (int j = 0; j < p_numBlocks; j++){
+		pitches[j] = 0;
+	}
+
+	while (i < a_size){
+		if (!voicedBlockRange(activityRanges[i], activityRanges[i+1],
+				      p_unpaddedSize, p_winInt, p_numBlocks,
+				      &first, &last)){
+			i += 2;
+			continue;
+		}
+		i += 2;
+		// merge the following activity ranges whose blocks overlap or
+		// adjoin these blocks
+		while (i < a_size){
+			if (voicedBlockRange(activityRanges[i],
+					     activityRanges[i+1],
+					     p_unpaddedSize, p_winInt,
+					     p_numBlocks, &nextFirst,
+					     &nextLast)){
+				if (nextFirst > last + 1){
+					break;
+				}
+				if (nextLast > last){
+					last = nextLast;
+				}
+			}
+			i += 2;
+		}
+
+		// the plans of STFT_magnitudeBlocks only depend on p_winSize,
+		// so ranges of any length share the same cached plans
+		float* spectrum = NULL;
+		int p_size = STFT_magnitudeBlocks(&input, info, p_unpaddedSize,
+						  p_winSize, p_winInt, first,
+						  last - first + 1, &spectrum);
+		if(p_size == -1){
+			return -1;
+		}
+		int result = pitchStrategy(spectrum, p_size, p_winSize/2,
+					   hpsOvr, p_winSize, info.samplerate,
+					   numThreads, pitches + first);
+		free(spectrum);
+		if(result <= 0){
+			return result;
+		}
+		voicedBlocks += last - first + 1;
+	}
+
+	if(verbose){
+		printf("pitch computed for %d of %d blocks\n", voicedBlocks,
+		       p_numBlocks);
+		fflush(NULL);
+	}
+	return p_numBlocks;
+}
+
 int ExtractSilence(float** input, int** activityRanges, audioInfo info,
 		   int s_winSize, int s_winInt, int s_mode,
 		   SilenceStrategyFunc silenceStrategy){
@@ -6,7 +6,32 @@ struct Midi* ExtractMelody(float** input, audioInfo info,
 		int p_unpaddedSize, int p_winSize, int p_winInt, PitchStrategyFunc pitchStrategy,
 		int o_unpaddedSize, int o_winSize, int o_winInt, OnsetStrategyFunc onsetStrategy,
 		int s_winSize, int s_winInt, int s_mode, SilenceStrategyFunc silenceStrategy,
-		int hpsOvr, int tuning, int verbose, char* prefix);
+		int hpsOvr, int tuning, int concurrentStages, int voicedPitch,
+		int voicedOnsets, const struct detFuncSettings *dfSettings, int verbose,
+		char* prefix);
+
+/// Identical to ExtractMelody, except that the notes are returned rather than
+/// a Midi
+///
+/// @param[in] s_ranges If not NULL, the s_size entries of the activity ranges
+///            of input, which are used instead of running silenceStrategy.
+///            The function takes ownership of (and frees) the array.
+/// @param[out] outRanges Set to an allocated array of 2 entries per note,
+///             holding the first frame of the note and the frame following it
+/// @param[out] outPitches Set to an allocated array holding the midi value of
+///             each note
+///
+/// @return Returns the number of notes. A value of 0 indicates that no notes
+///         were detected (and nothing was allocated), while -1 indicates that
+///         an error occured
+int ExtractMelodyNotes(float** input, audioInfo info,
+		int p_unpaddedSize, int p_winSize, int p_winInt, PitchStrategyFunc pitchStrategy,
+		int o_unpaddedSize, int o_winSize, int o_winInt, OnsetStrategyFunc onsetStrategy,
+		int s_winSize, int s_winInt, int s_mode, SilenceStrategyFunc silenceStrategy,
+		int hpsOvr, int tuning, int concurrentStages, int voicedPitch,
+		int voicedOnsets, const struct detFuncSettings *dfSettings,
+		int verbose, char* prefix, int* s_ranges, int s_size,
+		int** outRanges, int** outPitches);
 
 /// Extracts the pitches from audio
 ///
@@ -35,6 +60,7 @@ struct Midi* ExtractMelody(float** input, audioInfo info,
 /// @param[in] hpsOvr Number of harmonic product specturm overtones to use with
 ///            the "hps" strategy. If an alternative strategy is in use, this
 ///            does nothing.
+/// @param[in] numThreads The number of threads that pitchStrategy may use
 /// @param[in] verbose Controls the verbosity of the functions. A value of 1
 ///            indicates that the messages should be verbose
 /// @param[in] prefix A string prefix indicating where spectrograms used for
@@ -53,8 +79,8 @@ struct Midi* ExtractMelody(float** input, audioInfo info,
 /// resizable floatList
 int ExtractPitch(float* input, float* pitches, audioInfo info,
 		 int p_unpaddedSize, int p_winSize, int p_winInt,
-		 PitchStrategyFunc pitchStrategy, int hpsOvr, int verbose,
-		 char* prefix);
+		 PitchStrategyFunc pitchStrategy, int hpsOvr, int numThreads,
+		 int verbose, char* prefix);
 
 /// Extracts pitches from audio and allocates the memory to hold the data
 ///
@@ -65,7 +91,31 @@ int ExtractPitch(float* input, float* pitches, audioInfo info,
 int ExtractPitchAndAllocate(float** input, float** pitches, audioInfo info,
 			    int p_unpaddedSize, int p_winSize, int p_winInt,
 			    PitchStrategyFunc pitchStrategy, int hpsOvr,
-			    int verbose, char* prefix);
+			    int numThreads, int verbose, char* prefix);
+/// Extracts the pitches of the voiced portions of audio
+///
+/// This function is similar to ExtractPitch, except that the short-time
+/// fourier transforms and the pitch strategy are only computed for the blocks
+/// whose windows overlap the activity ranges. Consecutive activity ranges
+/// whose blocks overlap or adjoin are analyzed together. The pitches of all
+/// other blocks are set to 0.
+///
+/// @param[in] activityRanges The activity ranges identified by
+///            ExtractSilence. Each pair of entries holds the index of the
+///            first sample of a range and the index of the sample following
+///            the range. The ranges must be in increasing order.
+/// @param[in] a_size The number of entries in activityRanges
+///
+/// The remaining parameters are the same as the parameters of ExtractPitch.
+/// The spectrograms are never saved.
+///
+/// @return Returns the length of pitches. If the value is not positive, then
+///         an error occured
+int ExtractVoicedPitch(float* input, float* pitches, audioInfo info,
+		       int p_unpaddedSize, int p_winSize, int p_winInt,
+		       PitchStrategyFunc pitchStrategy, int hpsOvr,
+		       int numThreads, int* activityRanges, int a_size,
+		       int verbose);
 int ExtractSilence(float** input, int** activityRanges, audioInfo info,
 		   int s_winSize, int s_winInt, int s_mode,
 		   SilenceStrategyFunc silenceStrategy);
@@ -217,7 +217,13 @@ int vadHelper(float* data,int sample_rate, int mode, int frameLength,
 	fvad_free(vad);
 	free(buffer);
 
-	// resize activityRanges down to length j
+	// resize activityRanges down to length j. realloc can't be used when
+	// there is no activity, since realloc(ptr, 0) frees ptr
+	if (j == 0){
+		free(*activityRanges);
+		*activityRanges = NULL;
+		return 0;
+	}
 	temp = realloc(*activityRanges,j*sizeof(int));
 	if (temp!=NULL){
 		*activityRanges=temp;
@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "fftPlanCache.h"
+
+// The maximum number of bytes that a scratch array is shifted by in order to
+// match the alignment of the caller's array
+#define MAX_ALIGNMENT_SHIFT 64
+
+enum planKind{
+	PLAN_R2C = 0,
+	PLAN_C2R = 1,
+};
+
+struct planKey{
+	int kind;
+	int n;
+	int howmany;
+	int idist;
+	int odist;
+	int inAlign;
+	int outAlign;
+};
+
+struct planEntry{
+	struct planKey key;
+	fftwf_plan plan;
+};
+
+static pthread_mutex_t cacheLock = PTHREAD_MUTEX_INITIALIZER;
+static struct planEntry *entries = NULL;
+static int numEntries = 0;
+static int capacity = 0;
+// set when a plan was measured since the wisdom was last imported/exported
+static int newWisdom = 0;
+
+static int keyEqual(const struct planKey *a, const struct planKey *b)
+{
+	return (a->kind == b->kind && a->n == b->n && a->howmany == b->howmany
+		&& a->idist == b->idist && a->odist == b->odist
+		&& a->inAlign == b->inAlign && a->outAlign == b->outAlign);
+}
+
+/* Returns a pointer within base (which must have at least
+ * MAX_ALIGNMENT_SHIFT spare bytes) with the given fftw alignment. */
+static void* alignLike(char *base, int alignment)
+{
+	for (int shift = 0; shift < MAX_ALIGNMENT_SHIFT;
+	     shift += sizeof(float)){
+		if (fftwf_alignment_of((float*)(base + shift)) == alignment){
+			return base + shift;
+		}
+	}
+	return NULL;
+}
+
+/* Creates the plan on scratch arrays with the requested alignment. This
+ * must be called while holding cacheLock. */
+static fftwf_plan createPlan(const struct planKey *key)
+{
+	int n[] = {key->n};
+	size_t realLen, complexLen;
+	fftwf_plan plan = NULL;
+
+	if (key->kind == PLAN_R2C){
+		realLen = (size_t)(key->howmany - 1) * key->idist + key->n;
+		complexLen = (size_t)(key->howmany - 1) * key->odist
+			+ key->n/2 + 1;
+	} else {
+		complexLen = (size_t)(key->howmany - 1) * key->idist
+			+ key->n/2 + 1;
+		realLen = (size_t)(key->howmany - 1) * key->odist + key->n;
+	}
+
+	char *realBase = fftwf_malloc(sizeof(float) * realLen
+				      + MAX_ALIGNMENT_SHIFT);
+	char *complexBase = fftwf_malloc(sizeof(fftwf_complex) * complexLen
+					 + MAX_ALIGNMENT_SHIFT);
+	if (realBase == NULL || complexBase == NULL){
+		fftwf_free(realBase);
+		fftwf_free(complexBase);
+		return NULL;
+	}
+
+	int realAlign = (key->kind == PLAN_R2C) ? key->inAlign : key->outAlign;
+	int complexAlign = (key->kind == PLAN_R2C) ? key->outAlign : key->inAlign;
+	float *real = alignLike(realBase, realAlign);
+	fftwf_complex *cmplx = alignLike(complexBase, complexAlign);
+
+	if (real != NULL && cmplx != NULL){
+		if (key->kind == PLAN_R2C){
+			plan = fftwf_plan_many_dft_r2c(1, n, key->howmany,
+						       real, NULL, 1,
+						       key->idist, cmplx,
+						       NULL, 1, key->odist,
+						       FFTW_MEASURE);
+		} else {
+			plan = fftwf_plan_many_dft_c2r(1, n, key->howmany,
+						       cmplx, NULL, 1,
+						       key->idist, real,
+						       NULL, 1, key->odist,
+						       FFTW_MEASURE);
+		}
+	}
+
+	fftwf_free(realBase);
+	fftwf_free(complexBase);
+	return plan;
+}
+
+static fftwf_plan cacheLookup(const struct planKey *key)
+{
+	fftwf_plan plan = NULL;
+	int i;
+
+	pthread_mutex_lock(&cacheLock);
+	for (i = 0; i < numEntries; i++){
+		if (keyEqual(&(entries[i].key), key)){
+			plan = entries[i].plan;
+			break;
+		}
+	}
+
+	if (plan == NULL){
+		if (numEntries == capacity){
+			int newCapacity = (capacity == 0) ? 8 : 2 * capacity;
+			struct planEntry *temp;
+			temp = realloc(entries,
+				       sizeof(struct planEntry) * newCapacity);
+			if (temp == NULL){
+				pthread_mutex_unlock(&cacheLock);
+				return NULL;
+			}
+			entries = temp;
+			capacity = newCapacity;
+		}
+		plan = createPlan(key);
+		if (plan != NULL){
+			entries[numEntries].key = *key;
+			entries[numEntries].plan = plan;
+			numEntries++;
+			newWisdom = 1;
+		}
+	}
+	pthread_mutex_unlock(&cacheLock);
+	return plan;
+}
+
+fftwf_plan fftPlanCacheR2C(int n, int howmany, int idist, int odist,
+			   float *in, fftwf_complex *out)
+{
+	struct planKey key = {PLAN_R2C, n, howmany, idist, odist,
+			      fftwf_alignment_of(in),
+			      fftwf_alignment_of((float*)out)};
+	return cacheLookup(&key);
+}
+
+fftwf_plan fftPlanCacheC2R(int n, int howmany, int idist, int odist,
+			   fftwf_complex *in, float *out)
+{
+	struct planKey key = {PLAN_C2R, n, howmany, idist, odist,
+			      fftwf_alignment_of((float*)in),
+			      fftwf_alignment_of(out)};
+	return cacheLookup(&key);
+}
+
+int fftPlanCacheImportWisdom(const char *path)
+{
+	pthread_mutex_lock(&cacheLock);
+	int result = fftwf_import_wisdom_from_filename(path);
+	pthread_mutex_unlock(&cacheLock);
+	return (result != 0) ? 1 : 0;
+}
+
+int fftPlanCacheExportWisdom(const char *path)
+{
+	int result = 1;
+	pthread_mutex_lock(&cacheLock);
+	if (newWisdom){
+		// the temporary file is created in the same directory as path,
+		// so that it can be renamed atomically, and with a unique name,
+		// so that concurrent processes don't write to the same file
+		char *tempPath = malloc(strlen(path) + 8);
+		if (tempPath == NULL){
+			pthread_mutex_unlock(&cacheLock);
+			return -1;
+		}
+		strcpy(tempPath, path);
+		strcat(tempPath, ".XXXXXX");
+		int fd = mkstemp(tempPath);
+		if (fd == -1){
+			free(tempPath);
+			pthread_mutex_unlock(&cacheLock);
+			return -1;
+		}
+		close(fd);
+		if (fftwf_export_wisdom_to_filename(tempPath) == 0 ||
+		    rename(tempPath, path) != 0){
+			remove(tempPath);
+			result = -1;
+		} else {
+			newWisdom = 0;
+		}
+		free(tempPath);
+	}
+	pthread_mutex_unlock(&cacheLock);
+	return result;
+}
+
+int fftPlanCacheSize(void)
+{
+	pthread_mutex_lock(&cacheLock);
+	int size = numEntries;
+	pthread_mutex_unlock(&cacheLock);
+	return size;
+}
+
+void fftPlanCacheClear(void)
+{
+	pthread_mutex_lock(&cacheLock);
+	for (int i = 0; i < numEntries; i++){
+		fftwf_destroy_plan(entries[i].plan);
+	}
+	free(entries);
+	entries = NULL;
+	numEntries = 0;
+	capacity = 0;
+	pthread_mutex_unlock(&cacheLock);
+}
@@ -0,0 +1,63 @@
+#ifndef FFTPLANCACHE_H
+#define FFTPLANCACHE_H
+
+#include "fftw3.h"
+
+// A process-wide cache of FFTW plans.
+//
+// Creating a plan with FFTW_MEASURE can take longer than actually computing
+// the transforms of a short clip. Plans are therefore created once, for each
+// combination of transform kind, size, batch layout and array alignment, and
+// then reused by every caller in every thread. The FFTW planner is not thread
+// safe, so all planning (and wisdom import/export) is serialized by the
+// cache.
+//
+// The returned plans belong to the cache; they must NOT be destroyed by the
+// caller. They are created on scratch arrays, so they must be executed with
+// the new-array execute functions (fftwf_execute_dft_r2c and
+// fftwf_execute_dft_c2r) on arrays with the same alignment as the arrays
+// passed to the cache (execution itself is thread safe).
+
+/// Returns a plan computing howmany real to complex transforms of size n.
+/// Transform i reads n contiguous entries starting from in + i*idist and
+/// writes n/2 + 1 contiguous entries starting from out + i*odist.
+///
+/// @param[in] in,out Arrays with the same alignment as the arrays the plan
+///            will be executed on. They are not accessed.
+///
+/// @return Returns the plan, or NULL if it couldn't be created.
+fftwf_plan fftPlanCacheR2C(int n, int howmany, int idist, int odist,
+			   float *in, fftwf_complex *out);
+
+/// Returns a plan computing howmany complex to real transforms of size n.
+/// Transform i reads n/2 + 1 contiguous entries starting from in + i*idist
+/// and writes n contiguous entries starting from out + i*odist. Like all
+/// complex to real transforms, executing the plan overwrites the input.
+fftwf_plan fftPlanCacheC2R(int n, int howmany, int idist, int odist,
+			   fftwf_complex *in, float *out);
+
+/// Loads FFTW wisdom from a file, which speeds up the creation of plans for
+/// sizes that were measured by a previous run.
+///
+/// @return Returns 1 if the wisdom was imported and 0 if it could not be read
+///         (e.g. the file does not exist yet).
+int fftPlanCacheImportWisdom(const char *path);
+
+/// Saves the accumulated FFTW wisdom to a file. If no new plan was measured
+/// since the last import or export, the file is left untouched. The wisdom is
+/// first written to a uniquely named temporary file in the same directory,
+/// which is then renamed, so that concurrent processes never read (or write
+/// to) a partially written file.
+///
+/// @return Returns 1 on success (or if there was nothing to save) and -1 on
+///         failure.
+int fftPlanCacheExportWisdom(const char *path);
+
+/// Returns the number of cached plans.
+int fftPlanCacheSize(void);
+
+/// Destroys every cached plan. No plan returned by the cache may be used
+/// after (or during) this call.
+void fftPlanCacheClear(void);
+
+#endif /* FFTPLANCACHE_H */
@@ -9,27 +9,41 @@ char* ERR_INVALID_FILE = "Audio file could not be opened for processing\n";
 char* ERR_FILE_NOT_MONO = "Input file must be Mono."
                           " Multi-channel audio currently not supported.\n";
 
-int ReadAudioFile(char* inFile, float** buf, audioInfo* info, int verbose)
+// the number of frames read at a time by StreamAudioFile
+#define STREAM_READ_FRAMES 65536
+
+// opens inFile and checks that it is mono. Returns NULL on failure
+static SNDFILE* OpenMonoAudioFile(char* inFile, SF_INFO* file_info,
+				  int verbose)
 {
-	SF_INFO file_info;
-	SNDFILE * f = sf_open(inFile, SFM_READ, &file_info);
+	SNDFILE * f = sf_open(inFile, SFM_READ, file_info);
 	if( !f ){
 		printf("%s", ERR_INVALID_FILE);
-		return 0;
+		return NULL;
 	}
-	if(file_info.channels != 1){
+	if(file_info->channels != 1){
 		printf("%s", ERR_FILE_NOT_MONO);
 		sf_close( f );
-		return 0;
+		return NULL;
 	}
 
 	if (verbose){
-		printf("Frames:\t%ld\n", file_info.frames);
-		printf("Sample rate:\t%d\n", file_info.samplerate);
-		printf("Channels: \t%d\n", file_info.channels);
-		printf("Format: \t%d\n", file_info.format);
-		printf("Sections: \t%d\n", file_info.sections);
-		printf("Seekable: \t%d\n", file_info.seekable);
+		printf("Frames:\t%ld\n", file_info->frames);
+		printf("Sample rate:\t%d\n", file_info->samplerate);
+		printf("Channels: \t%d\n", file_info->channels);
+		printf("Format: \t%d\n", file_info->format);
+		printf("Sections: \t%d\n", file_info->sections);
+		printf("Seekable: \t%d\n", file_info->seekable);
+	}
+	return f;
+}
+
+int ReadAudioFile(char* inFile, float** buf, audioInfo* info, int verbose)
+{
+	SF_INFO file_info;
+	SNDFILE * f = OpenMonoAudioFile(inFile, &file_info, verbose);
+	if( !f ){
+		return 0;
 	}
 
 	// Copy relevant information from file_info into info
@@ -43,6 +57,52 @@ int ReadAudioFile(char* inFile, float** buf, audioInfo* info, int verbose)
 	return 1;
 }
 
+struct Midi* StreamAudioFile(char* inFile, struct me_settings* settings)
+{
+	SF_INFO file_info;
+	SNDFILE * f = OpenMonoAudioFile(inFile, &file_info, settings->verbose);
+	if( !f ){
+		return NULL;
+	}
+	audioInfo info = {file_info.frames, file_info.samplerate};
+
+	struct me_data *inst;
+	char* err = me_data_init(&inst, settings, info);
+	if(inst == NULL){
+		printf("error initializing me_data: %s\n", err);
+		sf_close( f );
+		return NULL;
+	}
+
+	struct me_stream *stream = me_stream_open(inst, info.samplerate);
+	float* chunk = malloc( sizeof(float) * STREAM_READ_FRAMES);
+	if(stream == NULL || chunk == NULL){
+		printf("malloc failed\n");
+		if(stream != NULL){
+			// nothing was pushed, so this just destroys the stream
+			me_stream_finish(stream);
+		}
+		free(chunk);
+		me_data_free(inst);
+		sf_close( f );
+		return NULL;
+	}
+
+	sf_count_t count;
+	while((count = sf_readf_float( f, chunk, STREAM_READ_FRAMES )) > 0){
+		if(me_stream_push(stream, chunk, (int)count) == -1){
+			break;
+		}
+	}
+	// if the stream failed, this just returns NULL
+	struct Midi* midi = me_stream_finish(stream);
+
+	free(chunk);
+	me_data_free(inst);
+	sf_close( f );
+	return midi;
+}
+
 void SaveAsWav(const double* audio, audioInfo info, const char* path) {
 	FILE* file = fopen(path, "wb");
 
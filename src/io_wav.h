@@ -1,4 +1,6 @@
 #include "melodyextraction.h"
 
 int ReadAudioFile(char* inFile, float** buf, audioInfo* info, int verbose);
+// extracts the melody of inFile with a me_stream, reading the file in chunks
+struct Midi* StreamAudioFile(char* inFile, struct me_settings* settings);
 void SaveAsWav(const double* audio, audioInfo info, const char* path);
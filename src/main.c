@@ -40,6 +40,51 @@
  *                    ("quality"), 1 ("low bitrate"), 2 ("aggressive"), and 3
  *                    ("very aggressive"), def = 0
  *
+ *   --concurrent_stages: if 1, the silence, pitch, and onset detection 
+ *                         stages are run concurrently on separate threads.
+ *                         If 0, they are run one after another, def = 0
+ *   --voiced_pitch: if 1, the pitch detection stage only analyzes the 
+ *                    windows that overlap the activity ranges found by 
+ *                    silence detection. The pitch of every other window is 
+ *                    0, def = 0
+ *   --voiced_onsets: if 1, the onset detection stage only computes the 
+ *                     detection function and searches for transients 
+ *                     within the activity ranges found by silence 
+ *                     detection (widened by 250ms), def = 0
+ *   --num_threads: number of threads used to compute the detection function
+ *                   for onset detection and the candidates of the BaNa pitch
+ *                   strategies. If 0, one thread is used for each
+ *                   processor, def = 1
+ *   --gammatone_filter: the approximation of the gammatone filter used by 
+ *                        the filterbank of the TransientAlg onset strategy.
+ *                        Either sos (a cascade of 4 second order sections),
+ *                        apgf (all-pole), or ozgf (one-zero). apgf and ozgf
+ *                        are cheaper but deviate from sos, def = sos
+ *   --psm_method: how the TransientAlg onset strategy computes the pooled
+ *                  summary matrix. Either direct (every window from 
+ *                  scratch), incremental (the squared differences are 
+ *                  shared between overlapping windows), which is faster 
+ *                  and agrees with direct to within ~1e-5, fgt (the 
+ *                  Fast Gauss Transform), which is only faster for long 
+ *                  correntropy windows, or histogram (the samples of a 
+ *                  window are binned), which has an error comparable to 
+ *                  direct and is faster for long correntropy windows, 
+ *                  def = direct
+ *   --exp_precision: the approximation of the gaussian used by the direct
+ *                     psm_method. Either schraudolph (~5% error), poly3 
+ *                     (~1e-4 error, ~2x slower), or accurate (~1 ulp, 
+ *                     ~3.5x slower), def = schraudolph. The incremental 
+ *                     psm_method requires schraudolph
+ *   --fftw_wisdom: path of a file where FFTW wisdom is loaded from (if it
+ *                   exists) and saved to, so that the FFT plans measured by
+ *                   one run are reused by later runs, def = NULL
+ *   --stream_segment: if set, the input file is read and processed in 
+ *                      segments of at most this many frames (split at 
+ *                      silences), which bounds the memory used for long 
+ *                      recordings. Like --pitch_window, this can be 
+ *                      specified as a number of frames or as a length of 
+ *                      time (ex: '30000ms'), def = NULL
+ *
  *   -h: number of harmonic product specturm overtones, def = 2
  *   -t: tuning adjustment mode. 0 = no adjustment,  1 = adjust with threshold,  2 = always adjust
  *   -p: prefix for fname where spectral data is stored, def = NULL;
@@ -74,6 +119,16 @@ int main(int argc, char ** argv)
 			{"silence_strategy", required_argument, 0, 'k'},
 			{"silence_mode", required_argument, 0, 'l'},
 
+			{"concurrent_stages", required_argument, 0, 'm'},
+			{"voiced_pitch", required_argument, 0, 'q'},
+			{"voiced_onsets", required_argument, 0, 'r'},
+			{"num_threads", required_argument, 0, 'n'},
+			{"gammatone_filter", required_argument, 0, 'u'},
+			{"psm_method", required_argument, 0, 's'},
+			{"exp_precision", required_argument, 0, 'A'},
+			{"fftw_wisdom", required_argument, 0, 'w'},
+			{"stream_segment", required_argument, 0, 'z'},
+
 			{0,0,0,0},
 		};
 
@@ -134,6 +189,33 @@ int main(int argc, char ** argv)
 		case 'l':
 			settings->silence_mode = atoi(optarg);
 			break;
+		case 'm':
+			settings->concurrent_stages = atoi(optarg);
+			break;
+		case 'q':
+			settings->voiced_pitch = atoi(optarg);
+			break;
+		case 'r':
+			settings->voiced_onsets = atoi(optarg);
+			break;
+		case 'n':
+			settings->num_threads = atoi(optarg);
+			break;
+		case 'u':
+			settings->gammatone_filter = strdup(optarg);
+			break;
+		case 's':
+			settings->psm_method = strdup(optarg);
+			break;
+		case 'A':
+			settings->exp_precision = strdup(optarg);
+			break;
+		case 'w':
+			settings->fftw_wisdom = strdup(optarg);
+			break;
+		case 'z':
+			settings->stream_segment = strdup(optarg);
+			break;
 		case 'h':
 			settings->hps = atoi(optarg);
 			break;
@@ -159,7 +241,18 @@ int main(int argc, char ** argv)
 		badargs = 1;
 	}
 
-	if(!badargs){
+	if(!badargs && settings->stream_segment != NULL){
+		// the file is read and processed in chunks
+		struct Midi* midi = StreamAudioFile(inFile, settings);
+		me_settings_free(settings);
+
+		if(midi == NULL){ //extractMelody error, or no notes found.
+			return 0;
+		}
+
+		SaveMIDI(midi, outFile, 1);
+		freeMidi(midi);
+	} else if(!badargs){
 
 		audioInfo info;
 
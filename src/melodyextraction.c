@@ -4,10 +4,14 @@
 #include <limits.h>
 #include <stdio.h>
 #include <math.h>
+#include <unistd.h>
 
 #include "extractMelodyProcedure.h"
+#include "fftPlanCache.h"
+#include "midi.h"
 #include "pitch/pitchStrat.h"
 #include "onset/onsetStrat.h"
+#include "onset/pairTransientDetection.h"
 #include "silenceStrat.h"
 
 
@@ -24,6 +28,8 @@ int SILENCE_WINDOW_DEF = 10; //silence window is in ms, not num samples
 int SILENCE_MODE_DEF = 0;
 SilenceStrategyFunc SILENCE_STRATEGY_DEF = &fVADDetectionStrategy;
 
+int STREAM_SEGMENT_DEF = 30000; //stream segment is in ms
+
 int msToFrames(int ms, int samplerate){
 	return (samplerate * ms) / 1000; //integer division
 }
@@ -77,6 +83,15 @@ struct me_data{
 	int silence_mode;
 	int hps;
 	int tuning;
+	int concurrent_stages;
+	int voiced_pitch;
+	int voiced_onsets;
+	int num_threads;
+	enum gammatoneFilterType gammatone_filter;
+	enum psmMethod psm_method;
+	enum expPrecision exp_precision;
+	char * fftw_wisdom;
+	int stream_segment;
 	int verbose;
 };
 
@@ -246,6 +261,110 @@ char* me_data_init(struct me_data** inst, struct me_settings* settings, audioInf
 		return "tuning must be 0, 1, or 2";
 	}
 
+	(*inst)->concurrent_stages = settings->concurrent_stages;
+	if((*inst)->concurrent_stages < 0 || (*inst)->concurrent_stages > 1){
+		me_data_free((*inst));
+		(*inst) = NULL;
+		return "concurrent_stages must be 0 or 1";
+	}
+
+	(*inst)->voiced_pitch = settings->voiced_pitch;
+	if((*inst)->voiced_pitch < 0 || (*inst)->voiced_pitch > 1){
+		me_data_free((*inst));
+		(*inst) = NULL;
+		return "voiced_pitch must be 0 or 1";
+	}
+
+	(*inst)->voiced_onsets = settings->voiced_onsets;
+	if((*inst)->voiced_onsets < 0 || (*inst)->voiced_onsets > 1){
+		me_data_free((*inst));
+		(*inst) = NULL;
+		return "voiced_onsets must be 0 or 1";
+	}
+
+	(*inst)->num_threads = settings->num_threads;
+	if((*inst)->num_threads < 0){
+		me_data_free((*inst));
+		(*inst) = NULL;
+		return "num_threads must be a non-negative int";
+	}else if((*inst)->num_threads == 0){
+		// use one thread per online processor
+		long nproc = sysconf(_SC_NPROCESSORS_ONLN);
+		(*inst)->num_threads = (nproc > 0) ? (int)nproc : 1;
+	}
+
+	if(settings->gammatone_filter == NULL){
+		(*inst)->gammatone_filter = GAMMATONE_SOS;
+	}else if(strcmp(settings->gammatone_filter, "sos") == 0){
+		(*inst)->gammatone_filter = GAMMATONE_SOS;
+	}else if(strcmp(settings->gammatone_filter, "apgf") == 0){
+		(*inst)->gammatone_filter = GAMMATONE_APGF;
+	}else if(strcmp(settings->gammatone_filter, "ozgf") == 0){
+		(*inst)->gammatone_filter = GAMMATONE_OZGF;
+	}else{
+		me_data_free((*inst));
+		(*inst) = NULL;
+		return "gammatone_filter must be \"sos\", \"apgf\", or \"ozgf\"";
+	}
+
+	if(settings->psm_method == NULL){
+		(*inst)->psm_method = PSM_DIRECT;
+	}else if(strcmp(settings->psm_method, "direct") == 0){
+		(*inst)->psm_method = PSM_DIRECT;
+	}else if(strcmp(settings->psm_method, "incremental") == 0){
+		(*inst)->psm_method = PSM_INCREMENTAL;
+	}else if(strcmp(settings->psm_method, "fgt") == 0){
+		(*inst)->psm_method = PSM_FGT;
+	}else if(strcmp(settings->psm_method, "histogram") == 0){
+		(*inst)->psm_method = PSM_HISTOGRAM;
+	}else{
+		me_data_free((*inst));
+		(*inst) = NULL;
+		return "psm_method must be \"direct\", \"incremental\", \"fgt\", or \"histogram\"";
+	}
+
+	if(settings->exp_precision == NULL){
+		(*inst)->exp_precision = EXP_PRECISION_SCHRAUDOLPH;
+	}else if(strcmp(settings->exp_precision, "schraudolph") == 0){
+		(*inst)->exp_precision = EXP_PRECISION_SCHRAUDOLPH;
+	}else if(strcmp(settings->exp_precision, "poly3") == 0){
+		(*inst)->exp_precision = EXP_PRECISION_POLY3;
+	}else if(strcmp(settings->exp_precision, "accurate") == 0){
+		(*inst)->exp_precision = EXP_PRECISION_ACCURATE;
+	}else{
+		me_data_free((*inst));
+		(*inst) = NULL;
+		return "exp_precision must be \"schraudolph\", \"poly3\", or \"accurate\"";
+	}
+	if(((*inst)->psm_method == PSM_INCREMENTAL) &&
+	   ((*inst)->exp_precision != EXP_PRECISION_SCHRAUDOLPH)){
+		me_data_free((*inst));
+		(*inst) = NULL;
+		return "psm_method \"incremental\" requires exp_precision \"schraudolph\"";
+	}
+
+	if(settings->stream_segment == NULL){
+		(*inst)->stream_segment = msToFrames(STREAM_SEGMENT_DEF,
+						     info.samplerate);
+	}else{
+		(*inst)->stream_segment = ConvertToFrames(settings->stream_segment, info.samplerate);
+		if((*inst)->stream_segment < (*inst)->pitch_padded){
+			me_data_free((*inst));
+			(*inst) = NULL;
+			return "stream_segment cannot be less than pitch_padded";
+		}
+	}
+
+	if(settings->fftw_wisdom != NULL){
+		(*inst)->fftw_wisdom = strdup(settings->fftw_wisdom);
+		// the wisdom file doesn't exist until it is first saved
+		if(fftPlanCacheImportWisdom((*inst)->fftw_wisdom) == 0
+		   && (*inst)->verbose){
+			printf("no FFTW wisdom loaded from %s\n",
+			       (*inst)->fftw_wisdom);
+		}
+	}
+
 	return "";
 }
 
@@ -255,6 +374,10 @@ struct me_settings* me_settings_new(){
 	inst->hps = 2;
 	inst->verbose = 0;
 	inst->tuning = 1;
+	inst->concurrent_stages = 0;
+	inst->voiced_pitch = 0;
+	inst->voiced_onsets = 0;
+	inst->num_threads = 1;
 	return inst;
 }
 
@@ -262,6 +385,9 @@ void me_data_free(struct me_data* inst){
 	if(inst->prefix != NULL){
 		free(inst->prefix);
 	}
+	if(inst->fftw_wisdom != NULL){
+		free(inst->fftw_wisdom);
+	}
 	free(inst);
 }
 
@@ -303,12 +429,34 @@ void me_settings_free(struct me_settings* inst)
 	if(inst->silence_strategy != NULL){
 		free(inst->silence_strategy);
 	}
+	if(inst->gammatone_filter != NULL){
+		free(inst->gammatone_filter);
+	}
+	if(inst->psm_method != NULL){
+		free(inst->psm_method);
+	}
+	if(inst->exp_precision != NULL){
+		free(inst->exp_precision);
+	}
+	if(inst->fftw_wisdom != NULL){
+		free(inst->fftw_wisdom);
+	}
+	if(inst->stream_segment != NULL){
+		free(inst->stream_segment);
+	}
 	free(inst);
 }
 
 struct Midi* me_process(float **input, audioInfo info, struct me_data *inst)
 {
 	struct Midi* midi = NULL;
+	struct detFuncSettings dfSettings;
+
+	detFuncSettingsInit(&dfSettings);
+	dfSettings.numThreads = inst->num_threads;
+	dfSettings.filterType = inst->gammatone_filter;
+	dfSettings.psmMethod = inst->psm_method;
+	dfSettings.expPrecision = inst->exp_precision;
 	
 	midi = ExtractMelody(input, info, 
 			inst->pitch_window, inst->pitch_padded, 
@@ -318,7 +466,346 @@ struct Midi* me_process(float **input, audioInfo info, struct me_data *inst)
 			inst->silence_window, inst->silence_spacing, 
 			inst->silence_mode, inst->silence_strategy,
 			inst->hps, inst->tuning, 
+			inst->concurrent_stages, inst->voiced_pitch,
+			inst->voiced_onsets, &dfSettings,
 			inst->verbose, inst->prefix);
 
+	if(inst->fftw_wisdom != NULL){
+		if(fftPlanCacheExportWisdom(inst->fftw_wisdom) == -1){
+			printf("failed to save FFTW wisdom to %s\n",
+			       inst->fftw_wisdom);
+		}
+	}
+
+	return midi;
+}
+
+struct me_stream{
+	struct me_data *inst;
+	int samplerate;
+	float *buffer; // holds up to inst->stream_segment frames
+	int length; // the number of frames in buffer
+	int offset; // the index in the stream of the first frame in buffer
+	int context; // the number of frames in buffer preceding the last split
+	int maxContext; // the largest value of context (see me_stream_open)
+	intList *noteRanges;
+	intList *notePitches;
+	int failed;
+};
+
+struct me_stream* me_stream_open(struct me_data *inst, int samplerate)
+{
+	struct me_stream *stream = calloc(1, sizeof(struct me_stream));
+	if(stream == NULL){
+		return NULL;
+	}
+	stream->inst = inst;
+	stream->samplerate = samplerate;
+	// The onset detection function at a frame is normalized by the rolling
+	// sigma of the window of SIGMA_WINDOW_MS centered on it, so the frames
+	// that precede the first new frame of a segment by up to half of that
+	// window are carried over from the previous segment. The context is
+	// limited to a quarter of the segment, so that every segment adds at
+	// least a quarter of a segment of new audio (splits are never made in
+	// the first half of the buffer).
+	stream->maxContext = msToFrames(SIGMA_WINDOW_MS / 2, samplerate);
+	if(stream->maxContext > inst->stream_segment / 4){
+		stream->maxContext = inst->stream_segment / 4;
+	}
+	stream->buffer = malloc(sizeof(float) * inst->stream_segment);
+	stream->noteRanges = intListCreate(20);
+	stream->notePitches = intListCreate(10);
+	if(stream->buffer == NULL || stream->noteRanges == NULL
+	   || stream->notePitches == NULL){
+		free(stream->buffer);
+		if(stream->noteRanges != NULL){
+			intListDestroy(stream->noteRanges);
+		}
+		if(stream->notePitches != NULL){
+			intListDestroy(stream->notePitches);
+		}
+		free(stream);
+		return NULL;
+	}
+	return stream;
+}
+
+// The middle of the silence preceding the activity range that starts at
+// activityRanges[i] (or -1 if there is no silence)
+static int silenceMiddle(const int *activityRanges, int i)
+{
+	int silenceStart = (i > 0) ? activityRanges[i-1] : 0;
+	int silenceStop = activityRanges[i];
+	if(silenceStop <= silenceStart){
+		return -1;
+	}
+	return silenceStart + (silenceStop - silenceStart)/2;
+}
+
+// Determines where a full buffer is split. The split always lies in the last
+// half of the buffer. It's the middle of the silence preceding the last
+// activity range of the buffer if there is one, and otherwise the middle of
+// the gap preceding the last note of the buffer. If neither lies in the last
+// half of the buffer, the buffer is split after its last note (or at the
+// middle of the buffer, whichever comes last).
+static int streamSplitIndex(const struct me_stream *stream,
+			    const int *activityRanges, int a_size,
+			    const int *noteRanges, int num_notes)
+{
+	int half = stream->length / 2;
+	if(a_size == 0){
+		// the buffer is silent
+		return stream->length;
+	}
+	int middle = silenceMiddle(activityRanges, a_size - 2);
+	if(middle >= half){
+		return middle;
+	}
+	if(num_notes == 0){
+		return half;
+	}
+	int last = num_notes - 1;
+	int gapStart = (last > 0) ? noteRanges[2*last - 1] : 0;
+	middle = gapStart + (noteRanges[2*last] - gapStart)/2;
+	if(middle >= half){
+		return middle;
+	}
+	return (noteRanges[2*last + 1] > half) ? noteRanges[2*last + 1] : half;
+}
+
+// Determines the first frame kept for the next segment, which is no earlier
+// than stream->maxContext frames before the split. The onset detection pairs
+// the transients it finds in order, so the kept audio starts between two
+// notes (at the middle of the gap if possible) whenever there is a gap in that
+// range, for the next segment to pair the transients like the extraction of
+// the whole recording. The kept audio also starts at a multiple of the
+// hopsize of the onset detection function (counted from the start of the
+// stream), so that the detection function of the next segment is sampled at
+// the same frames as the one of the whole recording.
+static int streamKeepIndex(const struct me_stream *stream, int split,
+			   const int *noteRanges, int num_notes)
+{
+	int hop = msToFrames(DET_FUNC_HOP_MS, stream->samplerate);
+	int first = (split > stream->maxContext) ? split - stream->maxContext
+		: 0;
+	int keep = first;
+	int gapStart = 0;
+	for(int i = 0; i <= num_notes && gapStart < split; i++){
+		int gapStop = (i < num_notes && noteRanges[2*i] < split)
+			? noteRanges[2*i] : split;
+		if(gapStop > first && gapStop > gapStart){
+			int middle = gapStart + (gapStop - gapStart)/2;
+			keep = (middle > first) ? middle : first;
+			break;
+		}
+		if(i < num_notes){
+			gapStart = noteRanges[2*i + 1];
+		}
+	}
+
+	// rounding up keeps the context within stream->maxContext
+	int phase = (hop > 1) ? (stream->offset + keep) % hop : 0;
+	if(phase != 0 && keep + hop - phase <= split){
+		keep += hop - phase;
+	}
+	return keep;
+}
+
+// Extracts the notes of the buffered audio and appends the notes that start
+// between the previous split and the next split. If last is nonzero, the
+// buffer holds the end of the stream and the next split is the end of the
+// buffer. Otherwise, the buffer is full and the next split is given by
+// streamSplitIndex. The frames that precede the split by more than
+// stream->maxContext are then dropped from the buffer. Returns 1 on success
+// and -1 on failure.
+//
+// The audio following the split is analyzed as well, even though its notes
+// are only kept by the next segment. The onset detection discards the last
+// transients it finds (which are usually a false positive) and the buffer
+// may end in the middle of a note, so the split always precedes the last
+// activity range or the last note, which are found again by the next
+// segment. Likewise, the detection function of the onsets is normalized by
+// the audio around each frame, so the audio preceding the split is analyzed
+// again by the next segment, to find the same onsets as the extraction of the
+// whole recording.
+static int streamProcessSegment(struct me_stream *stream, int last)
+{
+	struct me_data *inst = stream->inst;
+	struct detFuncSettings dfSettings;
+	int *activityRanges = NULL, *rangesCopy = NULL;
+	int a_size = 0;
+	int *noteRanges = NULL, *notePitches = NULL;
+	int num_notes = 0;
+
+	detFuncSettingsInit(&dfSettings);
+	dfSettings.numThreads = inst->num_threads;
+	dfSettings.filterType = inst->gammatone_filter;
+	dfSettings.psmMethod = inst->psm_method;
+	dfSettings.expPrecision = inst->exp_precision;
+
+	if(!last){
+		// the activity ranges are needed to split the buffer after the
+		// extraction, which takes ownership of the array
+		a_size = inst->silence_strategy(&(stream->buffer),
+						stream->length,
+						inst->silence_window,
+						inst->silence_spacing,
+						stream->samplerate,
+						inst->silence_mode,
+						&activityRanges);
+		if(a_size == -1){
+			return -1;
+		}
+		if(a_size > 0){
+			rangesCopy = malloc(sizeof(int) * a_size);
+			if(rangesCopy == NULL){
+				free(activityRanges);
+				return -1;
+			}
+			memcpy(rangesCopy, activityRanges,
+			       sizeof(int) * a_size);
+		}
+	}
+
+	// segments shorter than a single pitch window hold no notes
+	if(stream->length >= inst->pitch_window
+	   && stream->length > stream->context){
+		audioInfo info = {stream->length, stream->samplerate};
+		float *segment = stream->buffer;
+		num_notes = ExtractMelodyNotes(&segment, info,
+				inst->pitch_window, inst->pitch_padded,
+				inst->pitch_spacing, inst->pitch_strategy,
+				inst->onset_window, inst->onset_padded,
+				inst->onset_spacing, inst->onset_strategy,
+				inst->silence_window, inst->silence_spacing,
+				inst->silence_mode, inst->silence_strategy,
+				inst->hps, inst->tuning,
+				inst->concurrent_stages, inst->voiced_pitch,
+				inst->voiced_onsets, &dfSettings,
+				inst->verbose, NULL, rangesCopy, a_size,
+				&noteRanges, &notePitches);
+		if(num_notes == -1){
+			free(activityRanges);
+			return -1;
+		}
+	} else {
+		free(rangesCopy);
+	}
+
+	int split = stream->length;
+	int keep = stream->length;
+	if(!last){
+		split = streamSplitIndex(stream, activityRanges, a_size,
+					 noteRanges, num_notes);
+		keep = streamKeepIndex(stream, split, noteRanges, num_notes);
+	}
+	free(activityRanges);
+
+	int result = 1;
+	for(int i = 0; i < num_notes && result == 1; i++){
+		if(noteRanges[2*i] < stream->context){
+			// the note was found by the previous segment
+			continue;
+		}
+		if(noteRanges[2*i] >= split){
+			break;
+		}
+		int start = noteRanges[2*i] + stream->offset;
+		int stop = noteRanges[2*i+1] + stream->offset;
+		result = (intListAppend(stream->noteRanges, start) == 1
+			  && intListAppend(stream->noteRanges, stop) == 1
+			  && intListAppend(stream->notePitches,
+					   notePitches[i]) == 1) ? 1 : -1;
+	}
+	free(noteRanges);
+	free(notePitches);
+	if(result != 1){
+		return -1;
+	}
+
+	memmove(stream->buffer, stream->buffer + keep,
+		sizeof(float) * (stream->length - keep));
+	stream->length -= keep;
+	stream->offset += keep;
+	stream->context = split - keep;
+	return 1;
+}
+
+int me_stream_push(struct me_stream *stream, const float *input, int length)
+{
+	if(stream->failed){
+		return -1;
+	}
+	while(length > 0){
+		int count = stream->inst->stream_segment - stream->length;
+		if(count > length){
+			count = length;
+		}
+		memcpy(stream->buffer + stream->length, input,
+		       sizeof(float) * count);
+		stream->length += count;
+		input += count;
+		length -= count;
+
+		if(stream->length == stream->inst->stream_segment){
+			if(streamProcessSegment(stream, 0) != 1){
+				stream->failed = 1;
+				return -1;
+			}
+		}
+	}
+	return stream->notePitches->length;
+}
+
+int me_stream_notes(struct me_stream *stream, const int **noteRanges,
+		    const int **notePitches)
+{
+	(*noteRanges) = stream->noteRanges->array;
+	(*notePitches) = stream->notePitches->array;
+	return stream->notePitches->length;
+}
+
+struct Midi* me_stream_finish(struct me_stream *stream)
+{
+	struct me_data *inst = stream->inst;
+	struct Midi* midi = NULL;
+
+	if(!stream->failed && stream->length > 0){
+		stream->failed = (streamProcessSegment(stream, 1) != 1);
+	}
+
+	int num_notes = stream->notePitches->length;
+	if(!stream->failed && num_notes > 0){
+		if (inst->prefix != NULL){
+			// Here we save the note data
+			char *noteFile = malloc(sizeof(char) * (strlen(inst->prefix)+11));
+			strcpy(noteFile,inst->prefix);
+			strcat(noteFile,"_notes.txt");
+			SaveNotesTxt(noteFile, stream->noteRanges->array,
+				     stream->notePitches->array, num_notes,
+				     stream->samplerate);
+			free(noteFile);
+		}
+		midi = GenerateMIDIFromNotes(stream->notePitches->array,
+					     stream->noteRanges->array,
+					     num_notes, stream->samplerate,
+					     inst->verbose);
+		if(midi == NULL){
+			printf("Midi generation failed\n");
+			fflush(NULL);
+		}
+	}
+
+	if(inst->fftw_wisdom != NULL){
+		if(fftPlanCacheExportWisdom(inst->fftw_wisdom) == -1){
+			printf("failed to save FFTW wisdom to %s\n",
+			       inst->fftw_wisdom);
+		}
+	}
+
+	free(stream->buffer);
+	intListDestroy(stream->noteRanges);
+	intListDestroy(stream->notePitches);
+	free(stream);
 	return midi;
 }
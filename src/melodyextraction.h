@@ -55,6 +55,15 @@ struct me_settings{
 	int silence_mode;
 	int hps;
 	int tuning;
+	int concurrent_stages;
+	int voiced_pitch;
+	int voiced_onsets;
+	int num_threads;
+	char * gammatone_filter;
+	char * psm_method;
+	char * exp_precision;
+	char * fftw_wisdom;
+	char * stream_segment;
 	int verbose;
 };
 
@@ -74,4 +83,36 @@ void me_data_free(struct me_data *inst);
 
 struct Midi* me_process(float **input, audioInfo info, struct me_data *inst);
 
+// The following processes audio that is passed in chunks, rather than all at
+// once. The audio is buffered until stream_segment frames are available. The
+// buffer is processed like a complete recording and split in its last half,
+// at the middle of the silence preceding its last activity range (or at the
+// middle of the gap preceding its last note, if there isn't one). The notes
+// that start before the split are kept. The audio following the split, along
+// with up to 3.5s of the audio preceding it (half of the window that
+// normalizes the onset detection function, but no more than a quarter of
+// stream_segment), is kept for the next segment. This bounds the memory to
+// what is needed to process stream_segment frames. The notes are closest to
+// the ones found by me_process when stream_segment is at least 14s.
+struct me_stream;
+
+// create a stream that uses the settings of inst (which must outlive the
+// stream). Returns NULL if the memory can't be allocated
+struct me_stream* me_stream_open(struct me_data *inst, int samplerate);
+
+// pass the next length frames of audio to the stream. Returns the number of
+// notes finalized so far or -1 if an error occured
+int me_stream_push(struct me_stream *stream, const float *input, int length);
+
+// provides the notes finalized so far. noteRanges holds 2 entries per note
+// (the first frame of the note and the frame following it) and notePitches
+// holds the midi value of each note. The arrays remain valid until the next
+// call to me_stream_push or me_stream_finish. Returns the number of notes
+int me_stream_notes(struct me_stream *stream, const int **noteRanges,
+		    const int **notePitches);
+
+// process the remaining audio, destroy the stream and return the midi of all
+// of the notes (NULL if no notes were found or an error occured)
+struct Midi* me_stream_finish(struct me_stream *stream);
+
 #endif	/* MELODYEXTRACTION_H */
@@ -0,0 +1,308 @@
+#ifndef FASTEXP_H
+#define FASTEXP_H
+
+#include <stdint.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define FASTEXP_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define FASTEXP_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+/// The approximations of the gaussian, e^(-y), provided by this file. The
+/// largest relative errors over 0 <= y < FASTEXP_MAX_ARG (measured against
+/// the double precision exp) are:
+///
+/// | precision                 | max relative error    | float operations |
+/// |---------------------------|-----------------------|------------------|
+/// | EXP_PRECISION_SCHRAUDOLPH | 5e-2 (y < 8), 1e-1 at | 2 (+ 2 integer)  |
+/// |                           | y = 20, 0.4 at y = 87 |                  |
+/// | EXP_PRECISION_POLY3       | 8e-5                  | 10 (+ 3 integer) |
+/// | EXP_PRECISION_ACCURATE    | 8.2e-8 (1.4 ulp)      | 20 (+ 3 integer) |
+///
+/// The error of EXP_PRECISION_SCHRAUDOLPH grows with y because its slope,
+/// FASTEXP_A, is rounded from 2^7/ln(2) = 184.66.
+///
+/// With AVX2, a pooled summary matrix window of 137 samples takes about 6 us
+/// with EXP_PRECISION_SCHRAUDOLPH, 12 us with EXP_PRECISION_POLY3 and 22 us
+/// with EXP_PRECISION_ACCURATE.
+enum expPrecision{
+	/// Schraudolph's approximation: the high 16 bits of the float are set
+	/// to a linear function of y, so e^(-y) is linearly interpolated
+	/// between powers of 2
+	EXP_PRECISION_SCHRAUDOLPH = 0,
+	/// y is split into an integer power of 2 and a fraction, f, in
+	/// [-0.5, 0.5], and 2^f is approximated by a cubic minimax polynomial
+	EXP_PRECISION_POLY3 = 1,
+	/// The argument reduction of EXP_PRECISION_POLY3 is done in extended
+	/// precision (ln(2) is split into 2 floats) and e^r is approximated by
+	/// a polynomial of degree 6 (the same approach as the Cephes expf)
+	EXP_PRECISION_ACCURATE = 2,
+};
+
+/// The approximations are only valid for y < FASTEXP_MAX_ARG (beyond it,
+/// e^(-y) is below FLT_MIN). The callers are responsible for masking larger
+/// arguments to 0. This is the square of the EXP_UPPER_BOUND used by the
+/// pooled summary matrix kernels.
+#define FASTEXP_MAX_ARG 87.33f
+
+#define FASTEXP_A 184.0f
+#define FASTEXP_C 16249.0f
+#define FASTEXP_LOG2E 1.44269504088896341f
+// adding and subtracting 1.5*2^23 rounds a float to the nearest integer
+#define FASTEXP_ROUND 12582912.0f
+// ln(2) = FASTEXP_LN2_HI + FASTEXP_LN2_LO, where FASTEXP_LN2_HI has few
+// enough bits that n*FASTEXP_LN2_HI is exact
+#define FASTEXP_LN2_HI 0.693359375f
+#define FASTEXP_LN2_LO -2.12194440e-4f
+// the minimax polynomial of 2^f over [-0.5, 0.5] (relative error)
+#define FASTEXP_P3_0 0.99992807f
+#define FASTEXP_P3_1 0.69326099f
+#define FASTEXP_P3_2 0.24261112f
+#define FASTEXP_P3_3 0.05517167f
+// e^r = 1 + r + r^2*P(r) over [-ln(2)/2, ln(2)/2]
+#define FASTEXP_P6_0 1.9875691500e-4f
+#define FASTEXP_P6_1 1.3981999507e-3f
+#define FASTEXP_P6_2 8.3334519073e-3f
+#define FASTEXP_P6_3 4.1665795894e-2f
+#define FASTEXP_P6_4 1.6666665459e-1f
+#define FASTEXP_P6_5 5.0000001201e-1f
+
+/* The scalar and vectorized implementations below perform exactly the same
+ * sequence of floating point operations (without fused multiply-adds), so a
+ * lane of a vector always matches the scalar result bitwise. The float is
+ * built from its bits with integer arithmetic, which (unlike a union of a
+ * float and 2 shorts) doesn't depend on the endianness. */
+
+static inline float fastExpFromBits(int32_t bits)
+{
+	float f;
+	memcpy(&f, &bits, sizeof(float));
+	return f;
+}
+
+static inline int32_t fastExpToBits(float f)
+{
+	int32_t bits;
+	memcpy(&bits, &f, sizeof(float));
+	return bits;
+}
+
+/// Schraudolph's approximation, given the argument that has already been
+/// mapped to the high 16 bits of the float (FASTEXP_A*(-y) + FASTEXP_C).
+/// This allows callers to fold a scale factor into FASTEXP_A.
+static inline float fastExpSchraudolphArg(float arg)
+{
+	return fastExpFromBits((int32_t)arg << 16);
+}
+
+/// e^(-y) with EXP_PRECISION_SCHRAUDOLPH
+static inline float fastExpSchraudolph(float y)
+{
+	return fastExpSchraudolphArg(FASTEXP_A * (-y) + FASTEXP_C);
+}
+
+/// e^(-y) with EXP_PRECISION_POLY3
+static inline float fastExpPoly3(float y)
+{
+	float z = -y * FASTEXP_LOG2E;
+	float t = z + FASTEXP_ROUND;
+	int32_t n = fastExpToBits(t) - fastExpToBits(FASTEXP_ROUND);
+	float f = z - (t - FASTEXP_ROUND);
+	float p = FASTEXP_P3_0 + f * (FASTEXP_P3_1 + f * (FASTEXP_P3_2 +
+							  f * FASTEXP_P3_3));
+	return p * fastExpFromBits((n + 127) << 23);
+}
+
+/// e^(-y) with EXP_PRECISION_ACCURATE
+static inline float fastExpAccurate(float y)
+{
+	float t = -y * FASTEXP_LOG2E + FASTEXP_ROUND;
+	int32_t n = fastExpToBits(t) - fastExpToBits(FASTEXP_ROUND);
+	float fn = t - FASTEXP_ROUND;
+	float r = (-y - fn * FASTEXP_LN2_HI) - fn * FASTEXP_LN2_LO;
+	float p = FASTEXP_P6_0;
+	p = p * r + FASTEXP_P6_1;
+	p = p * r + FASTEXP_P6_2;
+	p = p * r + FASTEXP_P6_3;
+	p = p * r + FASTEXP_P6_4;
+	p = p * r + FASTEXP_P6_5;
+	p = (p * (r * r) + r) + 1.0f;
+	return p * fastExpFromBits((n + 127) << 23);
+}
+
+/// e^(-y) with the given precision. When precision is a constant, the switch
+/// is resolved at compile time.
+__attribute__((always_inline))
+static inline float fastExp(float y, enum expPrecision precision)
+{
+	switch(precision){
+	case EXP_PRECISION_POLY3:
+		return fastExpPoly3(y);
+	case EXP_PRECISION_ACCURATE:
+		return fastExpAccurate(y);
+	default:
+		return fastExpSchraudolph(y);
+	}
+}
+
+#ifdef FASTEXP_HAVE_X86
+/// The SSE2 counterpart of fastExp (4 lanes)
+__attribute__((target("sse2"), always_inline))
+static inline __m128 fastExpSSE2(__m128 y, enum expPrecision precision)
+{
+	const __m128 negY = _mm_xor_ps(_mm_set1_ps(-0.0f), y);
+	const __m128 round = _mm_set1_ps(FASTEXP_ROUND);
+	const __m128i roundBits = _mm_set1_epi32(fastExpToBits(FASTEXP_ROUND));
+	__m128 t, p, r, fn;
+	__m128i n;
+
+	if (precision == EXP_PRECISION_SCHRAUDOLPH){
+		__m128 arg = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(FASTEXP_A),
+						   negY),
+					_mm_set1_ps(FASTEXP_C));
+		return _mm_castsi128_ps(_mm_slli_epi32(_mm_cvttps_epi32(arg),
+						       16));
+	}
+
+	t = _mm_add_ps(_mm_mul_ps(negY, _mm_set1_ps(FASTEXP_LOG2E)), round);
+	n = _mm_sub_epi32(_mm_castps_si128(t), roundBits);
+	fn = _mm_sub_ps(t, round);
+	if (precision == EXP_PRECISION_POLY3){
+		r = _mm_sub_ps(_mm_mul_ps(negY, _mm_set1_ps(FASTEXP_LOG2E)),
+			       fn);
+		p = _mm_add_ps(_mm_set1_ps(FASTEXP_P3_2),
+			       _mm_mul_ps(r, _mm_set1_ps(FASTEXP_P3_3)));
+		p = _mm_add_ps(_mm_set1_ps(FASTEXP_P3_1), _mm_mul_ps(r, p));
+		p = _mm_add_ps(_mm_set1_ps(FASTEXP_P3_0), _mm_mul_ps(r, p));
+	} else {
+		r = _mm_sub_ps(_mm_sub_ps(negY, _mm_mul_ps(fn,
+				_mm_set1_ps(FASTEXP_LN2_HI))),
+			       _mm_mul_ps(fn, _mm_set1_ps(FASTEXP_LN2_LO)));
+		p = _mm_set1_ps(FASTEXP_P6_0);
+		p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(FASTEXP_P6_1));
+		p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(FASTEXP_P6_2));
+		p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(FASTEXP_P6_3));
+		p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(FASTEXP_P6_4));
+		p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(FASTEXP_P6_5));
+		p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p, _mm_mul_ps(r, r)), r),
+			       _mm_set1_ps(1.0f));
+	}
+	n = _mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23);
+	return _mm_mul_ps(p, _mm_castsi128_ps(n));
+}
+
+/// The AVX2 counterpart of fastExp (8 lanes)
+__attribute__((target("avx2"), always_inline))
+static inline __m256 fastExpAVX2(__m256 y, enum expPrecision precision)
+{
+	const __m256 negY = _mm256_xor_ps(_mm256_set1_ps(-0.0f), y);
+	const __m256 round = _mm256_set1_ps(FASTEXP_ROUND);
+	const __m256i roundBits = _mm256_set1_epi32(
+		fastExpToBits(FASTEXP_ROUND));
+	__m256 t, p, r, fn;
+	__m256i n;
+
+	if (precision == EXP_PRECISION_SCHRAUDOLPH){
+		__m256 arg = _mm256_add_ps(
+			_mm256_mul_ps(_mm256_set1_ps(FASTEXP_A), negY),
+			_mm256_set1_ps(FASTEXP_C));
+		return _mm256_castsi256_ps(_mm256_slli_epi32(
+			_mm256_cvttps_epi32(arg), 16));
+	}
+
+	t = _mm256_add_ps(_mm256_mul_ps(negY, _mm256_set1_ps(FASTEXP_LOG2E)),
+			  round);
+	n = _mm256_sub_epi32(_mm256_castps_si256(t), roundBits);
+	fn = _mm256_sub_ps(t, round);
+	if (precision == EXP_PRECISION_POLY3){
+		r = _mm256_sub_ps(
+			_mm256_mul_ps(negY, _mm256_set1_ps(FASTEXP_LOG2E)),
+			fn);
+		p = _mm256_add_ps(
+			_mm256_set1_ps(FASTEXP_P3_2),
+			_mm256_mul_ps(r, _mm256_set1_ps(FASTEXP_P3_3)));
+		p = _mm256_add_ps(_mm256_set1_ps(FASTEXP_P3_1),
+				  _mm256_mul_ps(r, p));
+		p = _mm256_add_ps(_mm256_set1_ps(FASTEXP_P3_0),
+				  _mm256_mul_ps(r, p));
+	} else {
+		r = _mm256_sub_ps(
+			_mm256_sub_ps(negY,
+				      _mm256_mul_ps(fn, _mm256_set1_ps(
+					      FASTEXP_LN2_HI))),
+			_mm256_mul_ps(fn, _mm256_set1_ps(FASTEXP_LN2_LO)));
+		p = _mm256_set1_ps(FASTEXP_P6_0);
+		p = _mm256_add_ps(_mm256_mul_ps(p, r),
+				  _mm256_set1_ps(FASTEXP_P6_1));
+		p = _mm256_add_ps(_mm256_mul_ps(p, r),
+				  _mm256_set1_ps(FASTEXP_P6_2));
+		p = _mm256_add_ps(_mm256_mul_ps(p, r),
+				  _mm256_set1_ps(FASTEXP_P6_3));
+		p = _mm256_add_ps(_mm256_mul_ps(p, r),
+				  _mm256_set1_ps(FASTEXP_P6_4));
+		p = _mm256_add_ps(_mm256_mul_ps(p, r),
+				  _mm256_set1_ps(FASTEXP_P6_5));
+		p = _mm256_add_ps(
+			_mm256_add_ps(_mm256_mul_ps(p, _mm256_mul_ps(r, r)),
+				      r),
+			_mm256_set1_ps(1.0f));
+	}
+	n = _mm256_slli_epi32(_mm256_add_epi32(n, _mm256_set1_epi32(127)), 23);
+	return _mm256_mul_ps(p, _mm256_castsi256_ps(n));
+}
+#endif /* FASTEXP_HAVE_X86 */
+
+#ifdef FASTEXP_HAVE_NEON
+/// The NEON counterpart of fastExp (4 lanes)
+__attribute__((always_inline))
+static inline float32x4_t fastExpNEON(float32x4_t y,
+				      enum expPrecision precision)
+{
+	const float32x4_t negY = vnegq_f32(y);
+	const float32x4_t round = vdupq_n_f32(FASTEXP_ROUND);
+	const int32x4_t roundBits = vdupq_n_s32(fastExpToBits(FASTEXP_ROUND));
+	float32x4_t t, p, r, fn;
+	int32x4_t n;
+
+	if (precision == EXP_PRECISION_SCHRAUDOLPH){
+		float32x4_t arg = vaddq_f32(vmulq_f32(vdupq_n_f32(FASTEXP_A),
+						      negY),
+					    vdupq_n_f32(FASTEXP_C));
+		return vreinterpretq_f32_s32(vshlq_n_s32(vcvtq_s32_f32(arg),
+							 16));
+	}
+
+	t = vaddq_f32(vmulq_f32(negY, vdupq_n_f32(FASTEXP_LOG2E)), round);
+	n = vsubq_s32(vreinterpretq_s32_f32(t), roundBits);
+	fn = vsubq_f32(t, round);
+	if (precision == EXP_PRECISION_POLY3){
+		r = vsubq_f32(vmulq_f32(negY, vdupq_n_f32(FASTEXP_LOG2E)), fn);
+		p = vaddq_f32(vdupq_n_f32(FASTEXP_P3_2),
+			      vmulq_f32(r, vdupq_n_f32(FASTEXP_P3_3)));
+		p = vaddq_f32(vdupq_n_f32(FASTEXP_P3_1), vmulq_f32(r, p));
+		p = vaddq_f32(vdupq_n_f32(FASTEXP_P3_0), vmulq_f32(r, p));
+	} else {
+		r = vsubq_f32(vsubq_f32(negY, vmulq_f32(fn,
+				vdupq_n_f32(FASTEXP_LN2_HI))),
+			      vmulq_f32(fn, vdupq_n_f32(FASTEXP_LN2_LO)));
+		p = vdupq_n_f32(FASTEXP_P6_0);
+		p = vaddq_f32(vmulq_f32(p, r), vdupq_n_f32(FASTEXP_P6_1));
+		p = vaddq_f32(vmulq_f32(p, r), vdupq_n_f32(FASTEXP_P6_2));
+		p = vaddq_f32(vmulq_f32(p, r), vdupq_n_f32(FASTEXP_P6_3));
+		p = vaddq_f32(vmulq_f32(p, r), vdupq_n_f32(FASTEXP_P6_4));
+		p = vaddq_f32(vmulq_f32(p, r), vdupq_n_f32(FASTEXP_P6_5));
+		p = vaddq_f32(vaddq_f32(vmulq_f32(p, vmulq_f32(r, r)), r),
+			      vdupq_n_f32(1.0f));
+	}
+	n = vshlq_n_s32(vaddq_s32(n, vdupq_n_s32(127)), 23);
+	return vmulq_f32(p, vreinterpretq_f32_s32(n));
+}
+#endif /* FASTEXP_HAVE_NEON */
+
+#endif /* FASTEXP_H */
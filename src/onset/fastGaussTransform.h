@@ -1 +1,61 @@
-float PSM_Gauss_Fast(float* arr, int winSize, float sigma);
\ No newline at end of file
+#ifndef FASTGAUSSTRANSFORM_H
+#define FASTGAUSSTRANSFORM_H
+
+/// The largest supported order of the Hermite expansion
+#define FGT_MAX_ORDER 8
+
+/// Holds the parameters and the work arrays used to evaluate the pooled
+/// summary matrix entries with the Fast Gauss Transform. It is allocated once
+/// and then reused for every window.
+struct fgtPSM;
+
+/// Allocates a new fgtPSM. Returns NULL if the allocation fails or if any
+/// argument is out of range.
+///
+/// @param[in] winSize The correntropy window size of the windows that will be
+///            evaluated (see fgtPSMEntryContrib)
+/// @param[in] numCenters The number of boxes (each with its own expansion
+///            center) that the range of a window is divided into. This must
+///            be positive.
+/// @param[in] order The number of terms, p, of the Hermite expansion. This
+///            must be between 1 and FGT_MAX_ORDER.
+///
+/// @par Note:
+/// numCenters and order control the accuracy. Increasing either one reduces
+/// the error, while the cost of a window is proportional to
+/// winSize*numCenters*order (rather than winSize^2 for the direct
+/// evaluation). The error of a box falls off as (w/sigma)^(p+1), where w is
+/// the width of the box, so it also depends on the range of the samples in
+/// units of sigma.
+struct fgtPSM* fgtPSMNew(int winSize, int numCenters, int order);
+
+/// Frees the fgtPSM
+void fgtPSMDestroy(struct fgtPSM *fgt);
+
+/// Approximates the contribution of a window to the pooled summary matrix
+/// with the Fast Gauss Transform
+///
+/// This evaluates the same sum as the implementations of psmEntryContribFunc
+/// (see psmKernel.h), except that x is NOT divided by sqrt(2)*sigma
+/// beforehand and that the gaussian is evaluated with expf rather than with
+/// a bit-level approximation.
+///
+/// @param[in] fgt The work arrays and accuracy parameters
+/// @param[in] x The window. This must hold 2*winSize+1 entries.
+/// @param[in] sigma The kernel width of the window
+///
+/// @return The contribution of the window to the pooled summary matrix
+///
+/// @par Implementation Notes:
+/// The range of x is divided into numCenters boxes of equal width. Every row
+/// i of the sum is the discrete Gauss transform of the targets
+/// x[i+1..i+winSize], evaluated at x[i]. The targets of a box are replaced by
+/// the first `order` Hermite moments about the center of the box, which are
+/// updated as the targets slide by one entry from row to row (one target is
+/// removed and one is added). When order is 1, the moment is just the number
+/// of targets in the box. If the boxes are wider than sqrt(2)*sigma, the
+/// expansion converges too slowly, and the window is evaluated directly with
+/// psmEntryContribGet (after dividing x by sqrt(2)*sigma).
+float fgtPSMEntryContrib(struct fgtPSM *fgt, float *x, float sigma);
+
+#endif /* FASTGAUSSTRANSFORM_H */
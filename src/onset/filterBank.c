@@ -20,8 +20,8 @@ struct filterBank* filterBankNew(int numChannels, int lenChannels, int overlap,
 		printf("Error: lenChannels must be postive\n");
 		return NULL;
 	}
-	if (overlap<0){
-		printf("Error: overlap must be >=0\n");
+	if ((overlap<0) || (overlap>=lenChannels)){
+		printf("Error: overlap must be >=0 and < lenChannels\n");
 		return NULL;
 	}
 	if (samplerate<1){
@@ -48,7 +48,7 @@ struct filterBank* filterBankNew(int numChannels, int lenChannels, int overlap,
 	(fB->cDArray) = malloc(sizeof(struct channelData)*numChannels);
 	if ((fB->cDArray) == NULL){
 		free(fB);
-		return fB;
+		return NULL;
 	}
 
 	//printf("Constructing the channel Data array\n");
@@ -59,14 +59,15 @@ struct filterBank* filterBankNew(int numChannels, int lenChannels, int overlap,
 	}
 	centralFreqMapper(numChannels, minFreq, maxFreq, fcArray);
 
-	/*
 	for (i=0; i<numChannels; i++){
 		// fill in the channel data
-
+		(fB->cDArray)[i].cf = fcArray[i];
+		sosCoeff(fcArray[i], samplerate, (fB->cDArray)[i].coef);
+		memset((fB->cDArray)[i].state, 0,
+		       sizeof((fB->cDArray)[i].state));
 	}
-	*/
 	fB->numChannels = numChannels;
-	fB->lenChannels = fB->lenChannels;
+	fB->lenChannels = lenChannels;
 	fB->overlap = overlap;
 	fB->samplerate = samplerate;
 
@@ -118,8 +119,11 @@ void swap_chunk(float **a, float **b){
 void filterBankFilteringHelper(struct channelData * cD,
 			       float* inputChunk,
 			       float** leadingSpectraChunk,
-			       int nsamples, int samplerate){
-	//gammatoneFilterChunk();
+			       int nsamples){
+	/* the state of the 4 sections picks up where the previous chunk left 
+	 * off */
+	sosGammatoneFastChunk(inputChunk, *leadingSpectraChunk, cD->coef,
+			      cD->state, nsamples);
 }
 
 void filterBankOverlapHelper(float** leadingSpectraChunk,
@@ -133,16 +137,25 @@ void filterBankOverlapHelper(float** leadingSpectraChunk,
 
 void filterBankFirstChunk(struct filterBank* fB, float* inputChunk,
 			  int nsamples, float** leadingSpectraChunk){
-	int i, offset;
+	int i, j, offset;
 	float* cur_chunk;
 	
 	for (i=0;i<(fB->numChannels);i++){
 		offset = i*(fB->lenChannels);
 		cur_chunk = (*leadingSpectraChunk)+offset;
+
+		/* this is the start of a recording, so reset the state */
+		memset((fB->cDArray)[i].state, 0,
+		       sizeof((fB->cDArray)[i].state));
 		filterBankFilteringHelper(((fB->cDArray)+i),
 					  inputChunk,
 					  (&cur_chunk),
-					  nsamples, (fB->samplerate));
+					  nsamples);
+
+		/* pad the remainder with zeros */
+		for (j=nsamples; j<(fB->lenChannels); j++){
+			cur_chunk[j] = 0.0;
+		}
 	}
 }
 
@@ -169,12 +182,10 @@ void filterBankUpdateChunk(struct filterBank* fB, float* inputChunk,
 		offset = i*(fB->lenChannels);
 
 		curLeadingRow = (*leadingSpectraChunk)+offset;
-		curTrailingRow = (*trailingSpectraChunk)+offset;
+		curTrailingRow = ((*trailingSpectraChunk) + offset
+				  + (fB->lenChannels) - overlap);
 		
 		/* first we copy in the overlapping data */
-		//filterBankOverlapHelper(&((*leadingSpectraChunk)+offset),
-		//			&((*trailingSpectraChunk)+offset),
-		//			overlap);
 		filterBankOverlapHelper(&curLeadingRow,
 					&curTrailingRow,
 					overlap);
@@ -185,14 +196,10 @@ void filterBankUpdateChunk(struct filterBank* fB, float* inputChunk,
 		 */
 		offset += overlap;
 		curLeadingRow = (*leadingSpectraChunk)+offset;
-		//filterBankFilteringHelper(&((fB->cDArray)[i]),
-		//			  inputChunk,
-		//			  &((*leadingSpectraChunk)+offset),
-		//			  nsamples, (fB->samplerate));
 		filterBankFilteringHelper(((fB->cDArray)+i),
 					  inputChunk,
 					  &curLeadingRow,
-					  nsamples, (fB->samplerate));
+					  nsamples);
 	}
 }
 
@@ -222,12 +229,10 @@ void filterBankFinalChunk(struct filterBank* fB, float* inputChunk,
 		offset = i*lenChannels;
 
 		curLeadingRow = (*leadingSpectraChunk)+offset;
-		curTrailingRow = (*trailingSpectraChunk)+offset;
+		curTrailingRow = ((*trailingSpectraChunk) + offset
+				  + lenChannels - overlap);
 		
 		/* first we copy in the overlapping data */
-		//filterBankOverlapHelper(&((*leadingSpectraChunk)+offset),
-		//			&((*trailingSpectraChunk)+offset),
-		//			overlap);
 		filterBankOverlapHelper(&curLeadingRow, &curTrailingRow,
 					overlap);
 
@@ -240,7 +245,7 @@ void filterBankFinalChunk(struct filterBank* fB, float* inputChunk,
 			filterBankFilteringHelper(((fB->cDArray)+i),
 						  inputChunk,
 						  &curLeadingRow,
-						  nsamples, (fB->samplerate));
+						  nsamples);
 			/* finally we fill in the rest of the channels */
 			offset += nsamples;
 		}
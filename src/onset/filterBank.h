@@ -46,14 +46,10 @@
 void centralFreqMapper(int numChannels, float minFreq, float maxFreq,
 		       float* fcArray);
 
-// The remainder of this header file was written with the intention of being
-// used to process chunks. This functionallity does not currently exist (the
-// following could probably be excised from the main development branch)
-
-
-// Had not originally thought that I would need to individually allocate
-// memory for the pointer to every member of channelData (it's obvious now).
-// Need to modify implementation
+// The remainder of this header file is used to filter a recording in
+// consecutive chunks. Each channel keeps its coefficients and the state of its
+// 4 second order sections between chunks, so the filtered output of a channel
+// is identical to calling sosGammatoneFast once over the concatenated input.
 
 struct filterBank{
 	
@@ -67,8 +63,12 @@ struct filterBank{
 
 struct channelData{
 	float cf; // center frequency
+	float coef[24]; // coefficients of the 4 sections, from sosCoeff
+	float state[8]; // d1 and d2 of each section, carried between chunks
 };
 
+/// Allocates a filterBank. overlap must be smaller than lenChannels. Returns
+/// NULL if an argument is invalid or an allocation fails.
 struct filterBank* filterBankNew(int numChannels, int lenChannels, int overlap,
 				 int samplerate, float minFreq, float maxFreq);
 
@@ -80,6 +80,15 @@ void filterBankDestroy(struct filterBank* fB);
  * function is used when you feed in the last chunk 
  *
  * for all functions, nsamples is the number of samples in the inputChunk
+ *
+ * The spectra chunks hold numChannels rows of lenChannels samples. Every row
+ * of a chunk after the first starts with the last overlap samples of the
+ * previous chunk's row, followed by the newly filtered samples. Consequently,
+ * nsamples must be lenChannels for the first chunk and lenChannels - overlap
+ * for the remaining chunks. It may be smaller for the first or the last
+ * chunk, in which case the rest of the rows are padded with zeros. The first
+ * chunk also resets the filter state, so a filterBank can be reused for
+ * another recording.
  */
 
 void filterBankFirstChunk(struct filterBank* fB, float* inputChunk,
@@ -92,5 +101,3 @@ void filterBankUpdateChunk(struct filterBank* fB, float* inputChunk,
 void filterBankFinalChunk(struct filterBank* fB, float* inputChunk,
 			  int nsamples, float** leadingSpectraChunk,
 			  float** trailingSpectraChunk);
-
-
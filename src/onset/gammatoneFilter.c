@@ -252,16 +252,18 @@ void sosGammatone(float* data, float* output, float centralFreq,
 
 
 
-//float version of biquadFilter
-void biquadFilterf(float *coef, float *x, float *y, int length)
+/* float version of biquadFilter that reads the state variables from 
+ * state[0] = d1 and state[1] = d2 at the start and writes them back at the 
+ * end. This allows a recording to be filtered in consecutive chunks; the output 
+ * is identical to filtering the concatenated chunks in a single call.
+ */
+void biquadFilterfState(float *coef, float *state, float *x, float *y,
+			int length)
 {
 	float d1, d2, cur_x, cur_y, a0,a1,a2,b0,b1,b2;
 	int n;
-	/* d1 and d2 are state variables, for now asssume they start at 0,
-	 * because before a recording there is silence. If we are chunking the 
-	 * recording we will need to track d1 and d2 between chunks. */
-	d1 = 0;
-	d2 = 0;
+	d1 = state[0];
+	d2 = state[1];
 
 	/* set the feedforward coefficients */
 	b0 = coef[0]; b1 = coef[1]; b2 = coef[2];
@@ -285,6 +287,18 @@ void biquadFilterf(float *coef, float *x, float *y, int length)
 		/* finally set y to cur_y */
 		y[n] = cur_y;
 	}
+
+	state[0] = d1;
+	state[1] = d2;
+}
+
+//float version of biquadFilter
+void biquadFilterf(float *coef, float *x, float *y, int length)
+{
+	/* d1 and d2 are state variables, for now asssume they start at 0,
+	 * because before a recording there is silence. */
+	float state[2] = {0, 0};
+	biquadFilterfState(coef, state, x, y, length);
 }
 
 //float version of cascadeBiquad
@@ -301,6 +315,18 @@ void cascadeBiquadf(int num_stages, float *coef, float *x, float *y,
 	}
 }
 
+/* state holds 2 entries per stage: the state variables of the ith stage are 
+ * state[2*i] = d1 and state[2*i+1] = d2. */
+void cascadeBiquadfState(int num_stages, float *coef, float *state, float *x,
+			 float *y, int length)
+{
+	biquadFilterfState(coef, state, x, y, length);
+	for (int i= 1; i<num_stages; i++){
+		biquadFilterfState((coef + (6*i)), (state + (2*i)), y, y,
+				   length);
+	}
+}
+
 //float version of numericalNormalize
 void numericalNormalizef(float centralFreq, int samplerate, float *coef)
 {
@@ -367,12 +393,175 @@ void sosCoeff(float centralFreq, int samplerate, float* coef)
 	}
 }
 
+/* A fused version of cascadeBiquadfState(4, ...) that is specialized for the 
+ * coefficients produced by sosCoeff:
+ *  - a0 = 1, so the division in the first difference equation is dropped
+ *  - b2 = 0, so d2[n] = -a2 * y[n]
+ *  - all 4 sections share the same poles (a1 and a2), since only b0 and b1
+ *    differ between the stages
+ * Rather than making 4 passes over the array, every sample is passed through
+ * all 4 sections while the state variables stay in registers.
+ *
+ * state holds d1 and d2 for each stage (as in cascadeBiquadfState).
+ */
+void sosGammatoneFastChunk(float* data, float* output, float* coef,
+			   float* state, int datalen)
+{
+	float b0_0, b0_1, b0_2, b0_3, b1_0, b1_1, b1_2, b1_3, a1, a2;
+	float d1_0, d1_1, d1_2, d1_3, d2_0, d2_1, d2_2, d2_3;
+	float y0, y1, y2, y3;
+	int n;
+
+	b0_0 = coef[0];  b1_0 = coef[1];
+	b0_1 = coef[6];  b1_1 = coef[7];
+	b0_2 = coef[12]; b1_2 = coef[13];
+	b0_3 = coef[18]; b1_3 = coef[19];
+	a1 = coef[4];
+	a2 = coef[5];
+
+	d1_0 = state[0]; d2_0 = state[1];
+	d1_1 = state[2]; d2_1 = state[3];
+	d1_2 = state[4]; d2_2 = state[5];
+	d1_3 = state[6]; d2_3 = state[7];
+
+	for (n = 0; n < datalen; n++){
+		float cur_x = data[n];
+
+		y0 = b0_0 * cur_x + d1_0;
+		d1_0 = b1_0 * cur_x - a1 * y0 + d2_0;
+		d2_0 = -a2 * y0;
+
+		y1 = b0_1 * y0 + d1_1;
+		d1_1 = b1_1 * y0 - a1 * y1 + d2_1;
+		d2_1 = -a2 * y1;
+
+		y2 = b0_2 * y1 + d1_2;
+		d1_2 = b1_2 * y1 - a1 * y2 + d2_2;
+		d2_2 = -a2 * y2;
+
+		y3 = b0_3 * y2 + d1_3;
+		d1_3 = b1_3 * y2 - a1 * y3 + d2_3;
+		d2_3 = -a2 * y3;
+
+		output[n] = y3;
+	}
+
+	state[0] = d1_0; state[1] = d2_0;
+	state[2] = d1_1; state[3] = d2_1;
+	state[4] = d1_2; state[5] = d2_2;
+	state[6] = d1_3; state[7] = d2_3;
+}
+
 void sosGammatoneFast(float* data, float* output, float centralFreq,
 		      int samplerate, int datalen)
 {
 	//modified sosGammatone that does not double the samplerate and uses floats instead of doubles.
 	//If the loss in accuracy is negligible, we should switch to this as it is significantly faster
 	float coef[24];
+	float state[8] = {0};
 	sosCoeff(centralFreq, samplerate, coef);
-	cascadeBiquadf(4, coef, data, output, datalen);
+	sosGammatoneFastChunk(data, output, coef, state, datalen);
+}
+
+void apgfCoeff(float centralFreq, int samplerate, int oneZero, float* coef)
+{
+	/* the poles are the same as those of the 4 sections of sosCoeff. The
+	 * gain is computed in double precision because it is the product of 4
+	 * small factors */
+	double delta_t = 1./(double)samplerate;
+	double cf = (double)centralFreq;
+	double b = 2*M_PI*1.019*24.7*(4.37*cf/1000. + 1); //bandwidth
+	double w = 2*M_PI*cf*delta_t;
+	double a1 = -2*cos(w)*exp(-b*delta_t);
+	double a2 = exp(-2*b*delta_t);
+	double re, im, gain;
+
+	/* the magnitude of each section's denominator at z = exp(I*w) */
+	re = 1 + a1*cos(w) + a2*cos(2*w);
+	im = a1*sin(w) + a2*sin(2*w);
+	gain = pow(re*re + im*im, 2.);
+	if (oneZero){
+		/* |1 - exp(-I*w)| = 2 * sin(w/2) */
+		gain /= 2*sin(w/2);
+	}
+	coef[0] = (float)gain;
+	coef[1] = (float)a1;
+	coef[2] = (float)a2;
+}
+
+/* The same Direct Form II Transposed structure as biquadFilterf, with 
+ * b0 = 1 and b1 = b2 = 0 for every section:
+ *  y[n] = x[n] + d1[n-1]
+ *  d1[n] = d2[n-1] - a1 * y[n]
+ *  d2[n] = -a2 * y[n]
+ */
+void apGammatoneChunk(float* data, float* output, float* coef, float* state,
+		      int datalen)
+{
+	float gain, a1, na2;
+	float d1_0, d1_1, d1_2, d1_3, d2_0, d2_1, d2_2, d2_3;
+	float y0, y1, y2, y3;
+	int n;
+
+	gain = coef[0];
+	a1 = coef[1];
+	na2 = -coef[2];
+
+	d1_0 = state[0]; d2_0 = state[1];
+	d1_1 = state[2]; d2_1 = state[3];
+	d1_2 = state[4]; d2_2 = state[5];
+	d1_3 = state[6]; d2_3 = state[7];
+
+	for (n = 0; n < datalen; n++){
+		y0 = gain * data[n] + d1_0;
+		d1_0 = d2_0 - a1 * y0;
+		d2_0 = na2 * y0;
+
+		y1 = y0 + d1_1;
+		d1_1 = d2_1 - a1 * y1;
+		d2_1 = na2 * y1;
+
+		y2 = y1 + d1_2;
+		d1_2 = d2_2 - a1 * y2;
+		d2_2 = na2 * y2;
+
+		y3 = y2 + d1_3;
+		d1_3 = d2_3 - a1 * y3;
+		d2_3 = na2 * y3;
+
+		output[n] = y3;
+	}
+
+	state[0] = d1_0; state[1] = d2_0;
+	state[2] = d1_1; state[3] = d2_1;
+	state[4] = d1_2; state[5] = d2_2;
+	state[6] = d1_3; state[7] = d2_3;
+}
+
+void apGammatone(float* data, float* output, float centralFreq,
+		 int samplerate, int datalen)
+{
+	float coef[3];
+	float state[8] = {0};
+	apgfCoeff(centralFreq, samplerate, 0, coef);
+	apGammatoneChunk(data, output, coef, state, datalen);
+}
+
+void ozGammatone(float* data, float* output, float centralFreq,
+		 int samplerate, int datalen)
+{
+	float coef[3];
+	float state[8] = {0};
+	int n;
+	apgfCoeff(centralFreq, samplerate, 1, coef);
+
+	/* apply the zero at DC (the recording is preceded by silence). Going 
+	 * backwards allows data and output to be the same array */
+	for (n = datalen - 1; n > 0; n--){
+		output[n] = data[n] - data[n-1];
+	}
+	if (datalen > 0){
+		output[0] = data[0];
+	}
+	apGammatoneChunk(output, output, coef, state, datalen);
 }
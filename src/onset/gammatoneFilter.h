@@ -1,3 +1,6 @@
+#ifndef GAMMATONEFILTER_H
+#define GAMMATONEFILTER_H
+
 void biquadFilter(double *coef, double *x, double *y, int length);
 
 void cascadeBiquad(int num_stages, double *coef, double *x, double *y,
@@ -41,7 +44,8 @@ void cascadeBiquad(int num_stages, double *coef, double *x, double *y,
 /// We could also optimize biquadFilter to always expect a0 = 1 (which is
 /// standard) which would remove `4*datalen` multiplications. If we tailored
 /// the implementation to this function in particular, we could also take
-/// advantage of the fact that b2 is always 0.
+/// advantage of the fact that b2 is always 0. sosGammatoneFastChunk applies
+/// all of these optimizations to the single precision implementation.
 ///
 /// @par Alternative Implementations
 /// There may be some benefits to using a FIR filter instead.  
@@ -70,3 +74,80 @@ void sosCoef(float centralFreq, int samplerate, double *coef);
 /// additional information.
 void sosGammatoneFast(float* data, float* output, float centralFreq,
 		      int samplerate, int datalen);
+
+/// The kernel of sosGammatoneFast: passes each sample through all 4 second
+/// order sections in a single pass over the data.
+///
+/// @param[in] coef The 24 coefficients computed by sosCoeff. The kernel
+///            assumes that a0 = 1 and b2 = 0 for every section and that all
+///            sections share a1 and a2.
+/// @param[in,out] state The 8 state variables (d1 and d2 of each section, laid
+///                out as in cascadeBiquadfState). Initialize them to zeros at
+///                the start of a recording; they are updated in place, so
+///                consecutive chunks can be filtered with successive calls.
+void sosGammatoneFastChunk(float* data, float* output, float* coef,
+			   float* state, int datalen);
+
+/// Computes the 24 single precision coefficients of the 4 second order
+/// sections used by sosGammatoneFast.
+void sosCoeff(float centralFreq, int samplerate, float* coef);
+
+/// Applies num_stages cascaded biquad filters (with the coefficients laid out
+/// as in cascadeBiquad) to x, while carrying the filter state between calls.
+///
+/// @param[in,out] state An array of 2*num_stages entries holding the d1 and
+///                d2 state variables of each stage. Initialize it to zeros
+///                before the first call; it is updated in place.
+///
+/// Filtering a signal in consecutive chunks with the same state array gives
+/// output identical to a single call over the whole signal.
+void cascadeBiquadfState(int num_stages, float *coef, float *state, float *x,
+			 float *y, int length);
+
+/// Identifies the IIR approximations of the gammatone filter that can be used
+/// by the filterbank.
+enum gammatoneFilterType{
+	GAMMATONE_SOS = 0, // sosGammatoneFast, the reference implementation
+	GAMMATONE_APGF = 1, // apGammatone, the All-Pole Gammatone Filter
+	GAMMATONE_OZGF = 2, // ozGammatone, the One-Zero Gammatone Filter
+};
+
+/// The All-Pole Gammatone Filter (APGF) described by Slaney (1993) and Lyon
+/// (1996). It is obtained by discarding the zeros of the 4 second order
+/// sections of sosGammatone; what remains is a cascade of 4 identical
+/// 2-pole resonators with the same poles. The response is normalized to have
+/// 0 dB gain at the central frequency.
+///
+/// @par
+/// The APGF costs 9 multiplications and 8 additions per sample, compared
+/// to 16 multiplications and 12 additions for sosGammatoneFast. Its response
+/// is less sharply attenuated below the central frequency (its low frequency
+/// tail has a constant gain rather than dropping towards 0 at DC).
+void apGammatone(float* data, float* output, float centralFreq,
+		 int samplerate, int datalen);
+
+/// The One-Zero Gammatone Filter (OZGF) described by Lyon (1996). It is the
+/// APGF with a single zero at DC, which removes the constant low frequency
+/// tail of the APGF and gives a closer approximation of the gammatone. The
+/// zero is the same for every channel, so a filterbank only needs to apply
+/// it once to the input (as a first difference) before the APGF cascade.
+/// The response is normalized to have 0 dB gain at the central frequency.
+void ozGammatone(float* data, float* output, float centralFreq,
+		 int samplerate, int datalen);
+
+/// Computes the 3 coefficients used by apGammatoneChunk: coef[0] is the
+/// gain, which is applied to the input, while coef[1] = a1 and
+/// coef[2] = a2 are the feedback coefficients shared by all 4 sections. If
+/// oneZero is nonzero, the gain also normalizes the zero of the OZGF.
+void apgfCoeff(float centralFreq, int samplerate, int oneZero, float* coef);
+
+/// The kernel of apGammatone and ozGammatone. For the OZGF, data must already
+/// hold the first difference of the input (x[n] - x[n-1]).
+///
+/// @param[in] coef The 3 coefficients computed by apgfCoeff
+/// @param[in,out] state The 8 state variables (d1 and d2 of each section).
+///                Initialize them to zeros at the start of a recording.
+void apGammatoneChunk(float* data, float* output, float* coef, float* state,
+		      int datalen);
+
+#endif /* GAMMATONEFILTER_H */
@@ -0,0 +1,385 @@
+#include <stddef.h>
+#include "gammatoneFilter.h"
+#include "gammatoneKernel.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define GAMMATONE_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define GAMMATONE_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+/* The number of samples filtered into the interleaved tile before it is
+ * transposed into the per-channel outputs. The tile stays in L1 cache. */
+#define GAMMATONE_TILE 64
+
+void gammatoneBankScalar(float* data, int datalen, int numChannels,
+			 float* coef, float** outputs)
+{
+	float state[8];
+	int c, i;
+	for (c = 0; c < numChannels; c++){
+		for (i = 0; i < 8; i++){
+			state[i] = 0;
+		}
+		sosGammatoneFastChunk(data, outputs[c], coef + 24*c, state,
+				      datalen);
+	}
+}
+
+void apgfBankScalar(float* data, int datalen, int numChannels,
+		    float* coef, float** outputs)
+{
+	float state[8];
+	int c, i;
+	for (c = 0; c < numChannels; c++){
+		for (i = 0; i < 8; i++){
+			state[i] = 0;
+		}
+		apGammatoneChunk(data, outputs[c], coef + 24*c, state, datalen);
+	}
+}
+
+/* Gathers entry k of the coefficients of every lane. The lanes past
+ * numChannels repeat the last channel; their output is discarded. */
+static inline void laneCoef(float* coef, int numChannels, int lanes, int k,
+			    float* out)
+{
+	for (int l = 0; l < lanes; l++){
+		int c = (l < numChannels) ? l : numChannels - 1;
+		out[l] = coef[24*c + k];
+	}
+}
+
+/* Copies the first len rows of the interleaved tile (lanes entries per
+ * sample) into the outputs of the channels, starting at index base */
+static inline void scatterTile(float* tile, int lanes, int numChannels,
+			       int base, int len, float** outputs)
+{
+	for (int c = 0; c < numChannels; c++){
+		float *out = outputs[c] + base;
+		for (int n = 0; n < len; n++){
+			out[n] = tile[n*lanes + c];
+		}
+	}
+}
+
+/* The vectorized implementations below mirror sosGammatoneFastChunk: each
+ * lane evaluates
+ *   y = b0 * x + d1
+ *   d1 = (b1 * x - a1 * y) + d2
+ *   d2 = (-a2) * y
+ * for the 4 sections in turn. The all-pole (APGF) implementations mirror
+ * apGammatoneChunk in the same way. The multiplications and additions are 
+ * kept separate (no FMA) so that every lane rounds like the scalar kernels. */
+#ifdef GAMMATONE_HAVE_X86
+__attribute__((target("sse2")))
+static void gammatoneBankSSE2(float* data, int datalen, int numChannels,
+			      float* coef, float** outputs)
+{
+	__m128 b0[4], b1[4], d1[4], d2[4], a1, na2, x, y;
+	float tmp[4] __attribute__((aligned(16)));
+	float tile[GAMMATONE_TILE*4] __attribute__((aligned(16)));
+	int s, n, l, base, len;
+
+	for (s = 0; s < 4; s++){
+		laneCoef(coef, numChannels, 4, 6*s, tmp);
+		b0[s] = _mm_load_ps(tmp);
+		laneCoef(coef, numChannels, 4, 6*s + 1, tmp);
+		b1[s] = _mm_load_ps(tmp);
+		d1[s] = _mm_setzero_ps();
+		d2[s] = _mm_setzero_ps();
+	}
+	laneCoef(coef, numChannels, 4, 4, tmp);
+	a1 = _mm_load_ps(tmp);
+	laneCoef(coef, numChannels, 4, 5, tmp);
+	for (l = 0; l < 4; l++){
+		tmp[l] = -tmp[l];
+	}
+	na2 = _mm_load_ps(tmp);
+
+	for (base = 0; base < datalen; base += GAMMATONE_TILE){
+		len = datalen - base;
+		if (len > GAMMATONE_TILE){
+			len = GAMMATONE_TILE;
+		}
+		for (n = 0; n < len; n++){
+			y = _mm_set1_ps(data[base + n]);
+			for (s = 0; s < 4; s++){
+				x = y;
+				y = _mm_add_ps(_mm_mul_ps(b0[s], x), d1[s]);
+				d1[s] = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1[s], x),
+							      _mm_mul_ps(a1, y)),
+						   d2[s]);
+				d2[s] = _mm_mul_ps(na2, y);
+			}
+			_mm_store_ps(tile + 4*n, y);
+		}
+		scatterTile(tile, 4, numChannels, base, len, outputs);
+	}
+}
+
+__attribute__((target("avx2")))
+static void gammatoneBankAVX2(float* data, int datalen, int numChannels,
+			      float* coef, float** outputs)
+{
+	__m256 b0[4], b1[4], d1[4], d2[4], a1, na2, x, y;
+	float tmp[8] __attribute__((aligned(32)));
+	float tile[GAMMATONE_TILE*8] __attribute__((aligned(32)));
+	int s, n, l, base, len;
+
+	for (s = 0; s < 4; s++){
+		laneCoef(coef, numChannels, 8, 6*s, tmp);
+		b0[s] = _mm256_load_ps(tmp);
+		laneCoef(coef, numChannels, 8, 6*s + 1, tmp);
+		b1[s] = _mm256_load_ps(tmp);
+		d1[s] = _mm256_setzero_ps();
+		d2[s] = _mm256_setzero_ps();
+	}
+	laneCoef(coef, numChannels, 8, 4, tmp);
+	a1 = _mm256_load_ps(tmp);
+	laneCoef(coef, numChannels, 8, 5, tmp);
+	for (l = 0; l < 8; l++){
+		tmp[l] = -tmp[l];
+	}
+	na2 = _mm256_load_ps(tmp);
+
+	for (base = 0; base < datalen; base += GAMMATONE_TILE){
+		len = datalen - base;
+		if (len > GAMMATONE_TILE){
+			len = GAMMATONE_TILE;
+		}
+		for (n = 0; n < len; n++){
+			y = _mm256_set1_ps(data[base + n]);
+			for (s = 0; s < 4; s++){
+				x = y;
+				y = _mm256_add_ps(_mm256_mul_ps(b0[s], x), d1[s]);
+				d1[s] = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(b1[s], x),
+								    _mm256_mul_ps(a1, y)),
+						      d2[s]);
+				d2[s] = _mm256_mul_ps(na2, y);
+			}
+			_mm256_store_ps(tile + 8*n, y);
+		}
+		scatterTile(tile, 8, numChannels, base, len, outputs);
+	}
+}
+
+__attribute__((target("sse2")))
+static void apgfBankSSE2(float* data, int datalen, int numChannels,
+			 float* coef, float** outputs)
+{
+	__m128 d1[4], d2[4], gain, a1, na2, y;
+	float tmp[4] __attribute__((aligned(16)));
+	float tile[GAMMATONE_TILE*4] __attribute__((aligned(16)));
+	int s, n, l, base, len;
+
+	for (s = 0; s < 4; s++){
+		d1[s] = _mm_setzero_ps();
+		d2[s] = _mm_setzero_ps();
+	}
+	laneCoef(coef, numChannels, 4, 0, tmp);
+	gain = _mm_load_ps(tmp);
+	laneCoef(coef, numChannels, 4, 1, tmp);
+	a1 = _mm_load_ps(tmp);
+	laneCoef(coef, numChannels, 4, 2, tmp);
+	for (l = 0; l < 4; l++){
+		tmp[l] = -tmp[l];
+	}
+	na2 = _mm_load_ps(tmp);
+
+	for (base = 0; base < datalen; base += GAMMATONE_TILE){
+		len = datalen - base;
+		if (len > GAMMATONE_TILE){
+			len = GAMMATONE_TILE;
+		}
+		for (n = 0; n < len; n++){
+			y = _mm_mul_ps(gain, _mm_set1_ps(data[base + n]));
+			for (s = 0; s < 4; s++){
+				y = _mm_add_ps(y, d1[s]);
+				d1[s] = _mm_sub_ps(d2[s], _mm_mul_ps(a1, y));
+				d2[s] = _mm_mul_ps(na2, y);
+			}
+			_mm_store_ps(tile + 4*n, y);
+		}
+		scatterTile(tile, 4, numChannels, base, len, outputs);
+	}
+}
+
+__attribute__((target("avx2")))
+static void apgfBankAVX2(float* data, int datalen, int numChannels,
+			 float* coef, float** outputs)
+{
+	__m256 d1[4], d2[4], gain, a1, na2, y;
+	float tmp[8] __attribute__((aligned(32)));
+	float tile[GAMMATONE_TILE*8] __attribute__((aligned(32)));
+	int s, n, l, base, len;
+
+	for (s = 0; s < 4; s++){
+		d1[s] = _mm256_setzero_ps();
+		d2[s] = _mm256_setzero_ps();
+	}
+	laneCoef(coef, numChannels, 8, 0, tmp);
+	gain = _mm256_load_ps(tmp);
+	laneCoef(coef, numChannels, 8, 1, tmp);
+	a1 = _mm256_load_ps(tmp);
+	laneCoef(coef, numChannels, 8, 2, tmp);
+	for (l = 0; l < 8; l++){
+		tmp[l] = -tmp[l];
+	}
+	na2 = _mm256_load_ps(tmp);
+
+	for (base = 0; base < datalen; base += GAMMATONE_TILE){
+		len = datalen - base;
+		if (len > GAMMATONE_TILE){
+			len = GAMMATONE_TILE;
+		}
+		for (n = 0; n < len; n++){
+			y = _mm256_mul_ps(gain, _mm256_set1_ps(data[base + n]));
+			for (s = 0; s < 4; s++){
+				y = _mm256_add_ps(y, d1[s]);
+				d1[s] = _mm256_sub_ps(d2[s], _mm256_mul_ps(a1, y));
+				d2[s] = _mm256_mul_ps(na2, y);
+			}
+			_mm256_store_ps(tile + 8*n, y);
+		}
+		scatterTile(tile, 8, numChannels, base, len, outputs);
+	}
+}
+#endif /* GAMMATONE_HAVE_X86 */
+
+#ifdef GAMMATONE_HAVE_NEON
+static void gammatoneBankNEON(float* data, int datalen, int numChannels,
+			      float* coef, float** outputs)
+{
+	float32x4_t b0[4], b1[4], d1[4], d2[4], a1, na2, x, y;
+	float tmp[4];
+	float tile[GAMMATONE_TILE*4];
+	int s, n, l, base, len;
+
+	for (s = 0; s < 4; s++){
+		laneCoef(coef, numChannels, 4, 6*s, tmp);
+		b0[s] = vld1q_f32(tmp);
+		laneCoef(coef, numChannels, 4, 6*s + 1, tmp);
+		b1[s] = vld1q_f32(tmp);
+		d1[s] = vdupq_n_f32(0.0f);
+		d2[s] = vdupq_n_f32(0.0f);
+	}
+	laneCoef(coef, numChannels, 4, 4, tmp);
+	a1 = vld1q_f32(tmp);
+	laneCoef(coef, numChannels, 4, 5, tmp);
+	for (l = 0; l < 4; l++){
+		tmp[l] = -tmp[l];
+	}
+	na2 = vld1q_f32(tmp);
+
+	for (base = 0; base < datalen; base += GAMMATONE_TILE){
+		len = datalen - base;
+		if (len > GAMMATONE_TILE){
+			len = GAMMATONE_TILE;
+		}
+		for (n = 0; n < len; n++){
+			y = vdupq_n_f32(data[base + n]);
+			for (s = 0; s < 4; s++){
+				x = y;
+				y = vaddq_f32(vmulq_f32(b0[s], x), d1[s]);
+				d1[s] = vaddq_f32(vsubq_f32(vmulq_f32(b1[s], x),
+							    vmulq_f32(a1, y)),
+						  d2[s]);
+				d2[s] = vmulq_f32(na2, y);
+			}
+			vst1q_f32(tile + 4*n, y);
+		}
+		scatterTile(tile, 4, numChannels, base, len, outputs);
+	}
+}
+
+static void apgfBankNEON(float* data, int datalen, int numChannels,
+			 float* coef, float** outputs)
+{
+	float32x4_t d1[4], d2[4], gain, a1, na2, y;
+	float tmp[4];
+	float tile[GAMMATONE_TILE*4];
+	int s, n, l, base, len;
+
+	for (s = 0; s < 4; s++){
+		d1[s] = vdupq_n_f32(0.0f);
+		d2[s] = vdupq_n_f32(0.0f);
+	}
+	laneCoef(coef, numChannels, 4, 0, tmp);
+	gain = vld1q_f32(tmp);
+	laneCoef(coef, numChannels, 4, 1, tmp);
+	a1 = vld1q_f32(tmp);
+	laneCoef(coef, numChannels, 4, 2, tmp);
+	for (l = 0; l < 4; l++){
+		tmp[l] = -tmp[l];
+	}
+	na2 = vld1q_f32(tmp);
+
+	for (base = 0; base < datalen; base += GAMMATONE_TILE){
+		len = datalen - base;
+		if (len > GAMMATONE_TILE){
+			len = GAMMATONE_TILE;
+		}
+		for (n = 0; n < len; n++){
+			y = vmulq_f32(gain, vdupq_n_f32(data[base + n]));
+			for (s = 0; s < 4; s++){
+				y = vaddq_f32(y, d1[s]);
+				d1[s] = vsubq_f32(d2[s], vmulq_f32(a1, y));
+				d2[s] = vmulq_f32(na2, y);
+			}
+			vst1q_f32(tile + 4*n, y);
+		}
+		scatterTile(tile, 4, numChannels, base, len, outputs);
+	}
+}
+#endif /* GAMMATONE_HAVE_NEON */
+
+int gammatoneBankLanes(enum psmSimdLevel simdLevel)
+{
+	switch(simdLevel){
+	case PSM_SIMD_SSE2:
+	case PSM_SIMD_NEON:
+		return 4;
+	case PSM_SIMD_AVX2:
+		return 8;
+	default:
+		return 1;
+	}
+}
+
+gammatoneBankFunc gammatoneBankGet(enum psmSimdLevel simdLevel,
+				   enum gammatoneFilterType filterType)
+{
+	/* the OZGF only differs from the APGF by a zero that the caller 
+	 * applies to the shared input */
+	int allPole = (filterType != GAMMATONE_SOS);
+
+	switch(simdLevel){
+	case PSM_SIMD_SCALAR:
+		return allPole ? &apgfBankScalar : &gammatoneBankScalar;
+#ifdef GAMMATONE_HAVE_X86
+	case PSM_SIMD_SSE2:
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("sse2")){
+			return allPole ? &apgfBankSSE2 : &gammatoneBankSSE2;
+		}
+		return NULL;
+	case PSM_SIMD_AVX2:
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")){
+			return allPole ? &apgfBankAVX2 : &gammatoneBankAVX2;
+		}
+		return NULL;
+#endif
+#ifdef GAMMATONE_HAVE_NEON
+	case PSM_SIMD_NEON:
+		return allPole ? &apgfBankNEON : &gammatoneBankNEON;
+#endif
+	default:
+		return NULL;
+	}
+}
@@ -0,0 +1,54 @@
+#ifndef GAMMATONEKERNEL_H
+#define GAMMATONEKERNEL_H
+
+#include "psmKernel.h"
+#include "gammatoneFilter.h"
+
+/// The largest number of channels filtered at once by any implementation
+#define GAMMATONE_MAX_LANES 8
+
+/// Signature shared by all implementations of the multi-channel gammatone
+/// filterbank. For GAMMATONE_SOS, every channel is filtered exactly like
+/// sosGammatoneFast. For GAMMATONE_APGF and GAMMATONE_OZGF, every channel is
+/// filtered exactly like apGammatoneChunk (so for the OZGF, data must hold the
+/// first difference of the input).
+///
+/// @param[in] data The input signal, shared by every channel
+/// @param[in] datalen The number of entries in data
+/// @param[in] numChannels The number of channels to filter. It must not
+///            exceed the number of lanes of the implementation (see
+///            gammatoneBankLanes)
+/// @param[in] coef The coefficients of the channels, computed by sosCoeff or
+///            apgfCoeff. The coefficients of channel c start at coef[24*c]
+///            (apgfCoeff only uses the first 3 of these entries)
+/// @param[out] outputs An array of numChannels pointers. The response of
+///             channel c is written to outputs[c][0] through
+///             outputs[c][datalen-1]
+typedef void (*gammatoneBankFunc)(float* data, int datalen, int numChannels,
+				  float* coef, float** outputs);
+
+/// The reference scalar implementations. They filter the channels one at a
+/// time and accept any number of channels.
+void gammatoneBankScalar(float* data, int datalen, int numChannels,
+			 float* coef, float** outputs);
+void apgfBankScalar(float* data, int datalen, int numChannels,
+		    float* coef, float** outputs);
+
+/// Returns the number of channels that the implementation corresponding to
+/// simdLevel filters at once (each channel occupies one lane of a vector).
+int gammatoneBankLanes(enum psmSimdLevel simdLevel);
+
+/// Returns the implementation of filterType corresponding to simdLevel. If
+/// that level is not supported by the build or by the CPU, NULL is returned.
+///
+/// @par Note:
+/// A single IIR channel can't be vectorized over time, so the vectorized
+/// implementations filter independent channels in the lanes of a vector. The
+/// samples are filtered in short tiles, which are then transposed into the
+/// per-channel outputs. Each lane performs the same operations as the scalar
+/// implementation, so the results only differ if the compiler contracts the
+/// scalar multiplications and additions into fused multiply-adds.
+gammatoneBankFunc gammatoneBankGet(enum psmSimdLevel simdLevel,
+				   enum gammatoneFilterType filterType);
+
+#endif /* GAMMATONEKERNEL_H */
@@ -0,0 +1,116 @@
+#include <stdlib.h>
+#include <math.h>
+#include "histogramPSM.h"
+#include "psmKernel.h"
+
+#define M_1_SQRT2PI 0.3989422804f
+
+/* Bin differences beyond HIST_CUTOFF (in units of sqrt(2)*sigma) are
+ * neglected. e^(-25) is far below the rounding error of the sum. */
+#define HIST_CUTOFF 5.0f
+
+struct histPSM{
+	int winSize;
+	int numBins;
+	/* the number of targets in each bin */
+	float *counts;
+	/* gauss[numBins - 1 + d] holds the gaussian of a difference of d bins,
+	 * for the differences within reach */
+	float *gauss;
+	/* the bin that each entry of the window belongs to */
+	int *bins;
+	psmHistDotFunc dot;
+};
+
+struct histPSM* histPSMNew(int winSize, int numBins)
+{
+	struct histPSM *hist;
+	if ((winSize < 1) || (numBins < 1)){
+		return NULL;
+	}
+	hist = malloc(sizeof(struct histPSM));
+	if (hist == NULL){
+		return NULL;
+	}
+	hist->winSize = winSize;
+	hist->numBins = numBins;
+	hist->counts = malloc(sizeof(float) * numBins);
+	hist->gauss = malloc(sizeof(float) * (2 * numBins - 1));
+	hist->bins = malloc(sizeof(int) * (2 * winSize + 1));
+	hist->dot = psmHistDotGet(psmSimdLevelDetect());
+	if (hist->dot == NULL){
+		// AVX2 without FMA
+		hist->dot = psmHistDotGet(PSM_SIMD_SSE2);
+	}
+	if ((hist->counts == NULL) || (hist->gauss == NULL) ||
+	    (hist->bins == NULL)){
+		histPSMDestroy(hist);
+		return NULL;
+	}
+	return hist;
+}
+
+void histPSMDestroy(struct histPSM *hist)
+{
+	free(hist->counts);
+	free(hist->gauss);
+	free(hist->bins);
+	free(hist);
+}
+
+float histPSMEntryContrib(struct histPSM *hist, float *x, float sigma)
+{
+	int winSize = hist->winSize, numBins = hist->numBins;
+	int *bins = hist->bins;
+	float *counts = hist->counts, *gauss = hist->gauss + numBins - 1;
+	float lo, hi, width, invWidth, scale, out;
+	int i, b, d, reach, kLo, kHi;
+
+	lo = x[0];
+	hi = x[0];
+	for (i = 1; i <= 2*winSize; i++){
+		if (x[i] < lo){
+			lo = x[i];
+		} else if (x[i] > hi){
+			hi = x[i];
+		}
+	}
+	width = (hi - lo) / numBins;
+	invWidth = (width > 0) ? 1.0f / width : 0.0f;
+	for (i = 0; i <= 2*winSize; i++){
+		b = (int)((x[i] - lo) * invWidth);
+		bins[i] = (b < numBins) ? b : numBins - 1;
+	}
+
+	// the largest bin difference within reach of the gaussian
+	reach = numBins - 1;
+	if (width * reach > HIST_CUTOFF * M_SQRT2 * sigma){
+		reach = (int)(HIST_CUTOFF * M_SQRT2 * sigma / width) + 1;
+	}
+	scale = -0.5f * (width / sigma) * (width / sigma);
+	for (d = 0; d <= reach; d++){
+		gauss[d] = expf(scale * d * d);
+		gauss[-d] = gauss[d];
+	}
+
+	for (b = 0; b < numBins; b++){
+		counts[b] = 0;
+	}
+	for (i = 1; i <= winSize; i++){
+		counts[bins[i]] += 1.0f;
+	}
+
+	out = 0;
+	for (i = 0; i < winSize; i++){
+		b = bins[i];
+		kLo = (b - reach > 0) ? b - reach : 0;
+		kHi = (b + reach < numBins - 1) ? b + reach : numBins - 1;
+		out += hist->dot(counts + kLo, gauss + kLo - b, kHi - kLo + 1);
+
+		// slide the targets from x[i+1..i+winSize] to x[i+2..i+winSize+1]
+		counts[bins[i+1]] -= 1.0f;
+		counts[bins[i+winSize+1]] += 1.0f;
+	}
+	out *= M_1_SQRT2PI / sigma;
+	return out;
+}
@@ -0,0 +1,61 @@
+#ifndef HISTOGRAMPSM_H
+#define HISTOGRAMPSM_H
+
+/// Holds the parameters and the work arrays used to evaluate the pooled
+/// summary matrix entries from a histogram of the window. It is allocated
+/// once and then reused for every window.
+struct histPSM;
+
+/// Allocates a new histPSM. Returns NULL if the allocation fails or if any
+/// argument is out of range.
+///
+/// @param[in] winSize The correntropy window size of the windows that will be
+///            evaluated (see histPSMEntryContrib)
+/// @param[in] numBins The number of bins of equal width that the range of a
+///            window is divided into. This must be positive.
+struct histPSM* histPSMNew(int winSize, int numBins);
+
+/// Frees the histPSM
+void histPSMDestroy(struct histPSM *hist);
+
+/// Approximates the contribution of a window to the pooled summary matrix by
+/// quantizing the window into the bins of a histogram
+///
+/// This evaluates the same sum as fgtPSMEntryContrib (x is NOT divided by
+/// sqrt(2)*sigma beforehand), except that every entry of x is replaced by the
+/// bin that it falls in.
+///
+/// @param[in] hist The work arrays and the number of bins
+/// @param[in] x The window. This must hold 2*winSize+1 entries.
+/// @param[in] sigma The kernel width of the window
+///
+/// @return The contribution of the window to the pooled summary matrix
+///
+/// @par Error Bound:
+/// Let h be the width of a bin, (max(x) - min(x))/numBins. The difference of
+/// the bins of a pair differs from the difference of the pair by less than h,
+/// and the slope of the (unnormalized) gaussian never exceeds
+/// 1/(sigma*sqrt(e)). Thus the error of the result is less than
+///   h/(sigma*sqrt(e)) * winSize^2/(sqrt(2*pi)*sigma)
+/// where the second factor is the largest possible value of the sum (every
+/// pair identical). The gaussian is neglected beyond 5*sqrt(2)*sigma, which
+/// adds at most e^(-25) per pair. In practice the errors of the pairs mostly
+/// cancel, and the actual error is orders of magnitude below the bound.
+///
+/// @par Implementation Notes:
+/// Every row i of the sum pairs x[i] with the targets x[i+1..i+winSize].
+/// Since only the bins matter, the row is the dot product of the histogram of
+/// the targets with a table of the gaussian of the bin differences (see
+/// psmHistDotGet). The table is computed once per window, and the histogram
+/// is updated as the targets slide by one entry from row to row (one target
+/// is removed and one is added). Only the bins within reach of the gaussian
+/// are visited, so the cost of a window is about
+/// winSize*min(numBins, 14*sigma/h) operations without any exponentials per
+/// pair, rather than winSize^2 exponentials.
+///
+/// The rows are not all of the pairs of the window, so the sum is NOT the
+/// autocorrelation of a single histogram (which could be computed with an
+/// FFT).
+float histPSMEntryContrib(struct histPSM *hist, float *x, float sigma);
+
+#endif /* HISTOGRAMPSM_H */
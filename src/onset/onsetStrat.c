@@ -93,6 +93,15 @@ int OnsetsDSDetectionStrategy(float** AudioData, int size, int dftBlocksize, int
 // May want to rename this something like "PairwiseTransientStrategy"
 int TransientDetectionStrategy(float** AudioData, int size, int dftBlocksize,
 			       int samplerate, intList* onsets)
+{
+	return TransientDetection(AudioData, size, samplerate, NULL, NULL, 0,
+				  onsets);
+}
+
+int TransientDetection(float** AudioData, int size, int samplerate,
+		       const struct detFuncSettings *dfSettings,
+		       const int *activityRanges, int a_size,
+		       intList* onsets)
 {
 	printf("in transientDetectionStrategy\n");
 
@@ -108,9 +117,24 @@ int TransientDetectionStrategy(float** AudioData, int size, int dftBlocksize,
 
 	printf("resample complete\n");
 
+	// convert the activity ranges to indices of the resampled audio
+	int* resampledRanges = NULL;
+	if(activityRanges != NULL){
+		resampledRanges = malloc(sizeof(int) * (a_size + 1));
+		if(resampledRanges == NULL){
+			free(ResampledAudio);
+			return -1;
+		}
+		for(int i = 0; i < a_size; ++i){
+			resampledRanges[i] = (int)(activityRanges[i] * sampleRatio);
+		}
+	}
+
 	int transientsLength = 
 		pairwiseTransientDetection(ResampledAudio, RALength,
-					   samplerate, onsets);
+					   samplerate, dfSettings,
+					   resampledRanges, a_size, onsets);
+	free(resampledRanges);
 
 	if(transientsLength <= 0){
 		free(ResampledAudio);
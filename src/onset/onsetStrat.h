@@ -1,4 +1,5 @@
 #include "../lists.h"
+#include "simpleDetFunc.h"
 
 typedef int (*OnsetStrategyFunc)(float** AudioData, int size, int dftBlocksize,
 			int samplerate, intList* onsets);
@@ -11,4 +12,16 @@ int OnsetsDSDetectionStrategy(float** AudioData, int size, int dftBlocksize,
 int TransientDetectionStrategy(float** AudioData, int size, int dftBlocksize,
 			int samplerate, intList* onsets);
 
+/// Identical to TransientDetectionStrategy, except that it accepts settings
+/// for the calculation of the detection function (NULL selects the defaults)
+/// and drops the unused dftBlocksize argument
+///
+/// If activityRanges isn't NULL, it holds a_size entries (pairs of the first
+/// frame of an active range and the frame following the range) and the
+/// transients are only computed within these ranges.
+int TransientDetection(float** AudioData, int size, int samplerate,
+		       const struct detFuncSettings *dfSettings,
+		       const int *activityRanges, int a_size,
+		       intList* onsets);
+
 void AddOnsetAt(int** onsets, int* size, int value, int index );
@@ -7,6 +7,7 @@
 #include <limits.h>
 #include <math.h>
 #include <float.h>
+#include <pthread.h>
 
 #include "pairTransientDetection.h"
 #include "simpleDetFunc.h"
@@ -29,33 +30,103 @@ float calcZ(int index, int max)
 	return ((DOUBLEMAXZ * index) / (max-1)) + MINZ;
 }
 
-float** GenKernels(int minK, int numKernels)
+/* Rounds len up to a multiple of KERNEL_BANK_ALIGN/sizeof(float) floats so
+ * that every kernel in the bank starts on an aligned boundary. */
+static int paddedKernelLen(int len)
+{
+	int align = KERNEL_BANK_ALIGN / sizeof(float);
+	return ((len + align - 1) / align) * align;
+}
+
+int kernelBankInit(struct kernelBank *bank, int minK, int maxK)
 {
 	int i, j, kernelLen;
-	float z;
-	if(numKernels <= 0){
-		return NULL;
+	size_t totalLen;
+	float z, *kernel;
+
+	bank->data = NULL;
+	bank->offsets = NULL;
+	bank->sqNorms = NULL;
+	bank->minK = minK;
+	bank->numKernels = maxK - minK + 1;
+	if(minK < 2 || bank->numKernels <= 0){
+		return -1;
 	}
-	float** kernels = malloc(numKernels * sizeof(float*));
-	for(i = 0, kernelLen = minK; i < numKernels; i++, kernelLen++)
-	{
-		kernels[i] = malloc(kernelLen * sizeof(float));
+
+	bank->offsets = malloc(bank->numKernels * sizeof(size_t));
+	bank->sqNorms = malloc(bank->numKernels * sizeof(double));
+	if(bank->offsets == NULL || bank->sqNorms == NULL){
+		kernelBankDestroy(bank);
+		return -1;
+	}
+
+	totalLen = 0;
+	for(i = 0, kernelLen = minK; i < bank->numKernels; i++, kernelLen++){
+		bank->offsets[i] = totalLen;
+		totalLen += paddedKernelLen(kernelLen);
+	}
+
+	if(posix_memalign((void**)&(bank->data), KERNEL_BANK_ALIGN,
+			  totalLen * sizeof(float)) != 0){
+		bank->data = NULL;
+		kernelBankDestroy(bank);
+		return -1;
+	}
+
+	for(i = 0, kernelLen = minK; i < bank->numKernels; i++, kernelLen++){
+		kernel = bank->data + bank->offsets[i];
+		bank->sqNorms[i] = 0.0;
 		for(j = 0; j < kernelLen; ++j){
 			z = calcZ(j, kernelLen);
-			kernels[i][j] = z/(1.15f - fabs(z));
+			kernel[j] = z/(1.15f - fabs(z));
+			bank->sqNorms[i] += (double)kernel[j] * (double)kernel[j];
+		}
+		// zero the padding
+		for(; j < paddedKernelLen(kernelLen); ++j){
+			kernel[j] = 0.f;
 		}
 	}
-	return kernels;
+	return 1;
+}
+
+void kernelBankDestroy(struct kernelBank *bank)
+{
+	free(bank->data);
+	free(bank->offsets);
+	free(bank->sqNorms);
+	bank->data = NULL;
+	bank->offsets = NULL;
+	bank->sqNorms = NULL;
 }
 
-void freeKernels(float** kernels, int numKernels){
-	for(int i = 0; i < numKernels; ++i){
-		free(kernels[i]);
+const float* kernelBankKernel(const struct kernelBank *bank, int len)
+{
+	return bank->data + bank->offsets[len - bank->minK];
+}
+
+/* The kernels used by detectTransients only depend on MIN_KERNEL_LEN and
+ * MAX_KERNEL_LEN, so they are computed once and then shared (read-only) by
+ * every call in every thread. The bank lives until the process exits. */
+static struct kernelBank sharedBank;
+static int sharedBankStatus = -1;
+static pthread_once_t sharedBankOnce = PTHREAD_ONCE_INIT;
+
+static void sharedKernelBankInit(void)
+{
+	sharedBankStatus = kernelBankInit(&sharedBank, MIN_KERNEL_LEN,
+					  MAX_KERNEL_LEN);
+}
+
+const struct kernelBank* sharedKernelBank(void)
+{
+	pthread_once(&sharedBankOnce, &sharedKernelBankInit);
+	if (sharedBankStatus != 1){
+		return NULL;
 	}
-	free(kernels);
+	return &sharedBank;
 }
 
-float FitnessOnset(float* kernel, float* window, int start, int len)
+float FitnessOnset(const float* kernel, float* window, int start, int len)
 {	
 	//In the paper, the equation for the onset fitness (Fig 6) had kernel[i] positive, and the offset had kernel[i] negative.
 	//but the related graph of the fitness functions (Fig 4) showed their signs flipped.
@@ -68,7 +139,7 @@ float FitnessOnset(float* kernel, float* window, int start, int len)
 	return sum/len;
 }
 
-float FitnessOffset(float* kernel, float* window, int start, int len)
+float FitnessOffset(const float* kernel, float* window, int start, int len)
 {
 	//only difference from FitnessOnset is kernel[i] is not negated
 	float sum = 0.0f;
@@ -80,6 +151,121 @@ float FitnessOffset(float* kernel, float* window, int start, int len)
 }
 
 
+/* Computes prefix[i] = sum(detection_func[j]^2) for j < i. prefix has len+1
+ * entries. */
+double* squaredPrefixSum(float* detection_func, int len)
+{
+	double *prefix = malloc((len + 1) * sizeof(double));
+	if (prefix == NULL){
+		return NULL;
+	}
+	prefix[0] = 0.0;
+	for(int i = 0; i < len; i++){
+		prefix[i+1] = (prefix[i] +
+			       (double)detection_func[i] * (double)detection_func[i]);
+	}
+	return prefix;
+}
+
+/* Computes sum(kernel[i]*window[i]). CROSS_TERM_LANES independent partial
+ * sums are used so that the loop doesn't serialize on the latency of the
+ * additions and so that the compiler is free to vectorize it. The rounding
+ * error is at most (len/CROSS_TERM_LANES + 4) * FLT_EPSILON *
+ * sum(|kernel[i]*window[i]|). */
+#define CROSS_TERM_LANES 8
+static inline float crossTerm(const float* kernel, float* window, int len)
+{
+	float acc[CROSS_TERM_LANES] = {0.f};
+	int i, j;
+	for(i = 0; i + CROSS_TERM_LANES <= len; i += CROSS_TERM_LANES){
+		for(j = 0; j < CROSS_TERM_LANES; j++){
+			acc[j] += kernel[i+j] * window[i+j];
+		}
+	}
+	for(; i < len; i++){
+		acc[0] += kernel[i] * window[i];
+	}
+	// pairwise reduction of the CROSS_TERM_LANES = 8 partial sums
+	return (((acc[0] + acc[1]) + (acc[2] + acc[3])) +
+		((acc[4] + acc[5]) + (acc[6] + acc[7])));
+}
+
+/* Searches kernel lengths minK <= i < maxK for the one that minimizes the
+ * fitness at start, and returns it (0 if no length is tried). The returned
+ * length is always identical to the one found by evaluating FitnessOnset
+ * (sign = -1) or FitnessOffset (sign = 1) for every length.
+ *
+ * Writing the kernel as k and the window as w, the fitness of length L is
+ *     sum((sign*k - w)^2)/L = (sum(k^2) + sum(w^2) - 2*sign*sum(k*w))/L
+ * sum(k^2) is precomputed in the kernel bank and sum(w^2) is the difference of
+ * 2 entries of the prefix sum of the squared detection function. Only the
+ * cross term needs to be computed for every length (the shape of the kernel
+ * changes with its length, so it can't be accumulated as the length grows),
+ * but unlike the original fitness functions, it has no serial dependence.
+ *
+ * The original single precision fitness differs from the exact value by a
+ * relative error of at most ~(L+4)*FLT_EPSILON/2 < 1e-4, while the error of
+ * the decomposed value is dominated by the rounding error of the cross term
+ * (bounded using sum(|k*w|) <= sqrt(sum(k^2)*sum(w^2))). Therefore:
+ *   1. the decomposed fitness of every length is stored in approxFitness
+ *      (with at least maxK - minK entries) and the length with the smallest
+ *      value is evaluated exactly to get a threshold, T.
+ *   2. every length whose decomposed fitness, loosened by
+ *      FITNESS_BOUND_SLACK, is no larger than T is evaluated exactly (in order
+ *      of increasing length). The others can't beat T.
+ * Typically, only a handful of lengths are evaluated exactly. */
+#define FITNESS_BOUND_SLACK 1.e-3
+static int bestKernelLength(float sign, const struct kernelBank *bank,
+			    double* wSqPrefix, float* detection_func,
+			    int start, int minK, int maxK,
+			    double *approxFitness)
+{
+	float (*fitness)(const float*, float*, int, int);
+	const double *sqNorms = bank->sqNorms + (minK - bank->minK);
+	fitness = (sign < 0) ? &FitnessOnset : &FitnessOffset;
+
+	if(maxK <= minK){
+		return 0;
+	}
+
+	int i, approxInd = minK;
+	for(i = minK; i < maxK; ++i){
+		double wSq = wSqPrefix[start + i] - wSqPrefix[start];
+		double kw = (double)crossTerm(kernelBankKernel(bank, i),
+					      detection_func + start, i);
+		approxFitness[i - minK] = (sqNorms[i - minK] + wSq
+					   - 2. * sign * kw) / i;
+		if(approxFitness[i - minK] < approxFitness[approxInd - minK]){
+			approxInd = i;
+		}
+	}
+
+	float threshold = fitness(kernelBankKernel(bank, approxInd),
+				  detection_func, start, approxInd);
+
+	float bestFitness = FLT_MAX;
+	int bestInd = 0;
+	float curFitness;
+	for(i = minK; i < maxK; ++i){
+		double wSq = wSqPrefix[start + i] - wSqPrefix[start];
+		double crossErr = (2. * (i / CROSS_TERM_LANES + 4) * FLT_EPSILON
+				   * sqrt(sqNorms[i - minK] * (wSq > 0 ? wSq : 0))
+				   / i);
+		double lowerBound = (approxFitness[i - minK]
+				     * (1.0 - FITNESS_BOUND_SLACK) - crossErr);
+		if(lowerBound > threshold){
+			continue;
+		}
+		curFitness = fitness(kernelBankKernel(bank, i), detection_func,
+				     start, i);
+		if(curFitness < bestFitness){
+			bestFitness = curFitness;
+			bestInd = i;
+		}
+	}
+	return bestInd;
+}
+
 void normalizeDetFunction(float ** detFunction, int length)
 {
 	float maxVal = -FLT_MAX;
@@ -100,49 +286,33 @@ void normalizeDetFunction(float ** detFunction, int length)
 	}
 }
 
-//populates transients, which will hold indices of onsets and offsets in detection_func
-int detectTransients(float* detection_func, int len, intList* transients){
-
-	// normalize the detection function so that values lie between -1 and 1
-	// (unclear if this is necessary)
-	// also divides 0.15 by all values
-	normalizeDetFunction(&detection_func, len);
-	
-	int minkernel = 4;
-	int maxkernel = 1500;
-
-	printf("detection with len %d, minK %d, maxK %d\n", len, minkernel, maxkernel);
-
-	int numKernels = maxkernel - minkernel + 1;
-	float** Kernels = GenKernels(minkernel, numKernels);
-
-	printf("kernel made\n");
-
-	int detect_index = 0;
+/* Appends the transients found between the indices rangeStart and rangeStop
+ * of detection_func to transients. The kernels never extend past rangeStop.
+ * Returns 1 for success and -1 for failure. */
+static int detectTransientsInRange(const struct kernelBank *bank,
+				   double* wSqPrefix, float* detection_func,
+				   int rangeStart, int rangeStop,
+				   double *approxFitness, intList* transients)
+{
+	int minkernel = MIN_KERNEL_LEN;
+	int maxkernel = MAX_KERNEL_LEN;
+	int detect_index = rangeStart;
 	int tmpMax = 0;
-	int lastpossibleStart = len-8; //last possible starting index bc notes are at least 8 indices for onset+offset.
-	int lastpossibleOnset = len-4; //last possible onset index bc offset requires at least 4 indices.
+	int lastpossibleStart = rangeStop-8; //last possible starting index bc notes are at least 8 indices for onset+offset.
+	int lastpossibleOnset = rangeStop-4; //last possible onset index bc offset requires at least 4 indices.
+	int rangeFirst = transients->length;
 
-	float bestFitness;
 	int bestInd;
 
-	float curFitness;
-	int i;
-
 	while(detect_index < lastpossibleStart){
 
 		//printf("start while index - %d\n", detect_index);
 
-		bestFitness = FLT_MAX;
-		bestInd = 0;
-		tmpMax = maxkernel < (len - detect_index) ? maxkernel : (len - detect_index);
-		for(i = minkernel; i < tmpMax; ++i){ 
-			curFitness = FitnessOnset(Kernels[i - minkernel], detection_func, detect_index, i);
-			if(curFitness < bestFitness){
-				bestFitness = curFitness;
-				bestInd = i;
-			}
-		}
+		tmpMax = maxkernel < (rangeStop - detect_index) ? maxkernel : (rangeStop - detect_index);
+		bestInd = bestKernelLength(-1.0f, bank,
+					   wSqPrefix, detection_func,
+					   detect_index, minkernel, tmpMax,
+					   approxFitness);
 		detect_index += bestInd;
 		if(detect_index >= lastpossibleOnset){
 			//onset detected too close to end for a corresponding offset, so we skip the onset and end.
@@ -150,41 +320,89 @@ int detectTransients(float* detection_func, int len, intList* transients){
 			break;
 		}
 
-		//printf("    ONSET   FITNESS:  %f  AT INDEX:  %d   AT TIME:  %f\n", bestFitness, bestInd, detect_index/200.0f);
+		//printf("    ONSET   AT INDEX:  %d   AT TIME:  %f\n", bestInd, detect_index/200.0f);
 		if(intListAppend(transients, detect_index) != 1){
 			printf("Resizing transients failed. Exitting.\n");
-			freeKernels(Kernels, numKernels);
 			return -1;
 		}
 
-		bestFitness = FLT_MAX;
-		bestInd = 0;
-		tmpMax = maxkernel < (len - detect_index) ? maxkernel : (len - detect_index);
-		for(i = minkernel; i < tmpMax; ++i){
-			curFitness = FitnessOffset(Kernels[i - minkernel], detection_func, detect_index, i);
-			if(curFitness < bestFitness){
-				bestFitness = curFitness;
-				bestInd = i;
-			}
-		}
+		tmpMax = maxkernel < (rangeStop - detect_index) ? maxkernel : (rangeStop - detect_index);
+		bestInd = bestKernelLength(1.0f, bank,
+					   wSqPrefix, detection_func,
+					   detect_index, minkernel, tmpMax,
+					   approxFitness);
 		detect_index += bestInd;
 
-		//printf("    OFFSET   FITNESS:  %f  AT INDEX:  %d   AT TIME:  %f\n", bestFitness, bestInd, detect_index/200.0f);
+		//printf("    OFFSET   AT INDEX:  %d   AT TIME:  %f\n", bestInd, detect_index/200.0f);
 		if(intListAppend(transients, detect_index) != 1){
 			printf("Resizing transients failed. Exitting.\n");
-			freeKernels(Kernels, numKernels);
 			return -1;
 		}
-		// if at end of activity range, jump detect_index forward to
-		// start of next range
 	}
 
-	freeKernels(Kernels, numKernels);
-
 	// the transient detection algorithm, by its design, will (almost)
-	// always have an extra false positive note at the end. we only go up
-	// to transients->length-2 to remove this note
+	// always have an extra false positive note at the end of the range.
+	// we remove this note
 	transients->length -= 2;
+	if(transients->length < rangeFirst){
+		transients->length = rangeFirst;
+	}
+	return 1;
+}
+
+//populates transients, which will hold indices of onsets and offsets in detection_func
+int detectTransients(float* detection_func, int len, intList* transients){
+	int range[2] = {0, len};
+	return detectTransientsInRanges(detection_func, len, range, 2,
+					transients);
+}
+
+int detectTransientsInRanges(float* detection_func, int len,
+			     const int* ranges, int r_size,
+			     intList* transients){
+
+	// normalize the detection function so that values lie between -1 and 1
+	// (unclear if this is necessary)
+	// also divides 0.15 by all values
+	normalizeDetFunction(&detection_func, len);
+	
+	int minkernel = MIN_KERNEL_LEN;
+	int maxkernel = MAX_KERNEL_LEN;
+
+	printf("detection with len %d, minK %d, maxK %d\n", len, minkernel, maxkernel);
+
+	const struct kernelBank* bank = sharedKernelBank();
+	if (bank == NULL){
+		printf("Generating the kernels failed. Exitting.\n");
+		return -1;
+	}
+
+	int numKernels = maxkernel - minkernel + 1;
+	double* wSqPrefix = squaredPrefixSum(detection_func, len);
+	double* approxFitness = malloc(numKernels * sizeof(double));
+	if (wSqPrefix == NULL || approxFitness == NULL){
+		printf("Allocating fitness workspace failed. Exitting.\n");
+		free(wSqPrefix);
+		free(approxFitness);
+		return -1;
+	}
+
+	printf("kernel made\n");
+
+	for(int r = 0; r < r_size; r += 2){
+		if(detectTransientsInRange(bank, wSqPrefix, detection_func,
+					   ranges[r] > 0 ? ranges[r] : 0,
+					   ranges[r+1] < len ? ranges[r+1] : len,
+					   approxFitness, transients) != 1){
+			free(wSqPrefix);
+			free(approxFitness);
+			return -1;
+		}
+	}
+
+	free(wSqPrefix);
+	free(approxFitness);
+
 	if(transients->length <= 0){
 		transients->length = 0;
 		// no transients found, do not attempt to shrink here. Unable
@@ -201,7 +419,66 @@ int detectTransients(float* detection_func, int len, intList* transients){
 	return transients->length;
 }
 
+/* Computes the detection function of each segment of audioData listed in
+ * segments (pairs of start and stop indices, where each start is a multiple
+ * of interval) and copies it into the corresponding entries of
+ * detectionFunction. The ranges of detectionFunction that were computed are
+ * written to detRanges (with the same number of entries as segments).
+ * Returns 1 for success and -1 for failure. */
+static int segmentDetFunctionCalculation(int correntropyWinSize,
+					 int interval, float scaleFactor,
+					 int sigWindowSize, int numChannels,
+					 float minFreq, float maxFreq,
+					 int samplerate, float *audioData,
+					 const int *segments, int s_size,
+					 int detectionFunctionLength,
+					 float *detectionFunction,
+					 int *detRanges,
+					 const struct detFuncSettings *settings)
+{
+	for(int i = 0; i < s_size; i += 2){
+		int segLength = segments[i+1] - segments[i];
+		int offset = segments[i] / interval;
+		int segDetLength = computeDetFunctionLength(segLength,
+							    correntropyWinSize,
+							    interval);
+		// the number of entries that fit within detectionFunction
+		int numCopied = segDetLength;
+		if(offset + numCopied > detectionFunctionLength){
+			numCopied = detectionFunctionLength - offset;
+		}
+		detRanges[i] = offset;
+		detRanges[i+1] = offset;
+		if(numCopied < 1){
+			continue;
+		}
+
+		float* segDet = malloc(sizeof(float) * segDetLength);
+		if(segDet == NULL){
+			return -1;
+		}
+		if (1 != detFunctionCalculation(correntropyWinSize, interval,
+						scaleFactor, sigWindowSize,
+						numChannels, minFreq, maxFreq,
+						samplerate, segLength,
+						audioData + segments[i],
+						segDetLength, segDet,
+						settings)){
+			free(segDet);
+			return -1;
+		}
+		for(int j = 0; j < numCopied; j++){
+			detectionFunction[offset + j] = segDet[j];
+		}
+		detRanges[i+1] = offset + numCopied;
+		free(segDet);
+	}
+	return 1;
+}
+
 int pairwiseTransientDetection(float *audioData, int size, int samplerate,
+			       const struct detFuncSettings *settings,
+			       const int *activityRanges, int a_size,
 			       intList* transients){
 
 	// use parameters suggested by paper
@@ -209,37 +486,104 @@ int pairwiseTransientDetection(float *audioData, int size, int samplerate,
 	float minFreq = 80.f; // 80 Hz
 	float maxFreq = 4000.f; // 4000 Hz 
 	int correntropyWinSize = samplerate/80; // assumes minFreq=80
-	int interval = samplerate/200; // 5ms
+	int interval = samplerate * DET_FUNC_HOP_MS / 1000; // 5ms
 	float scaleFactor = powf(4./3.,0.2); // magic, grants three wishes
-	int sigWindowSize = (samplerate*7); // 7s
+	int sigWindowSize = samplerate * SIGMA_WINDOW_MS / 1000; // 7s
+
+	int margin = samplerate/4; // 250ms
 
 	// allocate the detectionFunction
 	int detectionFunctionLength =
 		computeDetFunctionLength(size, correntropyWinSize, interval);
-	float* detectionFunction = malloc(sizeof(float) *
-					  detectionFunctionLength);
-
-	// compute the detectionFunction
-	if (1 != simpleDetFunctionCalculation(correntropyWinSize, interval,
-					      scaleFactor, sigWindowSize,
-					      numChannels, minFreq, maxFreq,
-					      samplerate, size, audioData,
-					      detectionFunctionLength,
-					      detectionFunction)){
-		free(detectionFunction);
+	float* detectionFunction = calloc(detectionFunctionLength,
+					  sizeof(float));
+	if (detectionFunction == NULL){
 		return -1;
 	}
 
+	int *segments = NULL, *detRanges = NULL;
+	int s_size = 0;
+	if (activityRanges == NULL){
+		// compute the detectionFunction
+		if (1 != detFunctionCalculation(correntropyWinSize, interval,
+						scaleFactor, sigWindowSize,
+						numChannels, minFreq, maxFreq,
+						samplerate, size, audioData,
+						detectionFunctionLength,
+						detectionFunction, settings)){
+			free(detectionFunction);
+			return -1;
+		}
+	} else {
+		// widen the activity ranges by margin (so that the filters
+		// have settled by the start of each range), align their
+		// starts to the hopsize and merge the ranges that overlap
+		segments = malloc(sizeof(int) * (a_size + 2));
+		detRanges = malloc(sizeof(int) * (a_size + 2));
+		if (segments == NULL || detRanges == NULL){
+			free(segments);
+			free(detRanges);
+			free(detectionFunction);
+			return -1;
+		}
+		for (int i = 0; i < a_size; i += 2){
+			int start = activityRanges[i] - margin;
+			int stop = activityRanges[i+1] + margin;
+			start = start > 0 ? start - (start % interval) : 0;
+			stop = stop < size ? stop : size;
+			if (stop <= start){
+				continue;
+			}
+			if (s_size > 0 && start <= segments[s_size-1]){
+				if (stop > segments[s_size-1]){
+					segments[s_size-1] = stop;
+				}
+			} else {
+				segments[s_size] = start;
+				segments[s_size+1] = stop;
+				s_size += 2;
+			}
+		}
+
+		// compute the detectionFunction of each segment. The entries
+		// outside of the segments are left as 0
+		if (1 != segmentDetFunctionCalculation(correntropyWinSize,
+						       interval, scaleFactor,
+						       sigWindowSize,
+						       numChannels, minFreq,
+						       maxFreq, samplerate,
+						       audioData, segments,
+						       s_size,
+						       detectionFunctionLength,
+						       detectionFunction,
+						       detRanges, settings)){
+			free(segments);
+			free(detRanges);
+			free(detectionFunction);
+			return -1;
+		}
+	}
+
 	printf("detect func computed\n");
 
 	// idendify the transients
-	int transientsLength = detectTransients(detectionFunction,
-						detectionFunctionLength,
-						transients);
+	int transientsLength;
+	if (activityRanges == NULL){
+		transientsLength = detectTransients(detectionFunction,
+						    detectionFunctionLength,
+						    transients);
+	} else {
+		transientsLength = detectTransientsInRanges(detectionFunction,
+							    detectionFunctionLength,
+							    detRanges, s_size,
+							    transients);
+		free(segments);
+		free(detRanges);
+	}
+	free(detectionFunction);
 
 	if(transientsLength == -1){
 		printf("detectTransients failed\n");
-		free(detectionFunction);
 		return -1;
 	}
 
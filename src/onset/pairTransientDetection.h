@@ -1,7 +1,61 @@
+#ifndef PAIRTRANSIENTDETECTION_H
+#define PAIRTRANSIENTDETECTION_H
+
+#include <stddef.h>
 #include "../lists.h"
+#include "simpleDetFunc.h"
 
 //might make sense to rename the file
 
+/// The range of kernel lengths tried by detectTransients (4 corresponds to
+/// 20ms and 1500 corresponds to 7.5s for a hopsize of 5ms)
+#define MIN_KERNEL_LEN 4
+#define MAX_KERNEL_LEN 1500
+
+/// The hopsize (in ms) of the detection function and the length (in ms) of
+/// the window used to compute its rolling sigma (the paper suggests 5ms and
+/// 7s)
+#define DET_FUNC_HOP_MS 5
+#define SIGMA_WINDOW_MS 7000
+
+/// Alignment (in bytes) of every kernel in a kernelBank
+#define KERNEL_BANK_ALIGN 64
+
+/// Holds the kernels of every length from minK to minK + numKernels - 1 in a
+/// single contiguous allocation. The kernel of length L starts at
+/// data + offsets[L - minK] (always aligned to KERNEL_BANK_ALIGN bytes) and
+/// is followed by zero padding up to the start of the next kernel. sqNorms
+/// holds the sum of the squared values of every kernel.
+struct kernelBank{
+	float *data;
+	size_t *offsets;
+	double *sqNorms;
+	int minK;
+	int numKernels;
+};
+
+/// Computes the kernels with lengths minK through maxK (inclusive)
+///
+/// @return Returns 1 for success and -1 for failure. On failure, bank doesn't
+///         need to be destroyed.
+int kernelBankInit(struct kernelBank *bank, int minK, int maxK);
+
+/// Frees the memory held by a kernelBank
+void kernelBankDestroy(struct kernelBank *bank);
+
+/// Returns the kernel of length len
+const float* kernelBankKernel(const struct kernelBank *bank, int len);
+
+/// Returns the process-wide kernel bank used by detectTransients, with lengths
+/// MIN_KERNEL_LEN through MAX_KERNEL_LEN. It is computed by the first call
+/// (thread-safe) and never freed. Returns NULL if it couldn't be allocated.
+const struct kernelBank* sharedKernelBank(void);
+
+/// Internal helper functions that compute the fitness of an onset (offset)
+/// kernel of length len with the values of window, starting from start
+float FitnessOnset(const float* kernel, float* window, int start, int len);
+float FitnessOffset(const float* kernel, float* window, int start, int len);
+
 /// Internal helper function that identifies transients from the provided
 /// detection function
 ///
@@ -23,8 +77,31 @@
 /// Note: We added another extra step in which we dropped the last pair of
 /// detected transients (the algorithm almost always return an extra false
 /// positive note at the end)
+///
+/// Note: The fitness of every kernel length is first estimated by expanding
+/// the squared difference into the sum of the squared kernel (precomputed),
+/// the sum of the squared window (from a prefix sum) and the cross term. Only
+/// the kernel lengths whose estimate is close to the best fitness are then
+/// evaluated with FitnessOnset/FitnessOffset. The chosen lengths are identical
+/// to those of the exhaustive search.
 int detectTransients(float* detection_func, int len, intList* transients);
 
+/// Identical to detectTransients, except that the transients are only
+/// searched for within ranges of detection_func
+///
+/// @param[in] ranges Pairs of indices of detection_func. Each pair holds the
+///            index where a range starts and the index following the range.
+///            The ranges must be in increasing order and must not overlap.
+///            The kernels never extend past the end of a range.
+/// @param[in] r_size The number of entries in ranges
+///
+/// Note: The detection function is normalized by its maximum magnitude over
+/// all len entries. The extra false positive note is dropped from the end of
+/// every range.
+int detectTransientsInRanges(float* detection_func, int len,
+			     const int* ranges, int r_size,
+			     intList* transients);
+
 /// Identifies pairs of onsets and offsets from audio data using the algorithm
 /// published by Chang & Lee (2016)
 ///
@@ -32,6 +109,15 @@ int detectTransients(float* detection_func, int len, intList* transients);
 ///            identified
 /// @param[in] size Length of audioData
 /// @param[in] samplerate The sample rate of the audio data (in Hz)
+/// @param[in] settings Controls how the detection function is computed. NULL
+///            selects the default settings.
+/// @param[in] activityRanges Pairs of indices of audioData, which each hold
+///            the start of an active range and the index following it (in
+///            increasing order). The detection function is only computed
+///            for these ranges (widened by 250ms) and transients are only
+///            searched for within them. If NULL, the whole of audioData is
+///            analyzed.
+/// @param[in] a_size The number of entries in activityRanges
 /// @param[out] transients A pointer to an initially empty intList. This list
 ///             will be filled with integers corresponding to the audio frame
 ///             where transients occured. The transients alternate between
@@ -40,5 +126,15 @@ int detectTransients(float* detection_func, int len, intList* transients);
 ///
 /// @par Note:
 /// This uses the default settings mentioned in the method paper
+///
+/// @par
+/// When activityRanges is provided, the filters and the rolling sigma of each
+/// widened range only see the audio within that range, so the detection
+/// function near the edges of a range can differ slightly from the detection
+/// function of the whole audio.
 int pairwiseTransientDetection(float *audioData, int size, int samplerate,
+			       const struct detFuncSettings *settings,
+			       const int *activityRanges, int a_size,
 			       intList* transients);
+
+#endif /* PAIRTRANSIENTDETECTION_H */
@@ -0,0 +1,620 @@
+#include <math.h>
+#include <stddef.h>
+#include "psmKernel.h"
+#include "fastExp.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define PSM_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define PSM_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+/**
+The functions in this file attempt to be optimized for speed AS MUCH AS
+POSSIBLE. The overwhelming majority (> 90%) of the programs runtime is within
+them. By default, we approximate e^x based off this method for doubles:
+https://nic.schraudolph.org/pubs/Schraudolph99.pdf
+A variation for floats taken from
+https://stackoverflow.com/questions/9652549/self-made-pow-c
+More accurate (and slower) approximations can be selected (see fastExp.h).
+Below is a simplified, much slower version of what they do, for clarity:
+
+static inline float calcPSMEntryContrib(float* x, int window_size, float sigma)
+{
+	float out = 0;
+	for (int i=0; i<window_size; i++){
+		for (int j=1; j<=window_size; j++){
+			float temp = x[i] - x[i+j];
+			out += expf(-1 * temp * temp);
+		}
+	}
+	return out / (sigma * sqrt(2* M_PI));
+}
+**/
+#define M_1_SQRT2PI 0.3989422804f
+#define EXP_UPPER_BOUND 9.345f
+
+/* The gaussian is evaluated with one of the approximations of fastExp.h,
+ * selected by precision. Every implementation below takes precision as an
+ * argument and is always inlined into wrappers that pass a constant, so that
+ * a separate kernel is compiled for each precision.
+ *
+ * For values of temp greater in magnitude than EXP_UPPER_BOUND, e^(-(temp^2))
+ * is smaller than FLT_MIN. expf() would return 0.0f for those, but the
+ * approximations return garbage, so only the values in the valid range are
+ * computed and the others are treated as 0. */
+__attribute__((always_inline))
+static inline float entryContribScalar(float* x, int window_size, float sigma,
+				       enum expPrecision precision)
+{
+	int i, j;
+	float out, temp;
+	out = 0;
+	for (i = 0; i < window_size; i++) {
+		for (j = 1; j <= window_size; j++) {
+			temp = x[i] - x[i+j];
+			if(fabsf(temp) < EXP_UPPER_BOUND){
+				out += fastExp(temp * temp, precision);
+			}
+		}
+	}
+	out *= M_1_SQRT2PI / sigma;
+	return out;
+}
+
+float psmEntryContribScalar(float* x, int window_size, float sigma)
+{
+	return entryContribScalar(x, window_size, sigma,
+				  EXP_PRECISION_SCHRAUDOLPH);
+}
+
+static float psmEntryContribScalarPoly3(float* x, int window_size,
+					float sigma)
+{
+	return entryContribScalar(x, window_size, sigma, EXP_PRECISION_POLY3);
+}
+
+static float psmEntryContribScalarAccurate(float* x, int window_size,
+					   float sigma)
+{
+	return entryContribScalar(x, window_size, sigma,
+				  EXP_PRECISION_ACCURATE);
+}
+
+/* The vectorized implementations below evaluate the inner (lag) loop several
+ * lags at a time. Each lane performs exactly the same arithmetic as the
+ * scalar implementation (see fastExp.h), and lanes with 
+ * |temp| >= EXP_UPPER_BOUND are masked to 0. The lags left over when the 
+ * window size is not a multiple of the vector width are handled by the 
+ * following scalar helper. */
+__attribute__((always_inline))
+static inline float scalarLagSum(float* x, int i, int jStart, int window_size,
+				 enum expPrecision precision)
+{
+	float out = 0, temp;
+	for (int j = jStart; j <= window_size; j++) {
+		temp = x[i] - x[i+j];
+		if(fabsf(temp) < EXP_UPPER_BOUND){
+			out += fastExp(temp * temp, precision);
+		}
+	}
+	return out;
+}
+
+#ifdef PSM_HAVE_X86
+__attribute__((target("sse2"), always_inline))
+static inline float entryContribSSE2(float* x, int window_size, float sigma,
+				     enum expPrecision precision)
+{
+	const __m128 bound = _mm_set1_ps(EXP_UPPER_BOUND);
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	__m128 acc = _mm_setzero_ps();
+	float tail = 0;
+	int i, j;
+
+	for (i = 0; i < window_size; i++) {
+		__m128 xi = _mm_set1_ps(x[i]);
+		for (j = 1; j + 3 <= window_size; j += 4) {
+			__m128 temp = _mm_sub_ps(xi, _mm_loadu_ps(x + i + j));
+			__m128 valid = _mm_cmplt_ps(
+				_mm_andnot_ps(signMask, temp), bound);
+			__m128 term = fastExpSSE2(_mm_mul_ps(temp, temp),
+						  precision);
+			acc = _mm_add_ps(acc, _mm_and_ps(term, valid));
+		}
+		tail += scalarLagSum(x, i, j, window_size, precision);
+	}
+
+	float lanes[4];
+	_mm_storeu_ps(lanes, acc);
+	float out = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + tail;
+	out *= M_1_SQRT2PI / sigma;
+	return out;
+}
+
+__attribute__((target("sse2")))
+static float psmEntryContribSSE2(float* x, int window_size, float sigma)
+{
+	return entryContribSSE2(x, window_size, sigma,
+				EXP_PRECISION_SCHRAUDOLPH);
+}
+
+__attribute__((target("sse2")))
+static float psmEntryContribSSE2Poly3(float* x, int window_size, float sigma)
+{
+	return entryContribSSE2(x, window_size, sigma, EXP_PRECISION_POLY3);
+}
+
+__attribute__((target("sse2")))
+static float psmEntryContribSSE2Accurate(float* x, int window_size,
+					 float sigma)
+{
+	return entryContribSSE2(x, window_size, sigma, EXP_PRECISION_ACCURATE);
+}
+
+// mul and add are kept separate (no FMA, see fastExp.h) so that every lane
+// rounds exactly like the scalar implementation
+__attribute__((target("avx2"), always_inline))
+static inline float entryContribAVX2(float* x, int window_size, float sigma,
+				     enum expPrecision precision)
+{
+	const __m256 bound = _mm256_set1_ps(EXP_UPPER_BOUND);
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+	__m256 acc = _mm256_setzero_ps();
+	float tail = 0;
+	int i, j;
+
+	for (i = 0; i < window_size; i++) {
+		__m256 xi = _mm256_set1_ps(x[i]);
+		for (j = 1; j + 7 <= window_size; j += 8) {
+			__m256 temp = _mm256_sub_ps(xi,
+						    _mm256_loadu_ps(x + i + j));
+			__m256 valid = _mm256_cmp_ps(
+				_mm256_andnot_ps(signMask, temp), bound,
+				_CMP_LT_OQ);
+			__m256 term = fastExpAVX2(_mm256_mul_ps(temp, temp),
+						  precision);
+			acc = _mm256_add_ps(acc, _mm256_and_ps(term, valid));
+		}
+		tail += scalarLagSum(x, i, j, window_size, precision);
+	}
+
+	float lanes[8];
+	_mm256_storeu_ps(lanes, acc);
+	float out = (((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) +
+		     ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]))) + tail;
+	out *= M_1_SQRT2PI / sigma;
+	return out;
+}
+
+__attribute__((target("avx2")))
+static float psmEntryContribAVX2(float* x, int window_size, float sigma)
+{
+	return entryContribAVX2(x, window_size, sigma,
+				EXP_PRECISION_SCHRAUDOLPH);
+}
+
+__attribute__((target("avx2")))
+static float psmEntryContribAVX2Poly3(float* x, int window_size, float sigma)
+{
+	return entryContribAVX2(x, window_size, sigma, EXP_PRECISION_POLY3);
+}
+
+__attribute__((target("avx2")))
+static float psmEntryContribAVX2Accurate(float* x, int window_size,
+					 float sigma)
+{
+	return entryContribAVX2(x, window_size, sigma, EXP_PRECISION_ACCURATE);
+}
+#endif /* PSM_HAVE_X86 */
+
+#ifdef PSM_HAVE_NEON
+__attribute__((always_inline))
+static inline float entryContribNEON(float* x, int window_size, float sigma,
+				     enum expPrecision precision)
+{
+	const float32x4_t bound = vdupq_n_f32(EXP_UPPER_BOUND);
+	float32x4_t acc = vdupq_n_f32(0.0f);
+	float tail = 0;
+	int i, j;
+
+	for (i = 0; i < window_size; i++) {
+		float32x4_t xi = vdupq_n_f32(x[i]);
+		for (j = 1; j + 3 <= window_size; j += 4) {
+			float32x4_t temp = vsubq_f32(xi, vld1q_f32(x + i + j));
+			uint32x4_t valid = vcltq_f32(vabsq_f32(temp), bound);
+			float32x4_t term = fastExpNEON(vmulq_f32(temp, temp),
+						       precision);
+			acc = vaddq_f32(acc, vreinterpretq_f32_u32(
+				vandq_u32(vreinterpretq_u32_f32(term), valid)));
+		}
+		tail += scalarLagSum(x, i, j, window_size, precision);
+	}
+
+	float lanes[4];
+	vst1q_f32(lanes, acc);
+	float out = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + tail;
+	out *= M_1_SQRT2PI / sigma;
+	return out;
+}
+
+static float psmEntryContribNEON(float* x, int window_size, float sigma)
+{
+	return entryContribNEON(x, window_size, sigma,
+				EXP_PRECISION_SCHRAUDOLPH);
+}
+
+static float psmEntryContribNEONPoly3(float* x, int window_size, float sigma)
+{
+	return entryContribNEON(x, window_size, sigma, EXP_PRECISION_POLY3);
+}
+
+static float psmEntryContribNEONAccurate(float* x, int window_size,
+					 float sigma)
+{
+	return entryContribNEON(x, window_size, sigma, EXP_PRECISION_ACCURATE);
+}
+#endif /* PSM_HAVE_NEON */
+
+/* The cached implementations below evaluate the same approximation from the
+ * unscaled squared differences, d2. Since temp^2 = d2 * scale:
+ *   - |temp| < EXP_UPPER_BOUND becomes d2 < EXP_UPPER_BOUND^2 / scale
+ *   - FASTEXP_A*(-temp*temp) + FASTEXP_C becomes
+ *     d2 * (-FASTEXP_A*scale) + FASTEXP_C
+ * which saves the subtraction, the absolute value and a multiplication per
+ * term. The terms are independent of the order of the pairs. */
+static inline float scalarCachedSum(float* sqDiffs, int count,
+				    float negAScale, float bound)
+{
+	float out = 0;
+	for (int k = 0; k < count; k++) {
+		if (sqDiffs[k] < bound){
+			out += fastExpSchraudolphArg(sqDiffs[k] * negAScale +
+						     FASTEXP_C);
+		}
+	}
+	return out;
+}
+
+float psmCachedContribScalar(float* sqDiffs, int count, float scale,
+			     float sigma)
+{
+	float out = scalarCachedSum(sqDiffs, count, -FASTEXP_A * scale,
+				    EXP_UPPER_BOUND * EXP_UPPER_BOUND / scale);
+	out *= M_1_SQRT2PI / sigma;
+	return out;
+}
+
+#ifdef PSM_HAVE_X86
+__attribute__((target("sse2")))
+static float psmCachedContribSSE2(float* sqDiffs, int count, float scale,
+				  float sigma)
+{
+	const __m128 negAScale = _mm_set1_ps(-FASTEXP_A * scale);
+	const __m128 c = _mm_set1_ps(FASTEXP_C);
+	const __m128 bound = _mm_set1_ps(EXP_UPPER_BOUND * EXP_UPPER_BOUND /
+					 scale);
+	__m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+	int k;
+
+	// two accumulators hide the latency of the additions
+	for (k = 0; k + 7 < count; k += 8) {
+		__m128 d0 = _mm_loadu_ps(sqDiffs + k);
+		__m128 d1 = _mm_loadu_ps(sqDiffs + k + 4);
+		__m128i bits0 = _mm_slli_epi32(_mm_cvttps_epi32(
+			_mm_add_ps(_mm_mul_ps(d0, negAScale), c)), 16);
+		__m128i bits1 = _mm_slli_epi32(_mm_cvttps_epi32(
+			_mm_add_ps(_mm_mul_ps(d1, negAScale), c)), 16);
+		acc0 = _mm_add_ps(acc0, _mm_and_ps(_mm_castsi128_ps(bits0),
+						   _mm_cmplt_ps(d0, bound)));
+		acc1 = _mm_add_ps(acc1, _mm_and_ps(_mm_castsi128_ps(bits1),
+						   _mm_cmplt_ps(d1, bound)));
+	}
+
+	float lanes[4];
+	_mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+	float out = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	out += scalarCachedSum(sqDiffs + k, count - k, -FASTEXP_A * scale,
+			       EXP_UPPER_BOUND * EXP_UPPER_BOUND / scale);
+	out *= M_1_SQRT2PI / sigma;
+	return out;
+}
+
+__attribute__((target("avx2,fma")))
+static float psmCachedContribAVX2(float* sqDiffs, int count, float scale,
+				  float sigma)
+{
+	const __m256 negAScale = _mm256_set1_ps(-FASTEXP_A * scale);
+	const __m256 c = _mm256_set1_ps(FASTEXP_C);
+	const __m256 bound = _mm256_set1_ps(EXP_UPPER_BOUND * EXP_UPPER_BOUND /
+					    scale);
+	__m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+	int k;
+
+	// two accumulators hide the latency of the additions. Unlike
+	// psmEntryContribAVX2, the argument is computed with a fused
+	// multiply-add (the cached method makes no promise of matching the
+	// scalar bitwise)
+	for (k = 0; k + 15 < count; k += 16) {
+		__m256 d0 = _mm256_loadu_ps(sqDiffs + k);
+		__m256 d1 = _mm256_loadu_ps(sqDiffs + k + 8);
+		__m256i bits0 = _mm256_slli_epi32(_mm256_cvttps_epi32(
+			_mm256_fmadd_ps(d0, negAScale, c)), 16);
+		__m256i bits1 = _mm256_slli_epi32(_mm256_cvttps_epi32(
+			_mm256_fmadd_ps(d1, negAScale, c)), 16);
+		acc0 = _mm256_add_ps(acc0,
+				     _mm256_and_ps(_mm256_castsi256_ps(bits0),
+						   _mm256_cmp_ps(d0, bound,
+								 _CMP_LT_OQ)));
+		acc1 = _mm256_add_ps(acc1,
+				     _mm256_and_ps(_mm256_castsi256_ps(bits1),
+						   _mm256_cmp_ps(d1, bound,
+								 _CMP_LT_OQ)));
+	}
+
+	float lanes[8];
+	_mm256_storeu_ps(lanes, _mm256_add_ps(acc0, acc1));
+	float out = (((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) +
+		     ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7])));
+	out += scalarCachedSum(sqDiffs + k, count - k, -FASTEXP_A * scale,
+			       EXP_UPPER_BOUND * EXP_UPPER_BOUND / scale);
+	out *= M_1_SQRT2PI / sigma;
+	return out;
+}
+#endif /* PSM_HAVE_X86 */
+
+#ifdef PSM_HAVE_NEON
+static float psmCachedContribNEON(float* sqDiffs, int count, float scale,
+				  float sigma)
+{
+	const float32x4_t negAScale = vdupq_n_f32(-FASTEXP_A * scale);
+	const float32x4_t c = vdupq_n_f32(FASTEXP_C);
+	const float32x4_t bound = vdupq_n_f32(EXP_UPPER_BOUND *
+					      EXP_UPPER_BOUND / scale);
+	float32x4_t acc0 = vdupq_n_f32(0.0f), acc1 = vdupq_n_f32(0.0f);
+	int k;
+
+	for (k = 0; k + 7 < count; k += 8) {
+		float32x4_t d0 = vld1q_f32(sqDiffs + k);
+		float32x4_t d1 = vld1q_f32(sqDiffs + k + 4);
+		int32x4_t bits0 = vshlq_n_s32(vcvtq_s32_f32(
+			vaddq_f32(vmulq_f32(d0, negAScale), c)), 16);
+		int32x4_t bits1 = vshlq_n_s32(vcvtq_s32_f32(
+			vaddq_f32(vmulq_f32(d1, negAScale), c)), 16);
+		acc0 = vaddq_f32(acc0, vreinterpretq_f32_u32(
+			vandq_u32(vreinterpretq_u32_s32(bits0),
+				  vcltq_f32(d0, bound))));
+		acc1 = vaddq_f32(acc1, vreinterpretq_f32_u32(
+			vandq_u32(vreinterpretq_u32_s32(bits1),
+				  vcltq_f32(d1, bound))));
+	}
+
+	float lanes[4];
+	vst1q_f32(lanes, vaddq_f32(acc0, acc1));
+	float out = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	out += scalarCachedSum(sqDiffs + k, count - k, -FASTEXP_A * scale,
+			       EXP_UPPER_BOUND * EXP_UPPER_BOUND / scale);
+	out *= M_1_SQRT2PI / sigma;
+	return out;
+}
+#endif /* PSM_HAVE_NEON */
+
+float psmHistDotScalar(const float* counts, const float* gauss, int n)
+{
+	// the separate accumulators break up the chain of dependent additions
+	float sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+	int k = 0;
+	for (; k + 4 <= n; k += 4){
+		sum0 += counts[k] * gauss[k];
+		sum1 += counts[k+1] * gauss[k+1];
+		sum2 += counts[k+2] * gauss[k+2];
+		sum3 += counts[k+3] * gauss[k+3];
+	}
+	for (; k < n; k++){
+		sum0 += counts[k] * gauss[k];
+	}
+	return (sum0 + sum1) + (sum2 + sum3);
+}
+
+#ifdef PSM_HAVE_X86
+__attribute__((target("sse2")))
+static float psmHistDotSSE2(const float* counts, const float* gauss, int n)
+{
+	__m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+	int k;
+	for (k = 0; k + 7 < n; k += 8) {
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(counts + k),
+						   _mm_loadu_ps(gauss + k)));
+		acc1 = _mm_add_ps(acc1,
+				  _mm_mul_ps(_mm_loadu_ps(counts + k + 4),
+					     _mm_loadu_ps(gauss + k + 4)));
+	}
+
+	float lanes[4];
+	_mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+	float out = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	for (; k < n; k++){
+		out += counts[k] * gauss[k];
+	}
+	return out;
+}
+
+__attribute__((target("avx2,fma")))
+static float psmHistDotAVX2(const float* counts, const float* gauss, int n)
+{
+	__m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+	int k;
+	for (k = 0; k + 15 < n; k += 16) {
+		acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(counts + k),
+				       _mm256_loadu_ps(gauss + k), acc0);
+		acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(counts + k + 8),
+				       _mm256_loadu_ps(gauss + k + 8), acc1);
+	}
+
+	float lanes[8];
+	_mm256_storeu_ps(lanes, _mm256_add_ps(acc0, acc1));
+	float out = (((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) +
+		     ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7])));
+	for (; k < n; k++){
+		out += counts[k] * gauss[k];
+	}
+	return out;
+}
+#endif /* PSM_HAVE_X86 */
+
+#ifdef PSM_HAVE_NEON
+static float psmHistDotNEON(const float* counts, const float* gauss, int n)
+{
+	float32x4_t acc0 = vdupq_n_f32(0.0f), acc1 = vdupq_n_f32(0.0f);
+	int k;
+	for (k = 0; k + 7 < n; k += 8) {
+		acc0 = vaddq_f32(acc0, vmulq_f32(vld1q_f32(counts + k),
+						 vld1q_f32(gauss + k)));
+		acc1 = vaddq_f32(acc1, vmulq_f32(vld1q_f32(counts + k + 4),
+						 vld1q_f32(gauss + k + 4)));
+	}
+
+	float lanes[4];
+	vst1q_f32(lanes, vaddq_f32(acc0, acc1));
+	float out = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	for (; k < n; k++){
+		out += counts[k] * gauss[k];
+	}
+	return out;
+}
+#endif /* PSM_HAVE_NEON */
+
+enum psmSimdLevel psmSimdLevelDetect(void)
+{
+#ifdef PSM_HAVE_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")){
+		return PSM_SIMD_AVX2;
+	} else if (__builtin_cpu_supports("sse2")){
+		return PSM_SIMD_SSE2;
+	}
+#endif
+#ifdef PSM_HAVE_NEON
+	return PSM_SIMD_NEON;
+#endif
+	return PSM_SIMD_SCALAR;
+}
+
+psmEntryContribFunc psmEntryContribPrecisionGet(enum psmSimdLevel simdLevel,
+						enum expPrecision precision)
+{
+	// the implementations of each level, in the order of enum expPrecision
+	static const psmEntryContribFunc scalar[] = {
+		&psmEntryContribScalar, &psmEntryContribScalarPoly3,
+		&psmEntryContribScalarAccurate};
+#ifdef PSM_HAVE_X86
+	static const psmEntryContribFunc sse2[] = {
+		&psmEntryContribSSE2, &psmEntryContribSSE2Poly3,
+		&psmEntryContribSSE2Accurate};
+	static const psmEntryContribFunc avx2[] = {
+		&psmEntryContribAVX2, &psmEntryContribAVX2Poly3,
+		&psmEntryContribAVX2Accurate};
+#endif
+#ifdef PSM_HAVE_NEON
+	static const psmEntryContribFunc neon[] = {
+		&psmEntryContribNEON, &psmEntryContribNEONPoly3,
+		&psmEntryContribNEONAccurate};
+#endif
+
+	if ((precision < EXP_PRECISION_SCHRAUDOLPH) ||
+	    (precision > EXP_PRECISION_ACCURATE)){
+		return NULL;
+	}
+	switch(simdLevel){
+	case PSM_SIMD_SCALAR:
+		return scalar[precision];
+#ifdef PSM_HAVE_X86
+	case PSM_SIMD_SSE2:
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("sse2")){
+			return sse2[precision];
+		}
+		return NULL;
+	case PSM_SIMD_AVX2:
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")){
+			return avx2[precision];
+		}
+		return NULL;
+#endif
+#ifdef PSM_HAVE_NEON
+	case PSM_SIMD_NEON:
+		return neon[precision];
+#endif
+	default:
+		return NULL;
+	}
+}
+
+psmEntryContribFunc psmEntryContribGet(enum psmSimdLevel simdLevel)
+{
+	return psmEntryContribPrecisionGet(simdLevel,
+					   EXP_PRECISION_SCHRAUDOLPH);
+}
+
+psmCachedContribFunc psmCachedContribGet(enum psmSimdLevel simdLevel)
+{
+	switch(simdLevel){
+	case PSM_SIMD_SCALAR:
+		return &psmCachedContribScalar;
+#ifdef PSM_HAVE_X86
+	case PSM_SIMD_SSE2:
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("sse2")){
+			return &psmCachedContribSSE2;
+		}
+		return NULL;
+	case PSM_SIMD_AVX2:
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2") &&
+		    __builtin_cpu_supports("fma")){
+			return &psmCachedContribAVX2;
+		}
+		return NULL;
+#endif
+#ifdef PSM_HAVE_NEON
+	case PSM_SIMD_NEON:
+		return &psmCachedContribNEON;
+#endif
+	default:
+		return NULL;
+	}
+}
+
+psmHistDotFunc psmHistDotGet(enum psmSimdLevel simdLevel)
+{
+	switch(simdLevel){
+	case PSM_SIMD_SCALAR:
+		return &psmHistDotScalar;
+#ifdef PSM_HAVE_X86
+	case PSM_SIMD_SSE2:
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("sse2")){
+			return &psmHistDotSSE2;
+		}
+		return NULL;
+	case PSM_SIMD_AVX2:
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2") &&
+		    __builtin_cpu_supports("fma")){
+			return &psmHistDotAVX2;
+		}
+		return NULL;
+#endif
+#ifdef PSM_HAVE_NEON
+	case PSM_SIMD_NEON:
+		return &psmHistDotNEON;
+#endif
+	default:
+		return NULL;
+	}
+}
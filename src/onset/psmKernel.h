@@ -0,0 +1,114 @@
+#ifndef PSMKERNEL_H
+#define PSMKERNEL_H
+
+#include "fastExp.h"
+
+/// Identifies the different implementations of the pooled summary matrix
+/// entry calculation. PSM_SIMD_SCALAR is always available and serves as the
+/// reference implementation.
+enum psmSimdLevel{
+	PSM_SIMD_SCALAR = 0,
+	PSM_SIMD_SSE2 = 1, // 4 lags at a time (x86)
+	PSM_SIMD_AVX2 = 2, // 8 lags at a time (x86)
+	PSM_SIMD_NEON = 3, // 4 lags at a time (ARM)
+};
+
+/// Signature shared by all implementations of the pooled summary matrix
+/// entry calculation.
+///
+/// @param[in] x The scaled values of the window. It must have at least
+///            `2*winSize + 1` entries; x[0] is the first entry of the window
+///            and the lag j contribution of x[i] is computed from x[i+j]
+/// @param[in] winSize The correntropy window size (also the maximum lag)
+/// @param[in] sigma The kernel width of the window
+///
+/// @return The contribution of the window to the pooled summary matrix
+typedef float (*psmEntryContribFunc)(float* x, int winSize, float sigma);
+
+/// The reference scalar implementation
+float psmEntryContribScalar(float* x, int winSize, float sigma);
+
+/// Returns the fastest implementation supported by both the build and the CPU
+/// that the program is currently running on.
+enum psmSimdLevel psmSimdLevelDetect(void);
+
+/// Returns the implementation corresponding to simdLevel. If that level is
+/// not supported by the build or by the CPU, NULL is returned.
+///
+/// @par Note:
+/// All implementations evaluate each exponential in exactly the same way, but
+/// the vectorized implementations accumulate the terms in a different order.
+/// Consequently their results are not bitwise identical to the scalar
+/// implementation; the relative difference is typically ~1e-6 and stays below
+/// 1e-4 for the window sizes used in practice.
+psmEntryContribFunc psmEntryContribGet(enum psmSimdLevel simdLevel);
+
+/// Identical to psmEntryContribGet, except that the gaussian is evaluated with
+/// the given precision (see fastExp.h) rather than with
+/// EXP_PRECISION_SCHRAUDOLPH. NULL is also returned if precision is invalid.
+///
+/// @par Note:
+/// Every lane of the vectorized implementations evaluates the gaussian
+/// exactly like the scalar implementation of the same precision, so the
+/// results again only differ in the order of summation.
+psmEntryContribFunc psmEntryContribPrecisionGet(enum psmSimdLevel simdLevel,
+						enum expPrecision precision);
+
+/// Signature shared by all implementations of the cached pooled summary matrix
+/// entry calculation, which is used by the incremental method (see
+/// pSMContributionIncremental). Rather than the scaled values of the window,
+/// it is passed the unscaled squared differences of a subset of the pairs in
+/// the window.
+///
+/// @param[in] sqDiffs The squared differences, (x[i] - x[i+j])^2, of the pairs
+///            in any order
+/// @param[in] count The number of entries in sqDiffs
+/// @param[in] scale The factor that scales a squared difference to the
+///            argument of the gaussian: 1/(2*sigma^2)
+/// @param[in] sigma The kernel width of the window
+///
+/// @return The contribution of the pairs to the pooled summary matrix
+typedef float (*psmCachedContribFunc)(float* sqDiffs, int count, float scale,
+				      float sigma);
+
+/// The reference scalar implementation
+float psmCachedContribScalar(float* sqDiffs, int count, float scale,
+			     float sigma);
+
+/// Returns the implementation corresponding to simdLevel. If that level is
+/// not supported by the build or by the CPU, NULL is returned.
+///
+/// @par Note:
+/// The cached implementations fold the scale into the constants of the
+/// exponential approximation, so the terms are rounded slightly differently
+/// than by psmEntryContribGet's implementations (the AVX2 implementation also
+/// uses fused multiply-adds, so it requires FMA support). The relative
+/// difference of the result is typically ~1e-5.
+psmCachedContribFunc psmCachedContribGet(enum psmSimdLevel simdLevel);
+
+/// Signature shared by all implementations of the dot product used by the
+/// histogram method (see histPSMEntryContrib) to pair the histogram of the
+/// targets of a row with the gaussian of the bin differences.
+///
+/// @param[in] counts The number of targets in each of n consecutive bins
+/// @param[in] gauss The gaussian of the difference between each of those bins
+///            and the bin of the source
+/// @param[in] n The number of bins
+///
+/// @return The sum of counts[k]*gauss[k]
+typedef float (*psmHistDotFunc)(const float* counts, const float* gauss,
+				int n);
+
+/// The reference scalar implementation
+float psmHistDotScalar(const float* counts, const float* gauss, int n);
+
+/// Returns the implementation corresponding to simdLevel. If that level is
+/// not supported by the build or by the CPU, NULL is returned.
+///
+/// @par Note:
+/// The implementations accumulate the terms in a different order (and the
+/// AVX2 implementation uses fused multiply-adds, so it requires FMA support),
+/// so their results differ by rounding.
+psmHistDotFunc psmHistDotGet(enum psmSimdLevel simdLevel);
+
+#endif /* PSMKERNEL_H */
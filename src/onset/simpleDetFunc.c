@@ -2,286 +2,160 @@
 #include <stdlib.h>
 #include <math.h>
 #include <time.h>
+#include <pthread.h>
 #include "filterBank.h"
-
-/* Concept is taken from python Pandas package*/
-
-/* If the window is centred, then curLocation refers to the centre of the 
-   window. Otherwise, it refers to the left edge */
-
-struct windowIndexer{
-	int variable; /* expects 1 or 0 */
-	int centered; /* expects 1 or 0 */
-	int sizeLeft;
-	int sizeRight;
-	int interval;
-	int curLocation; 
-	int arrayLength;
-};
-
-
-struct windowIndexer* windowIndexerNew(int variable, int centered, int winSize,
-				       int interval, int startIndex,
-				       int arrayLength)
+#include "simpleDetFunc.h"
+#include "psmKernel.h"
+#include "gammatoneKernel.h"
+
+/* The window of rollSigma centered on index c holds buffer[start..stop), where
+ * start = max(0, c - sizeLeft) and stop = min(dataLength, c + sizeRight). The
+ * window can be centered past the end of the array, so start is clamped to
+ * stop (the window is empty once the center is sizeLeft past the end). */
+static inline int sigmaWinStop(int center, int sizeRight, int dataLength)
 {
-	struct windowIndexer* out;
-	out = malloc(sizeof(struct windowIndexer));
-	out->variable = variable;
-	out->centered = centered;
-	if (centered){
-		out->sizeLeft = winSize/2;
-		out->sizeRight = out->sizeLeft + 1;
-		if (winSize % 2 == 0){
-			(out->sizeLeft)-=1;
-		}
-	} else {
-		out->sizeLeft = 0;
-		out->sizeRight = winSize;
-	}
-	out->interval = interval;
-	out->curLocation = startIndex;
-	out->arrayLength = arrayLength;
-	return out;
+	return (center + sizeRight < dataLength) ? center + sizeRight : dataLength;
 }
 
-void windowIndexerDestroy(struct windowIndexer *wInd){
-	free(wInd);
-}
-
-void wIndAdvance(struct windowIndexer *wInd){
-	(wInd->curLocation) += (wInd->interval);
+static inline int sigmaWinStart(int center, int sizeLeft, int stop)
+{
+	int start = (center > sizeLeft) ? center - sizeLeft : 0;
+	return (start < stop) ? start : stop;
 }
 
-int wIndGetStart(struct windowIndexer *wInd){
-	if (wInd->centered !=0){
-		int temp;
-		temp = wInd->curLocation - wInd->sizeLeft;
-		if (temp < 0){
-			// applies to both variable and non-variable windows
-			return 0;
-		}else{
-			return temp;
-		}
-	} else {
-		return (wInd->curLocation);
-	}
+/* Adds val to sum with Kahan compensation. comp holds the low order bits that
+ * were lost by the previous additions. */
+static inline void kahanAdd(double *sum, double *comp, double val)
+{
+	double y = val - *comp;
+	double t = *sum + y;
+	*comp = (t - *sum) - y;
+	*sum = t;
 }
 
-int wIndGetStop(struct windowIndexer *wInd){
-	int temp = wInd->curLocation + wInd->sizeRight;
-	
-	if (wInd->variable){
-		if (temp > wInd->arrayLength){
-			return wInd->arrayLength;
-		} else {
-			return temp;
+/* Computes the sums of (x[j] - shift) and (x[j] - shift)^2 over
+ * x[start..stop). The four partial sums are independent, which lets the
+ * compiler vectorize the loop (it can't reorder a single sum without
+ * -ffast-math) and also reduces the rounding error. */
+static inline void blockMoments(const float *x, int start, int stop,
+				double shift, double *sum, double *sumSq)
+{
+	double s[4] = {0, 0, 0, 0}, q[4] = {0, 0, 0, 0};
+	double d;
+	int j, l;
+	for (j = start; j + 4 <= stop; j += 4){
+		for (l = 0; l < 4; l++){
+			d = (double)x[j + l] - shift;
+			s[l] += d;
+			q[l] += d * d;
 		}
-	} else {
-		return temp;
 	}
-}
-
-
-/* the following draws HEAVY inspiration from implementation of pandas 
- * roll_variance. 
- * https://github.com/pandas-dev/pandas/blob/master/pandas/_libs/window.pyx
- */
-static inline double calc_var(double nobs, double ssqdm_x){
-	double result;
-	/* Variance is unchanged if no observation is added or removed
-	 */
-	if (nobs == 1){
-		result = 0;
-	} else {
-		result = ssqdm_x / (nobs - 1);
-		if (result < 0){
-			result = 0;
-		}
+	for (; j < stop; j++){
+		d = (double)x[j] - shift;
+		s[0] += d;
+		q[0] += d * d;
 	}
-	return result;
+	*sum = (s[0] + s[1]) + (s[2] + s[3]);
+	*sumSq = (q[0] + q[1]) + (q[2] + q[3]);
 }
 
-static inline void add_var(double val, int *nobs, double *mean_x,
-			   double *ssqdm_x){
-	/* add a value from the var calc */
-	double delta;
-
-	(*nobs) += 1;
-	delta = (val - *mean_x);
-	(*mean_x) += delta / *nobs;
-	(*ssqdm_x) += (((*nobs-1) * delta * delta) / *nobs);
-}
-
-static inline void remove_var(double val, int *nobs, double *mean_x,
-			      double *ssqdm_x){
-	/* remove a value from the var calc */
-
-	double delta;
-
-	(*nobs) -= 1;
-	if (*nobs>0){
-		delta = (val - *mean_x);
-		(*mean_x) -= delta / *nobs;
-		(*ssqdm_x) -= (((*nobs+1) * delta * delta) / *nobs);
-	} else {
-		*mean_x = 0;
-		*ssqdm_x = 0;
-	}
-}
-
-/* Basically we compute the rolling variance following the algorithm from 
- * python pandas. This algorithm can still be further optimized so that we add
- * and remove values from the windows in chunks (rather than 1 at a time). 
- * Additionally, if we store wInd on the stack, we might get better 
- * optimizations.
- */
+/* The rolling variance is computed from running sums of x and x^2 (the
+ * windows were originally modelled on the rolling windows of python pandas).
+ * Rather than stepping the window over every index between two outputs, the
+ * samples that enter and leave the window over a whole hop are summed as
+ * blocks, and the blocks are added to the running sums with Kahan
+ * compensation. The samples are shifted by the mean of the first window so
+ * that the sum of squares doesn't suffer from cancellation when the mean is
+ * far from zero. */
 
 void rollSigma(int startIndex, int interval, float scaleFactor,
 	       int sigWindowSize, int dataLength, int numWindows,
 	       float *buffer, float *sigmas)
 {
-	int i,j,k,nobs = 0,winStart, winStop, prevStop,prevStart;
-	double mean_x = 0, ssqdm_x = 0;
-	float std;
-	struct windowIndexer* wInd;
-
-	wInd = windowIndexerNew(1, 1, sigWindowSize, 1,
-				startIndex, dataLength);
-	
-	for (i=0;i<numWindows;i++){
-		winStart = wIndGetStart(wInd);
-		winStop = wIndGetStop(wInd);
-		/* Over the first window observations can only be added 
-		 * never removed */
-		if (i == 0){
-			for (j=winStart;j<winStop;j++){
-				//printf("%f\n",buffer[j]);
-				add_var((double)buffer[j], &nobs, &mean_x,
-					&ssqdm_x);
-			}
-		} else {
-			/* after the first window, observations can both be 
-			 * added and removed */
-
-			/* calculate adds 
-			 * (almost always iterates over 1 value, for the final
-			 *  windows, iterates over 0 values)
-			 */
-			for (j=prevStop;j<winStop;j++){
-				add_var((double)buffer[j], &nobs, &mean_x,
-					&ssqdm_x);
-			}
-
-			/* calculate deletes 
-			 * (should always iterates over 1 value)
-			 */
-			for (j = prevStart; j<winStart; j++){
-				remove_var((double)buffer[j], &nobs, &mean_x,
-					   &ssqdm_x);
+	int i, nobs, center, start, stop, prevStart, prevStop;
+	int sizeLeft, sizeRight;
+	double shift, sum, sumSq, sumComp = 0, sumSqComp = 0;
+	double addSum, addSumSq, removeSum, removeSumSq, var;
+	float interiorNorm, norm;
+
+	sizeLeft = sigWindowSize/2;
+	sizeRight = sizeLeft + 1;
+	if (sigWindowSize % 2 == 0){
+		sizeLeft -= 1;
+	}
+	// nobs^0.2 of every window that lies entirely inside of the array
+	interiorNorm = powf((float)sigWindowSize, 0.2f);
+
+	center = startIndex;
+	stop = sigmaWinStop(center, sizeRight, dataLength);
+	start = sigmaWinStart(center, sizeLeft, stop);
+	blockMoments(buffer, start, stop, 0, &sum, &sumSq);
+	shift = (stop > start) ? sum / (stop - start) : 0;
+	blockMoments(buffer, start, stop, shift, &sum, &sumSq);
+
+	for (i = 0; i < numWindows; i++){
+		if (i > 0){
+			prevStart = start;
+			prevStop = stop;
+			center += interval;
+			stop = sigmaWinStop(center, sizeRight, dataLength);
+			start = sigmaWinStart(center, sizeLeft, stop);
+			if (start >= prevStop){
+				// the windows don't overlap (interval is
+				// larger than sigWindowSize)
+				blockMoments(buffer, start, stop, shift, &sum,
+					     &sumSq);
+				sumComp = 0;
+				sumSqComp = 0;
+			} else {
+				blockMoments(buffer, prevStop, stop, shift,
+					     &addSum, &addSumSq);
+				blockMoments(buffer, prevStart, start, shift,
+					     &removeSum, &removeSumSq);
+				kahanAdd(&sum, &sumComp, addSum - removeSum);
+				kahanAdd(&sumSq, &sumSqComp,
+					 addSumSq - removeSumSq);
 			}
 		}
-		wIndAdvance(wInd);
-		prevStart = winStart;
-		prevStop = winStop;
-
-		/* compute sigma */
-		std = sqrtf((float)calc_var(nobs, ssqdm_x));
-		sigmas[i] = (scaleFactor*std/powf((float)nobs,0.2));
-
-		/* Now we need to advance the window over the interval between  
-		 * the current where we just calculated sigma and the next 
-		 * location where we want sigma. 
-		 * We do this because the windowIndexer only advances one index 
-		 * at a time and we are only interested in keeping the sigma 
-		 * values separated by interval (a number indices typically 
-		 * greater than 1) */
-		if (i == (numWindows-1)){
-			break;
-		}
-
-		for (k = 1; k<interval;k++){
-			winStart = wIndGetStart(wInd);
-			winStop = wIndGetStop(wInd);
-			/* after the first window, observations can both be 
-			 * added and removed */
-
-			/* calculate adds */
-			for (j=prevStop;j<winStop;j++){
-				add_var((double)buffer[j], &nobs, &mean_x, &ssqdm_x);
-			}
 
-			/* calculate deletes */
-			for (j = prevStart; j< winStart;j++){
-				remove_var((double)buffer[j], &nobs, &mean_x, &ssqdm_x);
-			}
-			wIndAdvance(wInd);
-			prevStart = winStart;
-			prevStop = winStop;
+		nobs = stop - start;
+		if (nobs < 2){
+			// the variance of a single sample is 0
+			sigmas[i] = 0;
+			continue;
+		}
+		var = (sumSq - sum * sum / nobs) / (nobs - 1);
+		if (var < 0){
+			var = 0;
 		}
+		norm = (nobs == sigWindowSize) ? interiorNorm :
+			powf((float)nobs, 0.2f);
+		sigmas[i] = (scaleFactor * sqrtf((float)var) / norm);
 	}
-	windowIndexerDestroy(wInd);
 }
 
 
-/**
-Below function attempts to be optimized for speed AS MUCH AS POSSIBLE.
-The overwhelming majority (> 90%) of the programs runtime is within this function.
-We approximate e^x based off this method for doubles: https://nic.schraudolph.org/pubs/Schraudolph99.pdf
-A variation for floats taken from https://stackoverflow.com/questions/9652549/self-made-pow-c
-Below is a simplified, much slower version of what below function does, for clarity:
-
-static inline float calcPSMEntryContrib(float* x, int window_size, float sigma)
-{
-	float out = 0;
-	for (int i=0; i<window_size; i++){
-		for (int j=1; j<=window_size; j++){
-			float temp = x[i] - x[i+j];
-			out += expf(-1 * temp * temp);
-		}
-	}
-	return out / (sigma * sqrt(2* M_PI));
-}
-**/
-#define EXP_A 184
-#define EXP_C 16249 
-#define M_1_SQRT2PI 0.3989422804f
-#define EXP_UPPER_BOUND 9.345f
-static inline float calcPSMEntryContrib(float* x, int window_size, float sigma)
+void pSMContribution(int correntropyWinSize, int interval, int numWindows,
+		     float *buffer, float *sigmas, float *pSMatrix)
 {
-	//union allows us to treat the same 4 bytes of memory as both a float and 2 shorts
-	union {
-		float f;
-		struct {
-			short j, i; //if on big-endian architecture, j, i must be flipped to i, j
-		} s;
-	} res;
-	int i, j;
-	float out, temp;
-	res.s.j = 0;
-	out = 0;
-	for (i = 0; i < window_size; i++) {
-		for (j = 1; j <= window_size; j++) {
-			temp = x[i] - x[i+j];
-			//for values of temp greater in magnitude than 9.345, e^(-(temp^2)) is smaller than FLT_MIN
-			//expf() would return 0.0f for results smaller than FLT_MIN, but EXP_APPROX will return NaN,-NaN for most (not all, some underflow)
-			//by only computing values in valid range, ones outside are treated as 0.
-			if(fabsf(temp) < EXP_UPPER_BOUND){
-				res.s.i = EXP_A*(-1.0f * temp * temp) + (EXP_C);
-				out += res.f;
-			}
-		}
-	}
-	out *= M_1_SQRT2PI / sigma;
-	return out;
+	pSMContributionPrecision(correntropyWinSize, interval, numWindows,
+				 buffer, sigmas, EXP_PRECISION_SCHRAUDOLPH,
+				 pSMatrix);
 }
 
-void pSMContribution(int correntropyWinSize, int interval, int numWindows,
-		     float *buffer, float *sigmas, float *pSMatrix)
+void pSMContributionPrecision(int correntropyWinSize, int interval,
+			      int numWindows, float *buffer, float *sigmas,
+			      enum expPrecision precision, float *pSMatrix)
 {
 	int i,start,j,calcBufferLength;
 	float *calcBuffer, denom;
+	psmEntryContribFunc calcPSMEntryContrib;
 	start = 0;
 
+	// use the fastest implementation supported by the CPU
+	calcPSMEntryContrib = psmEntryContribPrecisionGet(psmSimdLevelDetect(),
+							  precision);
+
 	calcBufferLength = 2*correntropyWinSize +1;
 	calcBuffer = malloc(sizeof(float)*calcBufferLength);
 
@@ -296,7 +170,7 @@ void pSMContribution(int correntropyWinSize, int interval, int numWindows,
 		 * first entry in the window
 		 */
 		for (j=1;j<=calcBufferLength;j++){
-			calcBuffer[j] = (buffer[start+j]) * denom;
+			calcBuffer[j-1] = (buffer[start+j]) * denom;
 		}
 		pSMatrix[i] += calcPSMEntryContrib(calcBuffer,
 						   correntropyWinSize,
@@ -310,46 +184,465 @@ void pSMContribution(int correntropyWinSize, int interval, int numWindows,
 	free(calcBuffer);
 }
 
-void simpleComputePSM(int numChannels, float* data, float **buffer,
-		      float *centralFreq, int sampleRate, int dataLength,
-		      int startIndex, int interval, float scaleFactor,
-		      int sigWindowSize, int numWindows, float *sigmas,
-		      int correntropyWinSize, float **pooledSummaryMatrix)
+/* Row a holds the pairs (buffer[a], buffer[a+j]) for j = 1..correntropyWinSize
+ * and the window starting at i*interval is made of rows i*interval+1 through 
+ * i*interval+correntropyWinSize. The rows are grouped into blocks of interval 
+ * rows, so that window i is made of the q = correntropyWinSize/interval full 
+ * blocks i..i+q-1 and the first r = correntropyWinSize%interval rows of block 
+ * i+q. The squared differences of each block are computed once and then 
+ * evaluated with the sigma of every window that includes them. A block is 
+ * small enough to remain in the L1 cache while it's reused (caching all 
+ * correntropyWinSize^2 differences of a window does not fit and was measured 
+ * to be slower than pSMContribution).
+ */
+int pSMContributionIncremental(int correntropyWinSize, int interval,
+			       int numWindows, float *buffer, float *sigmas,
+			       float *pSMatrix)
+{
+	int b,i,j,a,q,r,blockRows,numRows,firstRow;
+	float *block, *sums, *row, x, diff;
+	psmCachedContribFunc calcPSMCachedContrib;
+
+	// use the fastest implementation supported by the CPU
+	calcPSMCachedContrib = psmCachedContribGet(psmSimdLevelDetect());
+	if (calcPSMCachedContrib == NULL){
+		// AVX2 without FMA
+		calcPSMCachedContrib = psmCachedContribGet(PSM_SIMD_SSE2);
+	}
+
+	q = correntropyWinSize/interval;
+	r = correntropyWinSize%interval;
+	// when interval > correntropyWinSize, the end of each block is unused
+	blockRows = (q > 0) ? interval : r;
+	block = malloc(sizeof(float)*blockRows*correntropyWinSize);
+	// each window is added to pSMatrix once, like in pSMContribution, so
+	// that the result doesn't depend on the initial values of pSMatrix
+	sums = calloc(numWindows, sizeof(float));
+	if ((block == NULL) || (sums == NULL)){
+		free(block);
+		free(sums);
+		return -1;
+	}
+
+	for (b=0;b<numWindows+q;b++){
+		// the last block is only the partial block of the last window,
+		// so it's limited to its first r rows (it's unused if r == 0)
+		numRows = (b == numWindows+q-1) ? r : blockRows;
+		if (numRows == 0){
+			continue;
+		}
+		firstRow = b*interval + 1;
+		for (a=0;a<numRows;a++){
+			row = block + a*correntropyWinSize;
+			x = buffer[firstRow+a];
+			for (j=1;j<=correntropyWinSize;j++){
+				diff = x - buffer[firstRow+a+j];
+				row[j-1] = diff*diff;
+			}
+		}
+
+		// block b is the partial block of window b-q and a full block
+		// of windows b-q+1 through b
+		for (i=b-q;i<=b;i++){
+			if ((i < 0) || (i >= numWindows) ||
+			    ((i == b-q) && (r == 0))){
+				continue;
+			}
+			// (M_SQRT1_2/sigma)^2, the scale used by pSMContribution
+			sums[i] += calcPSMCachedContrib(
+				block, ((i == b-q) ? r : interval)*correntropyWinSize,
+				0.5f/(sigmas[i]*sigmas[i]), sigmas[i]);
+		}
+	}
+	for (i=0;i<numWindows;i++){
+		pSMatrix[i] += sums[i];
+	}
+	free(block);
+	free(sums);
+	return 1;
+}
+
+void pSMContributionFGT(int correntropyWinSize, int interval,
+			int numWindows, float *buffer, float *sigmas,
+			struct fgtPSM *fgt, float *pSMatrix)
+{
+	int i,start = 0;
+	// the window size is fixed when fgt is allocated
+	(void)correntropyWinSize;
+	for (i=0;i<numWindows;i++){
+		// the same window as the one copied into pSMContribution's
+		// calcBuffer, but without the scaling
+		pSMatrix[i] += fgtPSMEntryContrib(fgt, buffer + start + 1,
+						  sigmas[i]);
+		start+=interval;
+	}
+}
+
+void pSMContributionHistogram(int correntropyWinSize, int interval,
+			      int numWindows, float *buffer, float *sigmas,
+			      struct histPSM *hist, float *pSMatrix)
+{
+	int i,start = 0;
+	// the window size is fixed when hist is allocated
+	(void)correntropyWinSize;
+	for (i=0;i<numWindows;i++){
+		pSMatrix[i] += histPSMEntryContrib(hist, buffer + start + 1,
+						   sigmas[i]);
+		start+=interval;
+	}
+}
+
+/* The work arrays of the approximate methods. Every thread that computes 
+ * channel contributions needs its own. */
+struct psmWorkspace{
+	struct fgtPSM *fgt;
+	struct histPSM *hist;
+};
+
+/* Allocates the work arrays needed by the method selected by settings. 
+ * Returns 1 on success and -1 if an allocation fails (in which case nothing 
+ * needs to be freed). */
+static int psmWorkspaceInit(struct psmWorkspace *workspace,
+			    const struct detFuncSettings *settings,
+			    int correntropyWinSize)
+{
+	workspace->fgt = NULL;
+	workspace->hist = NULL;
+	if (settings->psmMethod == PSM_FGT){
+		workspace->fgt = fgtPSMNew(correntropyWinSize,
+					   settings->fgtCenters,
+					   settings->fgtOrder);
+		if (workspace->fgt == NULL){
+			return -1;
+		}
+	} else if (settings->psmMethod == PSM_HISTOGRAM){
+		workspace->hist = histPSMNew(correntropyWinSize,
+					     settings->histBins);
+		if (workspace->hist == NULL){
+			return -1;
+		}
+	}
+	return 1;
+}
+
+static void psmWorkspaceFree(struct psmWorkspace *workspace)
+{
+	if (workspace->fgt != NULL){
+		fgtPSMDestroy(workspace->fgt);
+	}
+	if (workspace->hist != NULL){
+		histPSMDestroy(workspace->hist);
+	}
+}
+
+/* Adds the contribution of a channel to pSMatrix with the method selected by 
+ * settings. Returns 1 on success and -1 if an allocation fails. */
+static int channelContribution(const struct detFuncSettings *settings,
+				struct psmWorkspace *workspace,
+				int correntropyWinSize, int interval,
+				int numWindows, float *buffer, float *sigmas,
+				float *pSMatrix)
+{
+	switch(settings->psmMethod){
+	case PSM_INCREMENTAL:
+		return pSMContributionIncremental(correntropyWinSize,
+						  interval, numWindows, buffer,
+						  sigmas, pSMatrix);
+	case PSM_FGT:
+		pSMContributionFGT(correntropyWinSize, interval, numWindows,
+				   buffer, sigmas, workspace->fgt, pSMatrix);
+		break;
+	case PSM_HISTOGRAM:
+		pSMContributionHistogram(correntropyWinSize, interval,
+					 numWindows, buffer, sigmas,
+					 workspace->hist, pSMatrix);
+		break;
+	default:
+		pSMContributionPrecision(correntropyWinSize, interval,
+					 numWindows, buffer, sigmas,
+					 settings->expPrecision, pSMatrix);
+		break;
+	}
+	return 1;
+}
+
+/* Computes the coefficients of every channel of the filterbank (24 entries 
+ * per channel, see sosCoeff and apgfCoeff). Returns NULL if the allocation 
+ * fails. */
+static float* filterBankCoef(int numChannels, float *centralFreq,
+			     int sampleRate,
+			     enum gammatoneFilterType filterType)
+{
+	float *coef = calloc(24 * numChannels, sizeof(float));
+	if (coef == NULL){
+		return NULL;
+	}
+	for (int i = 0; i < numChannels; i++){
+		if (filterType == GAMMATONE_SOS){
+			sosCoeff(centralFreq[i], sampleRate, coef + 24*i);
+		} else {
+			apgfCoeff(centralFreq[i], sampleRate,
+				  (filterType == GAMMATONE_OZGF),
+				  coef + 24*i);
+		}
+	}
+	return coef;
+}
+
+/* buffers holds lanes rows of bufferLength entries (the number of channels 
+ * filtered at once by the gammatone filterbank implementation). Returns 1 on 
+ * success and -1 on failure. */
+int simpleComputePSM(int numChannels, float* data, float *buffers,
+		      int bufferLength, int lanes, float *coef,
+		      gammatoneBankFunc filterBank, int dataLength, int startIndex, int interval,
+		      float scaleFactor, int sigWindowSize, int numWindows,
+		      float *sigmas, int correntropyWinSize,
+		      const struct detFuncSettings *settings,
+		      struct psmWorkspace *workspace,
+		      float **pooledSummaryMatrix)
 {
 	float averageTime = 0.0f;
-	for (int i = 0;i<numChannels;i++){
+	float *outputs[GAMMATONE_MAX_LANES];
+	int groupSize;
+
+	for (int l = 0; l < lanes; l++){
+		outputs[l] = buffers + (long)l * bufferLength;
+	}
+
+	for (int first = 0; first<numChannels; first+=lanes){
+		groupSize = numChannels - first;
+		if (groupSize > lanes){
+			groupSize = lanes;
+		}
 		clock_t c1 = clock();
 
-		//printf("compute channel %d...\n", i);
-		//sosGammatone(data, *buffer, centralFreq[i], sampleRate,
-		//	       dataLength);
-		sosGammatoneFast(data, *buffer, centralFreq[i], sampleRate,
-			       dataLength);
+		/* filter the group of channels at once */
+		filterBank(data, dataLength, groupSize, coef + 24*first,
+			   outputs);
 
 		clock_t c2 = clock();
+		float elapsed1 = ((float)(c2-c1))/CLOCKS_PER_SEC/groupSize;
+
+		for (int l = 0; l < groupSize; l++){
+			clock_t c3 = clock();
+			/* compute the sigma values */
+			rollSigma(startIndex, interval, scaleFactor,
+				  sigWindowSize, dataLength, numWindows,
+				  outputs[l], sigmas);
+
+			clock_t c4 = clock();
+
+			/* compute the pooledSummaryMatrixValues */
+			if (channelContribution(settings, workspace,
+						correntropyWinSize, interval,
+						numWindows, outputs[l], sigmas,
+						*pooledSummaryMatrix) != 1){
+				return -1;
+			}
 
-		//printf("   gammatone %d...\n", i);
-		/* compute the sigma values */
-		rollSigma(startIndex, interval, scaleFactor, sigWindowSize,
-			  dataLength, numWindows, *buffer, sigmas);
-		//printf("   sigma %d...\n", i);
-
-		clock_t c3 = clock();
-
-		/* compute the pooledSummaryMatrixValues */
-		pSMContribution(correntropyWinSize, interval, numWindows,
-				*buffer, sigmas, *pooledSummaryMatrix);
-		//printf("   matrix %d...\n", i);
-		
-		clock_t c4 = clock();
-		float elapsed = ((float)(c4-c1))/CLOCKS_PER_SEC;
-		float elapsed1 = ((float)(c2-c1))/CLOCKS_PER_SEC;
-		float elapsed2 = ((float)(c3-c2))/CLOCKS_PER_SEC;
-		float elapsed3 = ((float)(c4-c3))/CLOCKS_PER_SEC;
-		printf("  %d\telapsed = %0.5f,  (%0.5f,  %0.5f,  %0.5f)\n", i, elapsed*1000, elapsed1*1000, elapsed2*1000, elapsed3*1000);
-		averageTime += elapsed;
+			clock_t c5 = clock();
+			float elapsed2 = ((float)(c4-c3))/CLOCKS_PER_SEC;
+			float elapsed3 = ((float)(c5-c4))/CLOCKS_PER_SEC;
+			float elapsed = elapsed1 + elapsed2 + elapsed3;
+			printf("  %d\telapsed = %0.5f,  (%0.5f,  %0.5f,  %0.5f)\n",
+			       first + l, elapsed*1000, elapsed1*1000,
+			       elapsed2*1000, elapsed3*1000);
+			averageTime += elapsed;
+		}
 	}
 	printf("  average time: %f\n", (averageTime*1000) / numChannels);
+	return 1;
+}
+
+/* The following is used to compute the pooled summary matrix with a pool of 
+ * worker threads. Workers claim groups of groupSize channels from 
+ * nextChannel. Each worker filters the group into its own buffers (one 
+ * channel per vector lane) and writes each channel's contribution into its 
+ * own row of channelContribs. The rows are summed in channel order once all 
+ * workers finish.
+ */
+struct psmWorkQueue{
+	int numChannels;
+	int groupSize;
+	float *data;
+	float *coef;
+	gammatoneBankFunc filterBank;
+	int dataLength;
+	int bufferLength;
+	int startIndex;
+	int interval;
+	float scaleFactor;
+	int sigWindowSize;
+	int numWindows;
+	int correntropyWinSize;
+	const struct detFuncSettings *settings;
+	float *channelContribs; /* numChannels rows of numWindows entries */
+
+	pthread_mutex_t lock;
+	int nextChannel;
+	int failed; /* set when a contribution can't be computed */
+};
+
+static void* psmWorker(void *arg)
+{
+	struct psmWorkQueue *q = arg;
+	float *buffers, *sigmas, *outputs[GAMMATONE_MAX_LANES];
+	struct psmWorkspace workspace;
+	int i, l, channel, groupSize, failed;
+
+	if (psmWorkspaceInit(&workspace, q->settings,
+			     q->correntropyWinSize) != 1){
+		/* the other workers will process the channels */
+		return NULL;
+	}
+	buffers = malloc(sizeof(float)*q->bufferLength*q->groupSize);
+	sigmas = malloc(sizeof(float)*q->numWindows);
+	if ((buffers == NULL) || (sigmas == NULL)){
+		/* the other workers will process the channels */
+		free(buffers);
+		free(sigmas);
+		psmWorkspaceFree(&workspace);
+		return NULL;
+	}
+	/* see detFunctionCalculation for why the end is zero padded */
+	for (l = 0; l < q->groupSize; l++){
+		outputs[l] = buffers + (long)l * q->bufferLength;
+		for (i = q->dataLength; i<q->bufferLength; i++){
+			outputs[l][i] = 0;
+		}
+	}
+
+	while (1){
+		pthread_mutex_lock(&(q->lock));
+		channel = q->nextChannel;
+		(q->nextChannel) += q->groupSize;
+		failed = q->failed;
+		pthread_mutex_unlock(&(q->lock));
+		if ((channel >= q->numChannels) || failed){
+			break;
+		}
+		groupSize = q->numChannels - channel;
+		if (groupSize > q->groupSize){
+			groupSize = q->groupSize;
+		}
+
+		q->filterBank(q->data, q->dataLength, groupSize,
+			      q->coef + 24*channel, outputs);
+		for (l = 0; l < groupSize; l++){
+			rollSigma(q->startIndex, q->interval, q->scaleFactor,
+				  q->sigWindowSize, q->dataLength,
+				  q->numWindows, outputs[l], sigmas);
+			if (channelContribution(q->settings, &workspace,
+						q->correntropyWinSize,
+						q->interval, q->numWindows,
+						outputs[l], sigmas,
+						q->channelContribs +
+						((long)(channel + l) *
+						 q->numWindows)) != 1){
+				pthread_mutex_lock(&(q->lock));
+				q->failed = 1;
+				pthread_mutex_unlock(&(q->lock));
+				break;
+			}
+		}
+	}
+
+	free(buffers);
+	free(sigmas);
+	psmWorkspaceFree(&workspace);
+	return NULL;
+}
+
+/* Multithreaded counterpart of simpleComputePSM. The calling thread acts as 
+ * one of the numThreads workers. Returns 1 on success and -1 on failure.
+ */
+int parallelComputePSM(int numThreads, int numChannels, float* data,
+		       int bufferLength, int lanes, float *coef,
+		       gammatoneBankFunc filterBank, int dataLength, int startIndex, int interval,
+		       float scaleFactor, int sigWindowSize, int numWindows,
+		       int correntropyWinSize,
+		       const struct detFuncSettings *settings,
+		       float *pooledSummaryMatrix)
+{
+	struct psmWorkQueue q;
+	pthread_t *threads;
+	int i, channel, numLaunched;
+	float *row;
+
+	if (numThreads > numChannels){
+		numThreads = numChannels;
+	}
+
+	/* Filtering a full group of lanes costs about as much as filtering a 
+	 * single channel, but most of the time is spent on the correntropy. 
+	 * Shrink the groups so that every thread still gets channels. */
+	q.groupSize = numChannels / numThreads;
+	if (q.groupSize > lanes){
+		q.groupSize = lanes;
+	} else if (q.groupSize < 1){
+		q.groupSize = 1;
+	}
+
+	q.numChannels = numChannels;
+	q.data = data;
+	q.coef = coef;
+	q.filterBank = filterBank;
+	q.dataLength = dataLength;
+	q.bufferLength = bufferLength;
+	q.startIndex = startIndex;
+	q.interval = interval;
+	q.scaleFactor = scaleFactor;
+	q.sigWindowSize = sigWindowSize;
+	q.numWindows = numWindows;
+	q.correntropyWinSize = correntropyWinSize;
+	q.settings = settings;
+	q.nextChannel = 0;
+	q.failed = 0;
+	q.channelContribs = calloc((long)numChannels * numWindows,
+				   sizeof(float));
+	if (q.channelContribs == NULL){
+		return -1;
+	}
+	threads = malloc(sizeof(pthread_t) * numThreads);
+	if (threads == NULL){
+		free(q.channelContribs);
+		return -1;
+	}
+	pthread_mutex_init(&(q.lock), NULL);
+
+	/* if a thread can't be created, the remaining workers just process 
+	 * more channels */
+	numLaunched = 0;
+	for (i = 1; i < numThreads; i++){
+		if (pthread_create(threads + numLaunched, NULL, &psmWorker,
+				   &q) == 0){
+			numLaunched++;
+		}
+	}
+	psmWorker(&q);
+	for (i = 0; i < numLaunched; i++){
+		pthread_join(threads[i], NULL);
+	}
+	pthread_mutex_destroy(&(q.lock));
+	free(threads);
+
+	if ((q.nextChannel < numChannels) || q.failed){
+		/* every worker failed to allocate its buffers or a worker 
+		 * failed to compute a contribution */
+		free(q.channelContribs);
+		return -1;
+	}
+
+	/* Reduce in a fixed order so that the result does not depend on 
+	 * numThreads (or on which worker processed which channel) */
+	for (channel = 0; channel < numChannels; channel++){
+		row = q.channelContribs + ((long)channel * numWindows);
+		for (i = 0; i < numWindows; i++){
+			pooledSummaryMatrix[i] += row[i];
+		}
+	}
+	free(q.channelContribs);
+	return 1;
 }
 
 int computeNumWindows(int dataLength, int correntropyWinSize, int interval)
@@ -365,15 +658,73 @@ int computeDetFunctionLength(int dataLength, int correntropyWinSize,
 	return computeNumWindows(dataLength, correntropyWinSize, interval) - 1;
 }
 
+void detFuncSettingsInit(struct detFuncSettings *settings)
+{
+	settings->numThreads = 1;
+	settings->filterType = GAMMATONE_SOS;
+	settings->psmMethod = PSM_DIRECT;
+	settings->fgtCenters = 32;
+	settings->fgtOrder = 3;
+	settings->histBins = 128;
+	settings->expPrecision = EXP_PRECISION_SCHRAUDOLPH;
+}
+
 int simpleDetFunctionCalculation(int correntropyWinSize, int interval,
 				 float scaleFactor, int sigWindowSize,
 				 int numChannels, float minFreq, float maxFreq,
 				 int sampleRate, int dataLength, float* data,
 				 int detFunctionLength, float* detFunction)
 {
+	return detFunctionCalculation(correntropyWinSize, interval,
+				      scaleFactor, sigWindowSize, numChannels,
+				      minFreq, maxFreq, sampleRate, dataLength,
+				      data, detFunctionLength, detFunction,
+				      NULL);
+}
 
-	int dFLength,numWindows,bufferLength,i,startIndex;
-	float *pooledSummaryMatrix, *sigmas, *centralFreq, *buffer;
+int detFunctionCalculation(int correntropyWinSize, int interval,
+			   float scaleFactor, int sigWindowSize,
+			   int numChannels, float minFreq, float maxFreq,
+			   int sampleRate, int dataLength, float* data,
+			   int detFunctionLength, float* detFunction,
+			   const struct detFuncSettings *settings)
+{
+
+	int numWindows,bufferLength,i,startIndex,lanes,status;
+	float *pooledSummaryMatrix, *sigmas, *centralFreq, *buffers, *coef;
+	float *filterInput;
+	gammatoneBankFunc filterBank;
+	struct psmWorkspace workspace;
+	enum psmSimdLevel simdLevel;
+	struct detFuncSettings defaultSettings;
+
+	if (settings == NULL){
+		detFuncSettingsInit(&defaultSettings);
+		settings = &defaultSettings;
+	}
+	if ((settings->psmMethod < PSM_DIRECT) ||
+	    (settings->psmMethod > PSM_HISTOGRAM)){
+		return -1;
+	}
+	if ((settings->psmMethod == PSM_FGT) &&
+	    ((settings->fgtCenters < 1) || (settings->fgtOrder < 1) ||
+	     (settings->fgtOrder > FGT_MAX_ORDER))){
+		return -1;
+	}
+	if ((settings->psmMethod == PSM_HISTOGRAM) &&
+	    (settings->histBins < 1)){
+		return -1;
+	}
+	if ((settings->expPrecision < EXP_PRECISION_SCHRAUDOLPH) ||
+	    (settings->expPrecision > EXP_PRECISION_ACCURATE)){
+		return -1;
+	}
+	// the cached kernels of PSM_INCREMENTAL only implement
+	// EXP_PRECISION_SCHRAUDOLPH (see psmCachedContribGet)
+	if ((settings->psmMethod == PSM_INCREMENTAL) &&
+	    (settings->expPrecision != EXP_PRECISION_SCHRAUDOLPH)){
+		return -1;
+	}
 
 	numWindows = computeNumWindows(dataLength, correntropyWinSize,
 				       interval);
@@ -395,35 +746,111 @@ int simpleDetFunctionCalculation(int correntropyWinSize, int interval,
 	// signal has values of 0 at these locations).
 	bufferLength = (numWindows-1)*interval + 2*correntropyWinSize + 2;
 	printf("bufferLength: %d\n",bufferLength);
-	buffer = malloc(sizeof(float)*bufferLength);
-	for (i = dataLength; i<bufferLength;i++){
-		buffer[i] = 0;
-	}
 
 	pooledSummaryMatrix = malloc(sizeof(float)*numWindows);
 	for (i=0;i<numWindows;i++){
 		pooledSummaryMatrix[i] = 0;
 	}
-	sigmas = malloc(sizeof(float)*numWindows);
 
 	centralFreq = malloc(sizeof(float)*numChannels);
 	centralFreqMapper(numChannels, minFreq, maxFreq, centralFreq);
+	coef = filterBankCoef(numChannels, centralFreq, sampleRate,
+			      settings->filterType);
+	free(centralFreq);
+	if (coef == NULL){
+		free(pooledSummaryMatrix);
+		return -1;
+	}
+
+	// The zero of the OZGF is the same for every channel, so it is applied
+	// to the input once (as a first difference) rather than per channel
+	filterInput = data;
+	if (settings->filterType == GAMMATONE_OZGF){
+		filterInput = malloc(sizeof(float)*dataLength);
+		if (filterInput == NULL){
+			free(pooledSummaryMatrix);
+			free(coef);
+			return -1;
+		}
+		if (dataLength > 0){
+			filterInput[0] = data[0];
+		}
+		for (i = 1; i < dataLength; i++){
+			filterInput[i] = data[i] - data[i-1];
+		}
+	}
 
 	startIndex = correntropyWinSize/2;
 
-	simpleComputePSM(numChannels, data, &buffer, centralFreq, sampleRate, 
-			 dataLength, startIndex, interval, scaleFactor, 
-			 sigWindowSize, numWindows, sigmas,
-			 correntropyWinSize, 
-			 &pooledSummaryMatrix);
+	// the number of channels that the gammatone filterbank processes at once
+	simdLevel = psmSimdLevelDetect();
+	lanes = gammatoneBankLanes(simdLevel);
+	filterBank = gammatoneBankGet(simdLevel, settings->filterType);
+
+	if (settings->numThreads > 1){
+		// each worker thread allocates its own buffers and sigmas
+		if (parallelComputePSM(settings->numThreads, numChannels,
+				       filterInput, bufferLength, lanes, coef,
+				       filterBank, dataLength, startIndex,
+				       interval, scaleFactor, sigWindowSize,
+				       numWindows, correntropyWinSize,
+				       settings, pooledSummaryMatrix) != 1){
+			if (filterInput != data){
+				free(filterInput);
+			}
+			free(pooledSummaryMatrix);
+			free(coef);
+			return -1;
+		}
+	} else {
+		buffers = malloc(sizeof(float)*bufferLength*lanes);
+		for (int l = 0; l < lanes; l++){
+			for (i = dataLength; i<bufferLength;i++){
+				buffers[(long)l*bufferLength + i] = 0;
+			}
+		}
+		sigmas = malloc(sizeof(float)*numWindows);
+		if (psmWorkspaceInit(&workspace, settings,
+				     correntropyWinSize) != 1){
+			if (filterInput != data){
+				free(filterInput);
+			}
+			free(sigmas);
+			free(buffers);
+			free(pooledSummaryMatrix);
+			free(coef);
+			return -1;
+		}
+
+		status = simpleComputePSM(numChannels, filterInput, buffers,
+					  bufferLength, lanes, coef,
+					  filterBank, dataLength, startIndex,
+					  interval, scaleFactor, sigWindowSize,
+					  numWindows, sigmas,
+					  correntropyWinSize, settings,
+					  &workspace, &pooledSummaryMatrix);
+
+		psmWorkspaceFree(&workspace);
+		free(sigmas);
+		free(buffers);
+		if (status != 1){
+			if (filterInput != data){
+				free(filterInput);
+			}
+			free(pooledSummaryMatrix);
+			free(coef);
+			return -1;
+		}
+	}
+	if (filterInput != data){
+		free(filterInput);
+	}
 
-	free(sigmas);
-	free(buffer);
 	for (i = 0; i<detFunctionLength; i++){
 		detFunction[i] = (pooledSummaryMatrix[i+1]
 				  - pooledSummaryMatrix[i]);
 	}
 	free(pooledSummaryMatrix);
-	free(centralFreq);
+	free(coef);
 	return 1;
 }
@@ -1,3 +1,71 @@
+#ifndef SIMPLEDETFUNC_H
+#define SIMPLEDETFUNC_H
+
+#include "gammatoneFilter.h"
+#include "fastGaussTransform.h"
+#include "histogramPSM.h"
+#include "fastExp.h"
+
+/// The methods that can be used to compute the contribution of a channel to
+/// the pooled summary matrix
+enum psmMethod{
+	/// Every window is evaluated from scratch (see pSMContribution)
+	PSM_DIRECT = 0,
+	/// The squared differences are shared between overlapping windows (see
+	/// pSMContributionIncremental)
+	PSM_INCREMENTAL = 1,
+	/// Every window is approximated with the Fast Gauss Transform (see
+	/// pSMContributionFGT)
+	PSM_FGT = 2,
+	/// Every window is approximated from a histogram of its samples (see
+	/// pSMContributionHistogram)
+	PSM_HISTOGRAM = 3
+};
+
+/// Settings that control how the detection function is computed, but which
+/// are not parameters of the method described in the paper
+struct detFuncSettings{
+	/// The number of threads used to process the channels of the
+	/// filterbank. Values smaller than 2 indicate that the channels are
+	/// processed serially on the calling thread.
+	int numThreads;
+
+	/// The IIR approximation of the gammatone filter used by the
+	/// filterbank. The default is GAMMATONE_SOS. GAMMATONE_APGF and
+	/// GAMMATONE_OZGF filter the channels with about half of the arithmetic,
+	/// at the cost of a detection function that deviates from the one
+	/// computed with GAMMATONE_SOS (see apGammatone and ozGammatone).
+	enum gammatoneFilterType filterType;
+
+	/// The method used to compute the pooled summary matrix. The default is
+	/// PSM_DIRECT. PSM_INCREMENTAL is faster, but the result is not bitwise
+	/// identical to PSM_DIRECT (see pSMContributionIncremental). PSM_FGT
+	/// is only faster for large correntropy windows (see pSMContributionFGT).
+	/// PSM_HISTOGRAM has an error comparable to PSM_DIRECT and is faster for
+	/// large correntropy windows (see pSMContributionHistogram).
+	enum psmMethod psmMethod;
+
+	/// The number of boxes and the order of the Hermite expansion used by
+	/// PSM_FGT (see fgtPSMNew). The defaults are 32 and 3.
+	int fgtCenters;
+	int fgtOrder;
+
+	/// The number of bins used by PSM_HISTOGRAM (see histPSMNew). The
+	/// default is 128.
+	int histBins;
+
+	/// The approximation of the gaussian used by PSM_DIRECT (see
+	/// fastExp.h). The default is EXP_PRECISION_SCHRAUDOLPH. With AVX2,
+	/// EXP_PRECISION_POLY3 takes ~2x as long and EXP_PRECISION_ACCURATE
+	/// ~3.5x as long. PSM_INCREMENTAL only supports
+	/// EXP_PRECISION_SCHRAUDOLPH; detFunctionCalculation fails for any other
+	/// value.
+	enum expPrecision expPrecision;
+};
+
+/// Initializes settings with the default values
+void detFuncSettingsInit(struct detFuncSettings *settings);
+
 /// A quick and dirty implementation of detection function calculation
 ///
 /// The implementation is not memory efficient and sigma optimization can
@@ -58,6 +126,28 @@ int simpleDetFunctionCalculation(int correntropyWinSize, int interval,
 				 int sampleRate, int dataLength, float* data,
 				 int detFunctionLength, float* detFunction);
 
+/// Identical to simpleDetFunctionCalculation except that it also accepts
+/// settings, which control how the calculation is carried out
+///
+/// @param[in] settings Controls how the calculation is carried out. If this is
+///            NULL, then the default settings are used.
+///
+/// @return Returns 1 for success and -1 for failure.
+///
+/// @par Note:
+/// When `settings->numThreads > 1`, the contribution of every channel to the
+/// pooled summary matrix is computed by a pool of worker threads, each with its
+/// own filter buffer and sigma array. The contributions are then summed in
+/// order of increasing channel index, so that the result is bitwise identical
+/// to the serial calculation regardless of the number of threads. This
+/// requires an additional `numChannels` floats for every window.
+int detFunctionCalculation(int correntropyWinSize, int interval,
+			   float scaleFactor, int sigWindowSize,
+			   int numChannels, float minFreq, float maxFreq,
+			   int sampleRate, int dataLength, float* data,
+			   int detFunctionLength, float* detFunction,
+			   const struct detFuncSettings *settings);
+
 /// Computes the length of the resulting detection function
 int computeDetFunctionLength(int dataLength, int correntropyWinSize,
 			     int interval);
@@ -95,7 +185,8 @@ int computeDetFunctionLength(int dataLength, int correntropyWinSize,
 ///
 /// @par
 /// The current implementation allows the center of the window to extend past
-/// the end of the array.
+/// the end of the array. Windows holding fewer than 2 values have a sigma of
+/// 0.
 ///
 /// @par
 /// For a window centered at index `i`, the final element included in the 
@@ -106,7 +197,10 @@ int computeDetFunctionLength(int dataLength, int correntropyWinSize,
 ///
 /// @par
 /// The current implementation casts the single precision input data to double
-/// precision during the calculation and then casts back at the end.
+/// precision during the calculation and then casts back at the end. The sums
+/// of the values and of their squares are updated once per output, with the
+/// blocks of values that enter and leave the window over the interval, so no
+/// work is done at the indices between outputs and nothing is allocated.
 ///
 /// @par General Note:
 /// In general, rollSigma with Silverman's rule of thumb is optimized to be
@@ -152,3 +246,75 @@ void rollSigma(int startIndex, int interval, float scaleFactor,
 /// channels).
 void pSMContribution(int correntropyWinSize, int interval, int numWindows,
 		     float *buffer, float *sigmas, float *pSMatrix);
+
+/// Identical to pSMContribution, except that the gaussian is evaluated with
+/// the given precision (pSMContribution uses EXP_PRECISION_SCHRAUDOLPH)
+void pSMContributionPrecision(int correntropyWinSize, int interval,
+			      int numWindows, float *buffer, float *sigmas,
+			      enum expPrecision precision, float *pSMatrix);
+
+/// Identical to pSMContribution, except that the squared differences of the
+/// pairs are shared between overlapping windows
+///
+/// Consecutive windows share `correntropyWinSize - interval` of their
+/// `correntropyWinSize` rows of pairs (the pairs with a common first sample).
+/// The unscaled squared differences are computed one hop (`interval` rows) at
+/// a time, and every window that includes those rows evaluates the kernel on
+/// them, scaled by its own `1/(2*sigma^2)`. Thus each difference is computed
+/// once rather than in every window that includes it, and the windows are no
+/// longer rescaled by sigma.
+///
+/// @par Note:
+/// Because sigma changes from window to window and the gaussian of a scaled
+/// argument can't be factored out of a sum, the kernel itself must still be
+/// evaluated for all `correntropyWinSize^2` pairs of every window. The kernel
+/// arithmetic is rounded slightly differently than in pSMContribution (see
+/// psmCachedContribGet), which changes the contributions by ~1e-5 relative
+/// error. This allocates `min(interval,correntropyWinSize)*correntropyWinSize
+/// + numWindows` floats. The kernel is always evaluated with
+/// EXP_PRECISION_SCHRAUDOLPH.
+///
+/// @return Returns 1 for success and -1 if the allocation fails (in which case
+///         pSMatrix is left unmodified).
+int pSMContributionIncremental(int correntropyWinSize, int interval,
+			       int numWindows, float *buffer, float *sigmas,
+			       float *pSMatrix);
+
+/// Identical to pSMContribution, except that every window is approximated
+/// with the Fast Gauss Transform (see fgtPSMEntryContrib)
+///
+/// @param[in] fgt The work arrays and accuracy parameters. It must have been
+///            allocated with a winSize of correntropyWinSize.
+///
+/// @par Note:
+/// The cost of a window grows as `correntropyWinSize*fgtCenters*fgtOrder`
+/// rather than as `correntropyWinSize^2`. With the default settings, this
+/// is slower than pSMContribution for the windows used by the TransientAlg
+/// onset strategy (correntropyWinSize = 137 at 11025 Hz), and it becomes
+/// faster for windows of a few hundred samples. Windows whose samples are
+/// spread over too many multiples of sigma are evaluated directly.
+void pSMContributionFGT(int correntropyWinSize, int interval,
+			int numWindows, float *buffer, float *sigmas,
+			struct fgtPSM *fgt, float *pSMatrix);
+
+/// Identical to pSMContribution, except that every window is approximated
+/// from a histogram of its samples (see histPSMEntryContrib for the error
+/// bound)
+///
+/// @param[in] hist The work arrays and the number of bins. It must have been
+///            allocated with a winSize of correntropyWinSize.
+///
+/// @par Note:
+/// The error and the cost of a window are controlled by histBins. For the
+/// windows used by the TransientAlg onset strategy (correntropyWinSize = 137
+/// at 11025 Hz) and the default of 128 bins, a window takes about as long as
+/// with pSMContribution and the error is of the same order (a few 1e-3
+/// relative to the exact sum). Halving histBins makes it ~1.3x faster, but
+/// the error doubles. The cost grows as `correntropyWinSize*histBins`
+/// rather than as `correntropyWinSize^2`, so the speedup grows with the
+/// window size (~4x at correntropyWinSize = 551).
+void pSMContributionHistogram(int correntropyWinSize, int interval,
+			      int numWindows, float *buffer, float *sigmas,
+			      struct histPSM *hist, float *pSMatrix);
+
+#endif /* SIMPLEDETFUNC_H */
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <pthread.h>
 #include "findpeaks.h"
 #include "findCandidates.h"
 #include "candidateSelection.h"
@@ -15,14 +16,15 @@
 
 int BaNa(float **AudioData, int size, int dftBlocksize, int p,
 	 float f0Min, float f0Max, float xi, int fftSize, int samplerate,
-	 int first, float *fundamentals)
+	 int first, int numThreads, float *fundamentals)
 {
 	// Implements the BaNa fundamental pitch detection algorithm
 	// This algorithm is split into 3 parts:
 
 	// 1. Preprocessing
 	//    - mask all frequencies outside of [f0Min, p * f0Max]
-	// 2. Determination of F0 candidates. For each frame:
+	// 2. Determination of F0 candidates (the frames are processed by
+	//    numThreads threads). For each frame:
 	//    a. Retrieve p harmonic peaks - for ordinary BaNa algorithm, these
 	//       are the p peaks with lowest frequencies
 	//    b. Calculate F0 candidates from harmonic peaks
@@ -50,10 +52,16 @@ int BaNa(float **AudioData, int size, int dftBlocksize, int p,
 	// find the candidates for the fundamentals
 	windowCandidates = BaNaFindCandidates(AudioData, size, dftBlocksize,
 					      p, f0Min, f0Max, first, xi,
-					      frequencies, fftSize, samplerate);
+					      frequencies, fftSize, samplerate,
+					      numThreads);
+	if(windowCandidates == NULL){
+		free(frequencies);
+		return 0;
+	}
 
 	// determine which candidate is the fundamental
-	candidateSelection(windowCandidates, numBlocks, fundamentals);
+	int result = candidateSelection(windowCandidates, numBlocks,
+					fundamentals);
 
 	// clean up
 	for (i=0;i<numBlocks;i++){
@@ -62,7 +70,7 @@ int BaNa(float **AudioData, int size, int dftBlocksize, int p,
 	free(windowCandidates);
 	free(frequencies);
 
-	return 1;
+	return result;
 }
 
 float* calcFrequencies(int dftBlocksize, int fftSize, int samplerate)
@@ -108,120 +116,210 @@ void BaNaPreprocessing(float **AudioData, int size, int dftBlocksize, int p,
 	}
 }
 
+/* Blocks are handed out to the workers of BaNaFindCandidates in chunks of
+ * this many blocks, to limit contention on the queue's lock */
+#define BANA_BLOCKS_PER_CLAIM 16
+
+struct candidateWorkQueue{
+	float *audioData;
+	int numBlocks;
+	int dftBlocksize;
+	int p;
+	float f0Min;
+	float f0Max;
+	int first;
+	float xi;
+	float *frequencies;
+	int fftSize;
+	int samplerate;
+	distinctList **windowCandidates;
+
+	pthread_mutex_t lock;
+	int nextBlock;
+};
+
+/* Finds the candidates of a single block. peakFreq and peakMag are scratch
+ * buffers of p entries, ws is a findpeaks workspace for dftBlocksize
+ * entries and p peaks and candidates holds a buffer with a capacity of
+ * calcCandidatesCapacity(p). Returns NULL if memory can't be allocated. */
+static distinctList* blockCandidates(struct candidateWorkQueue *q, int block,
+				     struct findpeaksWorkspace *ws,
+				     float *peakFreq, float *peakMag,
+				     struct orderedList *candidates)
+{
+	int i;
+	int numPeaks;
+	float temp, firstFreqPeak, ampThreshold, smoothwidth;
+	float *magnitudes = q->audioData + (long)block * q->dftBlocksize;
+
+	// determine slopeThreshold, ampThreshold, smoothwidth
+	// set ampThreshold to 1/15 th of largest magnitude
+	ampThreshold = magnitudes[0];
+	for (i=1; i < q->dftBlocksize; i++){
+		temp = magnitudes[i];
+		if (temp>ampThreshold) {
+			ampThreshold = temp;
+		}
+	}
+	ampThreshold/=15.;
+
+	// set smoothwidth to the equivalent of 50 Hz
+	smoothwidth = 50. * ((float) q->fftSize) / ((float) q->samplerate);
+
+	// find the harmonic spectra peaks
+	numPeaks = findpeaks(q->frequencies, magnitudes,
+			     (long)q->dftBlocksize, 0.0,
+			     ampThreshold, smoothwidth, 5, 3,
+			     q->p, q->first, peakFreq, peakMag,
+			     &firstFreqPeak, ws);
+
+	// determine the candidates from the peaks and add the lowest
+	// frequency peak fundamental candidate
+	calcCandidates(peakFreq, numPeaks, (float)firstFreqPeak, candidates);
+	// add the cepstrum fundamental candidate
+
+	// determine the distinctive candidates
+	return distinctCandidates(candidates, ((numPeaks)*(numPeaks-1)/2)+2,
+				  q->xi,(float)q->f0Min, (float)q->f0Max);
+}
+
+static void* candidateWorker(void *arg)
+{
+	struct candidateWorkQueue *q = arg;
+	struct findpeaksWorkspace *ws;
+	float *peakFreq, *peakMag;
+	struct orderedList candidates;
+	int block, stop;
+
+	ws = findpeaksWorkspaceNew(q->dftBlocksize, q->p);
+	peakFreq = malloc(q->p * sizeof(float));
+	peakMag = malloc(q->p * sizeof(float));
+	candidates = orderedListCreate(calcCandidatesCapacity(q->p));
+	if ((ws == NULL) || (peakFreq == NULL) || (peakMag == NULL) ||
+	    (candidates.array == NULL)){
+		/* the other workers will process the blocks */
+		findpeaksWorkspaceDestroy(ws);
+		free(peakFreq);
+		free(peakMag);
+		orderedListDestroy(candidates);
+		return NULL;
+	}
+
+	while (1){
+		pthread_mutex_lock(&(q->lock));
+		block = q->nextBlock;
+		q->nextBlock += BANA_BLOCKS_PER_CLAIM;
+		pthread_mutex_unlock(&(q->lock));
+		if (block >= q->numBlocks){
+			break;
+		}
+
+		stop = block + BANA_BLOCKS_PER_CLAIM;
+		if (stop > q->numBlocks){
+			stop = q->numBlocks;
+		}
+		for (; block < stop; block++){
+			q->windowCandidates[block] = blockCandidates(q, block,
+								     ws,
+								     peakFreq,
+								     peakMag,
+								     &candidates);
+		}
+	}
+
+	free(peakFreq);
+	free(peakMag);
+	orderedListDestroy(candidates);
+	findpeaksWorkspaceDestroy(ws);
+	return NULL;
+}
+
 distinctList** BaNaFindCandidates(float **AudioData, int size,
 				  int dftBlocksize, int p, float f0Min,
 				  float f0Max, int first, float xi,
 				  float* frequencies, int fftSize,
-				  int samplerate)
+				  int samplerate, int numThreads)
 {
 	// this finds all of the f0 candiates
 	// windowCandidates is an array of pointers that point to the list of
-	// candidates for each window
+	// candidates for each window.
+	//
+	// The candidates of each window only depend on that window, so the
+	// windows are distributed among numThreads workers (the calling thread
+	// acts as one of them). Each worker has its own scratch buffers.
 
-	int i;
+	int i, numLaunched;
 	int numBlocks = size / dftBlocksize;
-	int blockstart;
-	int numPeaks;
-	float temp, firstFreqPeak, ampThreshold, smoothwidth;
-	float *peakFreq, *peakMag;
-	float *magnitudes;
-	struct orderedList candidates;
-	distinctList **windowCandidates;
+	struct candidateWorkQueue q;
+	pthread_t *threads = NULL;
 
-	magnitudes = malloc(dftBlocksize * sizeof(float));
-	if(magnitudes == NULL){
+	q.audioData = *AudioData;
+	q.numBlocks = numBlocks;
+	q.dftBlocksize = dftBlocksize;
+	q.p = p;
+	q.f0Min = f0Min;
+	q.f0Max = f0Max;
+	q.first = first;
+	q.xi = xi;
+	q.frequencies = frequencies;
+	q.fftSize = fftSize;
+	q.samplerate = samplerate;
+	q.nextBlock = 0;
+	// the blocks that aren't processed (or whose candidates can't be
+	// allocated) are left as NULL
+	q.windowCandidates = calloc(numBlocks, sizeof(distinctList*));
+	if(q.windowCandidates == NULL){
 		printf("malloc error\n");
 		fflush(NULL);
 		return NULL;
 	}
-	peakFreq = malloc(p * sizeof(float));
-	if(peakFreq == NULL){
-		printf("malloc error\n");
-		fflush(NULL);
-		free(magnitudes);
-		return NULL;
+
+	// there is no point in launching more workers than there are claims
+	int maxThreads = (numBlocks + BANA_BLOCKS_PER_CLAIM - 1)
+		/ BANA_BLOCKS_PER_CLAIM;
+	if (numThreads > maxThreads){
+		numThreads = maxThreads;
 	}
-	peakMag = malloc(p * sizeof(float));
-	if(peakMag == NULL){
-		printf("malloc error\n");
-		fflush(NULL);
-		free(magnitudes);
-		free(peakFreq);
-		return NULL;
-	}
-	windowCandidates = malloc(sizeof(distinctList*) * numBlocks);
-	if(windowCandidates == NULL){
-		printf("malloc error\n");
-		fflush(NULL);
-		free(magnitudes);
-		free(peakFreq);
-		free(peakMag);
-		return NULL;
+	if (numThreads > 1){
+		threads = malloc(sizeof(pthread_t) * numThreads);
 	}
+	pthread_mutex_init(&(q.lock), NULL);
 
-	// outer loop iterates over blocks
-	for (blockstart = 0; blockstart < size; blockstart += dftBlocksize){
-
-		// for now copy the magnitudes into a buffer. Fix this in the
-		// future
-		for(i = 0; i < dftBlocksize; i++){
-			magnitudes[i] = (*AudioData)[blockstart + i];
+	/* if a thread can't be created, the remaining workers just process
+	 * more blocks */
+	numLaunched = 0;
+	for (i = 1; (threads != NULL) && (i < numThreads); i++){
+		if (pthread_create(threads + numLaunched, NULL,
+				   &candidateWorker, &q) == 0){
+			numLaunched++;
 		}
+	}
+	candidateWorker(&q);
+	for (i = 0; i < numLaunched; i++){
+		pthread_join(threads[i], NULL);
+	}
+	pthread_mutex_destroy(&(q.lock));
+	free(threads);
 
-		// determine slopeThreshold, ampThreshold, smoothwidth
-		// set ampThreshold to 1/15 th of largest magnitude
-		ampThreshold = magnitudes[0];
-		for (i=1; i < dftBlocksize; i++){
-			temp = magnitudes[i];
-			if (temp>ampThreshold) {
-				ampThreshold = temp;
+	/* every worker failed to allocate its buffers or the candidates of a
+	 * block couldn't be allocated */
+	for (i = 0; i < numBlocks; i++){
+		if (q.windowCandidates[i] == NULL){
+			break;
+		}
+	}
+	if (i < numBlocks){
+		printf("malloc error\n");
+		fflush(NULL);
+		for (i = 0; i < numBlocks; i++){
+			if (q.windowCandidates[i] != NULL){
+				distinctListDestroy(q.windowCandidates[i]);
 			}
 		}
-		ampThreshold/=15.;
-
-		// set smoothwidth to the equivalent of 50 Hz
-		smoothwidth = 50. * ((float) fftSize) / ((float) samplerate);
-
-		// find the harmonic spectra peaks
-		numPeaks = findpeaks(frequencies, magnitudes,
-				     (long)dftBlocksize, 0.0,
-				     ampThreshold, smoothwidth, 5, 3, 
-				     p, first, peakFreq, peakMag,
-				     &firstFreqPeak);
-		//printf("Candidates = [%.0lf",firstFreqPeak);
-		//for (int j =1; j<numPeaks;j++){
-		//	printf(", %.0lf",peakFreq[j]);
-		//}
-		//printf("]\n");
-		
-		//printf("Done finding peaks\n");
-		// determine the candidates from the peaks
-		candidates = calcCandidates(peakFreq, numPeaks);
-		//printf("Done finding candidates\n");
-		// add the lowest frequency peak fundamental candidate
-		orderedListInsert(&candidates, (float)firstFreqPeak);
-		//printf("Inserted lowest frequency candidate\n");
-		// add the cepstrum fundamental candidate
-
-		distinctList* t = distinctCandidates(&candidates,
-						     ((numPeaks)*
-						     (numPeaks-1)/2)+2,
-						     xi,(float)f0Min,
-						     (float)f0Max);
-		//distinctListPrintFreq(*t);
-		// determine the distinctive candidates and add them to
-		windowCandidates[blockstart/dftBlocksize] = t;
-		//windowCandidates[i] = distinctCandidates(&candidates,
-		//					 (p-1)*(p-1)+2, xi);
-
-		orderedListDestroy(candidates);
-
-		 
+		free(q.windowCandidates);
+		return NULL;
 	}
-	free(peakFreq);
-	free(peakMag);
-	free(magnitudes);
-	return windowCandidates;
+	return q.windowCandidates;
 }
 
 
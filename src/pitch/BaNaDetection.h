@@ -2,12 +2,13 @@
 // returns 1 on success
 int BaNa(float **AudioData, int size, int dftBlocksize, int p,
 	 float f0Min, float f0Max, float xi, int fftSize, int samplerate,
-	 int first, float* fundamentals);
+	 int first, int numThreads, float* fundamentals);
 float* calcFrequencies(int dftBlocksize, int fftSize, int samplerate);
 void BaNaPreprocessing(float **AudioData, int size, int dftBlocksize, int p,
 		       float f0Min, float f0Max, float* frequencies);
+// returns NULL if memory can't be allocated
 distinctList** BaNaFindCandidates(float **AudioData, int size,
 				  int dftBlocksize, int p, float f0Min,
 				  float f0Max, int first, float xi,
 				  float* frequencies, int fftSize,
-				  int samplerate);
+				  int samplerate, int numThreads);
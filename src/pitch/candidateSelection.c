@@ -5,17 +5,183 @@
 #include "../lists.h"
 #include "candidateSelection.h"
 
+#if defined(__SSE2__)
+#define CS_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define CS_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+// weight of the confidence term of the cost function
+#define CONFIDENCE_WEIGHT 0.4
 
 
 float costFunction(struct distinctCandidate cand1,
 		   struct distinctCandidate cand2)
 {
 	// calculate the cost for candidate 2 from candidate 1
-	return (float)fabs(log(cand1.frequency/cand2.frequency)/log(2.0))+(0.4/(double)cand1.confidence);
+	return (float)fabs(log(cand1.frequency/cand2.frequency)/log(2.0))+(CONFIDENCE_WEIGHT/(double)cand1.confidence);
+}
+
+struct candidateLattice* candidateLatticeCreate(distinctList **windowList,
+						long length)
+{
+	long frame, total;
+	int i;
+	struct candidateLattice *lattice = malloc(sizeof(struct candidateLattice));
+	if (lattice == NULL){
+		return NULL;
+	}
+	lattice->numFrames = length;
+	lattice->maxWidth = 0;
+	lattice->offsets = malloc(sizeof(long) * (length + 1));
+	if (lattice->offsets == NULL){
+		free(lattice);
+		return NULL;
+	}
+
+	total = 0;
+	for (frame = 0; frame < length; frame++){
+		lattice->offsets[frame] = total;
+		total += windowList[frame]->length;
+		if (windowList[frame]->length > lattice->maxWidth){
+			lattice->maxWidth = windowList[frame]->length;
+		}
+	}
+	lattice->offsets[length] = total;
+
+	// allocate at least 1 entry so that NULL always indicates failure
+	lattice->frequency = malloc(sizeof(float) * (total + 1));
+	lattice->log2Freq = malloc(sizeof(float) * (total + 1));
+	lattice->invConfidence = malloc(sizeof(float) * (total + 1));
+	lattice->cost = malloc(sizeof(float) * (total + 1));
+	lattice->backpointer = malloc(sizeof(int) * (total + 1));
+	if ((lattice->frequency == NULL) || (lattice->log2Freq == NULL) ||
+	    (lattice->invConfidence == NULL) || (lattice->cost == NULL) ||
+	    (lattice->backpointer == NULL)){
+		candidateLatticeDestroy(lattice);
+		return NULL;
+	}
+
+	for (frame = 0; frame < length; frame++){
+		long offset = lattice->offsets[frame];
+		for (i = 0; i < windowList[frame]->length; i++){
+			struct distinctCandidate c = windowList[frame]->array[i];
+			lattice->frequency[offset + i] = c.frequency;
+			lattice->log2Freq[offset + i] = (float)log2((double)c.frequency);
+			lattice->invConfidence[offset + i] = (float)(1.0/(double)c.confidence);
+			lattice->cost[offset + i] = 0;
+			lattice->backpointer[offset + i] = -1;
+		}
+	}
+	return lattice;
+}
+
+void candidateLatticeDestroy(struct candidateLattice *lattice)
+{
+	if (lattice != NULL){
+		free(lattice->offsets);
+		free(lattice->frequency);
+		free(lattice->log2Freq);
+		free(lattice->invConfidence);
+		free(lattice->cost);
+		free(lattice->backpointer);
+		free(lattice);
+	}
+}
+
+/* Returns the minimum over j < n of exitCost[j] + |log2Freq[j] - log2Cur|
+ * and stores the lowest index j that achieves it in argmin (-1 if there is
+ * none below FLT_MAX). Each of the 4 lanes tracks its minimum along with the
+ * index where it was first reached, so that the lanes only need to be
+ * combined once at the end. */
+static float minTransition(const float *exitCost, const float *log2Freq,
+			   int n, float log2Cur, int *argmin)
+{
+	float minCost = FLT_MAX;
+	int j = 0;
+	*argmin = -1;
+#if defined(CS_HAVE_SSE2)
+	if (n >= 4){
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+		const __m128 cur = _mm_set1_ps(log2Cur);
+		const __m128i step = _mm_set1_epi32(4);
+		__m128 vmin = _mm_set1_ps(FLT_MAX);
+		__m128i vidx = _mm_set1_epi32(-1);
+		__m128i idx = _mm_setr_epi32(0, 1, 2, 3);
+		float laneMin[4];
+		int laneIdx[4], l;
+		for (; j + 3 < n; j += 4){
+			__m128 diff = _mm_sub_ps(_mm_loadu_ps(log2Freq + j), cur);
+			__m128 total = _mm_add_ps(_mm_loadu_ps(exitCost + j),
+						  _mm_andnot_ps(signMask, diff));
+			// strictly less, so each lane keeps its first index
+			__m128i less = _mm_castps_si128(_mm_cmplt_ps(total,
+								     vmin));
+			vmin = _mm_min_ps(vmin, total);
+			vidx = _mm_or_si128(_mm_and_si128(less, idx),
+					    _mm_andnot_si128(less, vidx));
+			idx = _mm_add_epi32(idx, step);
+		}
+		_mm_storeu_ps(laneMin, vmin);
+		_mm_storeu_si128((__m128i *)laneIdx, vidx);
+		for (l = 0; l < 4; l++){
+			if (laneIdx[l] != -1 && (laneMin[l] < minCost ||
+			    (laneMin[l] == minCost && laneIdx[l] < *argmin))){
+				minCost = laneMin[l];
+				*argmin = laneIdx[l];
+			}
+		}
+	}
+#elif defined(CS_HAVE_NEON) && defined(__aarch64__)
+	if (n >= 4){
+		const float32x4_t cur = vdupq_n_f32(log2Cur);
+		const int32x4_t step = vdupq_n_s32(4);
+		const int32x4_t idxInit = {0, 1, 2, 3};
+		float32x4_t vmin = vdupq_n_f32(FLT_MAX);
+		int32x4_t vidx = vdupq_n_s32(-1);
+		int32x4_t idx = idxInit;
+		float laneMin[4];
+		int laneIdx[4], l;
+		for (; j + 3 < n; j += 4){
+			float32x4_t total = vaddq_f32(vld1q_f32(exitCost + j),
+						      vabdq_f32(vld1q_f32(log2Freq + j),
+								cur));
+			// strictly less, so each lane keeps its first index
+			uint32x4_t less = vcltq_f32(total, vmin);
+			vmin = vminq_f32(vmin, total);
+			vidx = vbslq_s32(less, idx, vidx);
+			idx = vaddq_s32(idx, step);
+		}
+		vst1q_f32(laneMin, vmin);
+		vst1q_s32(laneIdx, vidx);
+		for (l = 0; l < 4; l++){
+			if (laneIdx[l] != -1 && (laneMin[l] < minCost ||
+			    (laneMin[l] == minCost && laneIdx[l] < *argmin))){
+				minCost = laneMin[l];
+				*argmin = laneIdx[l];
+			}
+		}
+	}
+#endif
+	// we favor candidates at lower freq (lower index) if cost is equal. The
+	// remaining indices follow the ones of the lanes, so only a strictly
+	// lower cost replaces the minimum
+	for (; j < n; j++){
+		float total = exitCost[j] + fabsf(log2Freq[j] - log2Cur);
+		if (total < minCost){
+			minCost = total;
+			*argmin = j;
+		}
+	}
+	return minCost;
 }
 
-void candidateSelection(distinctList **windowList, long length,
-			float *fundamentals)
+int candidateSelection(distinctList **windowList, long length,
+		       float *fundamentals)
 {
 	// selects the candidates that represent the fundamentals
 	// finds blocks of candidates, and passes it to candidateSelectionSegment
@@ -25,6 +191,19 @@ void candidateSelection(distinctList **windowList, long length,
 	long end = -1;
 	int curWindowListLen;
 
+	struct candidateLattice *lattice = candidateLatticeCreate(windowList,
+								  length);
+	float *exitCost = NULL;
+	if (lattice != NULL){
+		exitCost = malloc(sizeof(float) * (lattice->maxWidth + 1));
+	}
+	if (exitCost == NULL){
+		printf("malloc error\n");
+		fflush(NULL);
+		candidateLatticeDestroy(lattice);
+		return 0;
+	}
+
 	for ( i=0; i<length; i++){
 		curWindowListLen = windowList[i]->length;
 
@@ -38,82 +217,97 @@ void candidateSelection(distinctList **windowList, long length,
 			start = i;
 		}
 
-		if (start != -1 && i == length-1){
-			//reached end of block of sound. mark position
-			end = i;
-		}
-		else if (start != -1 && curWindowListLen == 0){
+		if (start != -1 && curWindowListLen == 0){
 			//passed end of block of sound. mark position
 			end = i-1;
 		}
+		else if (start != -1 && i == length-1){
+			//reached end of block of sound. mark position
+			end = i;
+		}
 
 		if(end != -1){
 			//process block of sound
 			if(start == end){
 				//block was only 1 window long
 				//for now we will just set the frequency to the first candidate
-				fundamentals[start] = (float)((windowList[start]->array[0]).frequency);
+				fundamentals[start] = lattice->frequency[lattice->offsets[start]];
 			}
 			else{
-				candidateSelectionSegment(fundamentals, windowList,end,start);
+				candidateSelectionSegment(fundamentals, lattice,
+							  exitCost, end, start);
 			}
 			start = -1;
 			end = -1;
 		}
 	}
+
+	free(exitCost);
+	candidateLatticeDestroy(lattice);
+	return 1;
 }
 
-void candidateSelectionSegment(float* fundamentals, distinctList **windowList,
-			       long final, long start)
+void candidateSelectionSegment(float* fundamentals,
+			       struct candidateLattice *lattice,
+			       float *exitCost, long final, long start)
 {
-	// This function finds the lowest cost path from windowList[start]
-	// to windowList[final] and fills in fundamentals with the frequency values.
-	// Before calling this function ensure that all distinctLists from
-	// windowList[start] to windowList[final] have at least 1 candidate each
-
-	distinctList *curWindowList;
-	distinctList *prevWindowList;
-	struct distinctCandidate *curcandidate;
-	long frame;
-	int i, j, indexLowestCost;
-	float curCost, minCost;
+	// This function finds the lowest cost path from frame start to frame
+	// final of the lattice and fills in fundamentals with the frequency
+	// values. Before calling this function ensure that all frames from
+	// start to final have at least 1 candidate each. exitCost is a
+	// scratch array of lattice->maxWidth entries.
+
+	long frame, prev, cur;
+	int i, j, prevLength, curLength, indexLowestCost;
+	float minCost;
 
 	//calculate intermediate mincost paths from start to final, eventually
-	//finding lowest cost candidate in windowList[final]
+	//finding lowest cost candidate in the final frame
+	for (i = 0; i < lattice->offsets[start + 1] - lattice->offsets[start]; i++){
+		lattice->cost[lattice->offsets[start] + i] = 0;
+	}
 	int finalindex = -1;
 	float finalcost = FLT_MAX;
 	for(frame = start + 1; frame <= final; ++frame){
-		curWindowList = windowList[frame];
-		prevWindowList = windowList[frame-1];
-
-		for (i = curWindowList->length - 1; i >= 0; --i){
-			curcandidate = &(curWindowList->array[i]);
-
-			minCost = FLT_MAX;
-			indexLowestCost = -1;
-
-			for (j = prevWindowList->length - 1; j >= 0; --j){
-				curCost = (prevWindowList->array[j]).cost;
-				curCost += costFunction(prevWindowList->array[j],*curcandidate);
-				if (curCost<=minCost) {
-					//<= bc we favor candidates at lower freq if cost is equal
-					minCost = curCost;
-					indexLowestCost = j;
-				}
-			}
-			distinctListAdjustCost(curWindowList, i,minCost,indexLowestCost);
-			if(frame == final && minCost <= finalcost){
-				finalcost = minCost;
-				finalindex = i;
-			}
+		prev = lattice->offsets[frame - 1];
+		cur = lattice->offsets[frame];
+		prevLength = (int)(cur - prev);
+		curLength = (int)(lattice->offsets[frame + 1] - cur);
+
+		// the part of the cost of a transition that only depends on
+		// the previous candidate
+		for (j = 0; j < prevLength; j++){
+			exitCost[j] = lattice->cost[prev + j]
+				+ ((float)CONFIDENCE_WEIGHT
+				   * lattice->invConfidence[prev + j]);
+		}
+
+		for (i = 0; i < curLength; i++){
+			minCost = minTransition(exitCost, lattice->log2Freq + prev,
+						prevLength,
+						lattice->log2Freq[cur + i],
+						&indexLowestCost);
+			lattice->cost[cur + i] = minCost;
+			lattice->backpointer[cur + i] = indexLowestCost;
+		}
+	}
+
+	// we favor candidates at lower freq if cost is equal
+	cur = lattice->offsets[final];
+	curLength = (int)(lattice->offsets[final + 1] - cur);
+	for (i = 0; i < curLength; i++){
+		if (lattice->cost[cur + i] < finalcost){
+			finalcost = lattice->cost[cur + i];
+			finalindex = i;
 		}
 	}
 
 	// now trace the lowest cost path backwards
 	indexLowestCost = finalindex;
 	for (frame = final; frame >= start; frame--){
-		fundamentals[frame] = (float)(windowList[frame]->array[indexLowestCost]).frequency;
-		indexLowestCost = (windowList[frame]->array[indexLowestCost]).indexLowestCost;
+		cur = lattice->offsets[frame];
+		fundamentals[frame] = lattice->frequency[cur + indexLowestCost];
+		indexLowestCost = lattice->backpointer[cur + indexLowestCost];
 	}
 }
 
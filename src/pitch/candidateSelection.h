@@ -1,8 +1,28 @@
 #include "../lists.h"
 
+// The candidates of all frames packed into contiguous arrays (like a
+// compressed sparse row matrix). The candidates of frame f occupy the
+// entries offsets[f] up to (but not including) offsets[f+1] of each array.
+struct candidateLattice{
+	long numFrames;
+	int maxWidth; // the largest number of candidates in a frame
+	long *offsets; // numFrames + 1 entries
+	float *frequency;
+	float *log2Freq;
+	float *invConfidence;
+	float *cost; // cost of the lowest cost path ending at a candidate
+	int *backpointer; // index of the previous candidate on that path
+};
+
 float costFunction(struct distinctCandidate cand1,
 		   struct distinctCandidate cand2);
-void candidateSelection(distinctList **windowList, long length,
-			float* fundamentals);
-void candidateSelectionSegment(float* fundamentals, distinctList **windowList,
-			       long final, long start);
+// returns NULL if memory can't be allocated
+struct candidateLattice* candidateLatticeCreate(distinctList **windowList,
+						long length);
+void candidateLatticeDestroy(struct candidateLattice *lattice);
+// returns 1 on success and 0 on failure
+int candidateSelection(distinctList **windowList, long length,
+		       float* fundamentals);
+void candidateSelectionSegment(float* fundamentals,
+			       struct candidateLattice *lattice,
+			       float *exitCost, long final, long start);
@@ -1,64 +1,198 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <limits.h>
+#include <float.h>
+#include <math.h>
 #include "../lists.h"
 #include "findCandidates.h"
 
+// The number of entries sorted by the sorting network in calcCandidates
+#define SORT_NETWORK_SIZE 16
+
 // https://stackoverflow.com/questions/6514651/declare-large-global-array
 static float ratioRanges[15] = {1.15, 1.29, 1.42, 1.59,  
 				1.8,  1.9,  2.1,  2.4,
 				2.6,  2.8,  3.2,  3.8,
 				4.2,  4.8,  5.2};
 
-static float mRanges[15] = { 4,  3,  2,  3,  
-			    -1,  1, -1,  2,
-			    -1,  1, -1,  1,  
-			    -1,  1, -1};
-
+// mTable[i] is the value of m when exactly i entries of ratioRanges are
+// less than the ratio of 2 peaks (-1 indicates there is no candidate)
+static float mTable[16] = {-1,
+			    4,  3,  2,  3,  
+			   -1,  1, -1,  2,
+			   -1,  1, -1,  1,  
+			   -1,  1, -1};
 
-struct orderedList calcCandidates(float* peaks, int numPeaks)
+int calcCandidatesCapacity(int maxPeaks)
 {
-	int i,j;
-	float m;
-
 	// let T_n represent the nth triangle number. T_n = n(n+1)/2
 	// the maximum number of candidates from different combinations of
 	// peaks is: T_(numPeaks-1)= (numPeaks)(numPeaks-1)/2
 	// In addition to those combinations, the list of candidates also
 	// includes the lowest Frequency Peak and the cepstral frequency
 	// Thus, the maximum length is: 2+(numPeaks)(numPeaks-1)/2
-	struct orderedList candidates = orderedListCreate(2+((numPeaks-1) *
-							     (numPeaks)/2));
+	int capacity = 2+((maxPeaks-1) * (maxPeaks)/2);
+	// leave room to pad the candidates for the sorting network
+	if (capacity < SORT_NETWORK_SIZE){
+		capacity = SORT_NETWORK_SIZE;
+	}
+	return capacity;
+}
+
+static int compareFloats(const void *a, const void *b)
+{
+	float x = *(const float*)a;
+	float y = *(const float*)b;
+	return (x > y) - (x < y);
+}
+
+static void sortCandidates(float *array, int length)
+{
+	// For up to SORT_NETWORK_SIZE entries (every frame when p = 5), the
+	// entries are padded with FLT_MAX and sorted with a bitonic sorting
+	// network. The sequence of comparisons is fixed and each one is a
+	// branch-free min/max, so the compiler can fully unroll it.
+	if (length <= SORT_NETWORK_SIZE){
+		int i, j, k, l;
+		for (i = length; i < SORT_NETWORK_SIZE; i++){
+			array[i] = FLT_MAX;
+		}
+		for (k = 2; k <= SORT_NETWORK_SIZE; k *= 2){
+			for (j = k/2; j > 0; j /= 2){
+				for (i = 0; i < SORT_NETWORK_SIZE; i++){
+					l = i ^ j;
+					if (l > i){
+						float lo = fminf(array[i], array[l]);
+						float hi = fmaxf(array[i], array[l]);
+						int ascending = ((i & k) == 0);
+						array[i] = ascending ? lo : hi;
+						array[l] = ascending ? hi : lo;
+					}
+				}
+			}
+		}
+	} else {
+		qsort(array, length, sizeof(float), &compareFloats);
+	}
+}
+
+void calcCandidates(float* peaks, int numPeaks, float lowestPeak,
+		    struct orderedList* candidates)
+{
+	// Fills candidates with the candidates computed from every pair of
+	// peaks and with lowestPeak, sorted in increasing order. The array of
+	// candidates is owned by the caller and must have a capacity of at
+	// least calcCandidatesCapacity(numPeaks). Rather than inserting the
+	// candidates in order one at a time, they are all written and then
+	// sorted once.
+	int i,j;
+	float m;
+	int length = 0;
 
 	for (i=0; i<numPeaks-1;i++){
 		for (j=i+1; j<numPeaks; j++){
 			m = calcM(peaks[i],peaks[j]);
 			if (m>0) {
-				orderedListInsert(&candidates, peaks[i]/m);
+				candidates->array[length] = peaks[i]/m;
+				length++;
 			}				
 		}
 	}
-	return candidates;
+	candidates->array[length] = lowestPeak;
+	length++;
+
+	sortCandidates(candidates->array, length);
+	candidates->length = length;
 }
  
 float calcM(float f_i, float f_j){
-	// find the index, i, of the right most value in ratioRanges less than
-        // f_j/f_i. it returns mRanges[i]
+	// find the number of values in ratioRanges less than f_j/f_i and
+	// look up the corresponding value of m. The values are all compared,
+	// rather than bisected, so that there are no branches.
 	float ratio = f_j/f_i;
+	int i, count = 0;
+	for (i = 0; i < 15; i++){
+		count += (ratioRanges[i] < ratio);
+	}
+	return mTable[count];
+}
 
-	// basically using algorithm from python's bisect left and then moving
-	// one index to the left. This could probably be improved
 
-	int i = bisectLeft(ratioRanges,ratio,0,15);
+// Confidence of a candidate that has already been assigned to a cluster.
+// This stays far below every real confidence even after being decremented
+// once for every other candidate.
+#define REMOVED_CONFIDENCE (INT_MIN/4)
 
-	if (i == 0) {
-		return -1.;
+// A max segment tree over the confidences of the candidates that supports
+// adding a value to a range of candidates and finding the (leftmost)
+// candidate with the highest confidence. Removed candidates are lazily
+// deleted by giving them REMOVED_CONFIDENCE.
+struct confidenceTree{
+	int size; // number of leaves (a power of 2)
+	int *max; // max[node] includes all pending adds of node's subtree
+	int *lazy; // pending add of node that hasn't been pushed to children
+};
+
+static void confidenceTreePush(struct confidenceTree *t, int node)
+{
+	if (t->lazy[node] != 0){
+		int child;
+		for (child = 2*node; child <= 2*node+1; child++){
+			t->max[child] += t->lazy[node];
+			t->lazy[child] += t->lazy[node];
+		}
+		t->lazy[node] = 0;
 	}
+}
 
-	i= i - 1;
+static void confidenceTreeAdd(struct confidenceTree *t, int node,
+			      int nodeStart, int nodeStop, int start,
+			      int stop, int value)
+{
+	// adds value to the candidates start,...,stop-1. node covers the
+	// candidates nodeStart,...,nodeStop-1
+	if ((stop <= nodeStart) || (nodeStop <= start)){
+		return;
+	}
+	if ((start <= nodeStart) && (nodeStop <= stop)){
+		t->max[node] += value;
+		t->lazy[node] += value;
+		return;
+	}
+	int mid = (nodeStart + nodeStop)/2;
+	confidenceTreePush(t, node);
+	confidenceTreeAdd(t, 2*node, nodeStart, mid, start, stop, value);
+	confidenceTreeAdd(t, 2*node+1, mid, nodeStop, start, stop, value);
+	t->max[node] = (t->max[2*node] >= t->max[2*node+1]) ?
+		t->max[2*node] : t->max[2*node+1];
+}
 
-	return mRanges[i];
+static int confidenceTreeArgMax(struct confidenceTree *t)
+{
+	// ties are broken by choosing the candidate with lower frequency
+	int node = 1;
+	while (node < t->size){
+		confidenceTreePush(t, node);
+		node = (t->max[2*node] >= t->max[2*node+1]) ? 2*node : 2*node+1;
+	}
+	return node - t->size;
 }
 
+static int nextRemaining(int *next, int i)
+{
+	// returns the index of the first candidate >= i that hasn't been
+	// removed. next[i] == i for every remaining candidate
+	int root = i;
+	while (next[root] != root){
+		root = next[root];
+	}
+	while (next[i] != root){
+		int temp = next[i];
+		next[i] = root;
+		i = temp;
+	}
+	return root;
+}
 
 distinctList* distinctCandidates(struct orderedList* candidates,
 				 int max_length, float xi,
@@ -66,83 +200,101 @@ distinctList* distinctCandidates(struct orderedList* candidates,
 {	
 	// Finds the distinct candidates from the list of candidates. This is
         // done by selecting the candidate with the most other candidates
-        // within xi Hz
+        // within xi Hz, removing it and all of the candidates within xi Hz
+        // of it, and repeating until no candidates are left.
+	//
+	// Since candidates is sorted, the candidates within xi Hz of
+	// candidate i are the contiguous range lo[i],...,hi[i]. The ranges
+	// are found with 2 sliding pointers, and the confidence of every
+	// candidate (the number of remaining candidates in its range) is
+	// kept up to date in a segment tree as candidates are removed. This
+	// takes O(n log n) time rather than recomputing all of the
+	// confidences each time a candidate is picked.
 	
-	int first, last, i,j,maxIndex, *confidence, maxConfidence;
+	int n = candidates->length;
+	float *a = candidates->array;
+	int i, j, maxIndex, maxConfidence;
 	distinctList *distinct;
 	distinct = (distinctListCreate(max_length));
+	if (distinct == NULL || n == 0){
+		return distinct;
+	}
 
-	confidence = malloc(sizeof(int) * (candidates->length));
-
-	first = -1;
+	struct confidenceTree t;
+	t.size = 1;
+	while (t.size < n){
+		t.size *= 2;
+	}
+	int *lo = malloc(sizeof(int) * ((long)3 * n + 1 + 4 * (long)t.size));
+	if (lo == NULL){
+		distinctListDestroy(distinct);
+		return NULL;
+	}
+	int *hi = lo + n;
+	int *next = hi + n; // n+1 entries
+	t.max = next + n + 1;
+	t.lazy = t.max + 2 * t.size;
 
-	while (candidates->length !=0){	        
-		// set entries of confidence to 1
-		for (i=0;i<(candidates->length);i++){
-			confidence[i] = 1;
+	// determine the range of candidates within xi Hz of each candidate
+	j = 0;
+	for (i = 0; i < n; i++){
+		while ((a[i] - a[j]) > xi){
+			j++;
 		}
-		// determine confidence values for each index
-		for (i=0;i<(candidates->length)-1;i++){
-			for (j=i+1;j<(candidates->length);j++){
-				if ((candidates->array[j] -
-				     candidates->array[i])<=xi) { 
-					confidence[i]+=1;
-					confidence[j]+=1;
-				} else {
-					break;
-				}
-			}
+		lo[i] = j;
+	}
+	j = n-1;
+	for (i = n-1; i >= 0; i--){
+		while ((a[j] - a[i]) > xi){
+			j--;
 		}
-		
+		hi[i] = j;
+	}
+
+	// the initial confidences, padding leaves are never picked
+	for (i = 0; i < t.size; i++){
+		t.max[t.size + i] = (i < n) ? hi[i] - lo[i] + 1 : REMOVED_CONFIDENCE;
+	}
+	for (i = t.size - 1; i >= 1; i--){
+		t.max[i] = (t.max[2*i] >= t.max[2*i+1]) ? t.max[2*i] : t.max[2*i+1];
+	}
+	for (i = 0; i < 2 * t.size; i++){
+		t.lazy[i] = 0;
+	}
+	for (i = 0; i <= n; i++){
+		next[i] = i;
+	}
+
+	while (t.max[1] > REMOVED_CONFIDENCE/2){
 		// determine which candidate has highest confidence
-		// break ties by choosing the candidate with lower frequency
-		maxConfidence = confidence[0];
-		maxIndex = 0;
-		for (i = 1; i<(candidates->length);i++){
-			if (confidence[i]>maxConfidence) {
-				maxIndex = i;
-				maxConfidence = confidence[i];
-			}
-		}
+		maxIndex = confidenceTreeArgMax(&t);
+		maxConfidence = t.max[t.size + maxIndex];
 		
 		// add that candidate to distinct
-		if ((candidates->array[maxIndex] >= f0Min) &&
-		    (candidates->array[maxIndex] <= f0Max)){
-			struct distinctCandidate temp = { candidates->array[maxIndex],
-				 confidence[maxIndex], 0.0, -1};
-			distinctListAppend(distinct,temp);
-			//		   (candidates->array[maxIndex]),
-			//		   confidence[maxIndex]);
-		}
-		// determine first: index of first entry in candidates that is
-		// within xi Hz of the candidate with the highest confidence
-		first = maxIndex;
-		for (i=maxIndex-1;i>=0;i--){
-			if ((candidates->array[maxIndex] -
-			     candidates->array[i])<=xi) {
-				first = i;
-			} else {
-				break;
+		if ((a[maxIndex] >= f0Min) && (a[maxIndex] <= f0Max)){
+			struct distinctCandidate temp = { a[maxIndex],
+				 maxConfidence, 0.0, -1};
+			if (distinctListAppend(distinct,temp) != 1){
+				free(lo);
+				distinctListDestroy(distinct);
+				return NULL;
 			}
 		}
 
-		// determine last: index of largest entry in candidates that is
-		// within xi Hz of the candidate with the highest confidence
-		last = maxIndex;
-		for (i=maxIndex+1;i<(candidates->length);i++){
-			if ((candidates->array[i] - candidates->array[maxIndex])<=xi) {
-				last = i;
-			} else {
-				break;
-			}
+		// remove that candidate and all of the remaining candidates
+		// within xi Hz from that candidate. Every remaining candidate
+		// within xi Hz of a removed candidate loses 1 confidence.
+		for (i = nextRemaining(next, lo[maxIndex]); i <= hi[maxIndex];
+		     i = nextRemaining(next, i + 1)){
+			confidenceTreeAdd(&t, 1, 0, t.size, lo[i], hi[i] + 1, -1);
+			confidenceTreeAdd(&t, 1, 0, t.size, i, i + 1,
+					  REMOVED_CONFIDENCE);
+			next[i] = i + 1;
 		}
-
-		// remove that candidate and all of the candidates within xi Hz 
-		// from that candidate from candidates
-		orderedListDeleteEntries(candidates, first, last+1);
-
 	}
 
-	free(confidence);
+	// like the removal of entries, all entries have been consumed
+	candidates->length = 0;
+	free(lo);
 	return distinct;
 }
@@ -1,6 +1,9 @@
 #include "../lists.h"
-struct orderedList calcCandidates(float* peaks, int numPeaks);
+int calcCandidatesCapacity(int maxPeaks);
+void calcCandidates(float* peaks, int numPeaks, float lowestPeak,
+		    struct orderedList* candidates);
 float calcM(float f_i, float f_j);
+// returns NULL if memory can't be allocated
 distinctList* distinctCandidates(struct orderedList* candidates,
 				 int max_length, float xi,
 				 float f0Min, float f0Max);
@@ -28,7 +28,7 @@ SOFTWARE.
 int findpeaks(float* x, float* y, long length,float slopeThreshold, 
 	      float ampThreshold, float smoothwidth, int peakgroup,
 	      int smoothtype, int N, int first, float* peakX,
-	      float* peakY, float* firstPeakX)
+	      float* peakY, float* firstPeakX, struct findpeaksWorkspace *ws)
 {
 	// This function has been transcribed from T. C. O'Haver's findpeaks
 	// function.
@@ -60,15 +60,22 @@ int findpeaks(float* x, float* y, long length,float slopeThreshold,
 
 	// "peakX", "peakY", and will point at the peaks with the greatest 
 
+	// All intermediate arrays live in ws, which must have been created
+	// for at least length entries and N peaks. No memory is allocated.
+
+	// "firstPeakX" is the position of the first peak, or 0 if no peak is
+	// found (e.g. in a silent frame)
+	*firstPeakX = 0;
+
 	smoothwidth = round(smoothwidth);
 	peakgroup = round(peakgroup);
-	float* d=fastsmooth(deriv(y,length),length, smoothwidth, smoothtype);
+	float* d=smoothDeriv(y, length, smoothwidth, smoothtype, ws);
 	int n = (int)round(peakgroup/2 +1);
 		
 	long j, temp;
 	float curPeakX,curPeakY;
 
-	struct peakQueue peakQ=peakQueueNew(N);
+	struct peakQueue peakQ=peakQueueNew(ws->peaks, N);
 
 	// Here we try to find the first peak
 	for (j=((long)smoothwidth)-1;j<(length-(long)smoothwidth);j++){
@@ -125,11 +132,42 @@ int findpeaks(float* x, float* y, long length,float slopeThreshold,
 			}
 		}
 	}
-	free(d);
 
-	int out = peakQueueToArrays(&peakQ,peakX,peakY);
-	peakQueueDestroy(peakQ);
-	return out;
+	return peakQueueToArrays(&peakQ,peakX,peakY);
+}
+
+struct findpeaksWorkspace* findpeaksWorkspaceNew(long length, int N)
+{
+	struct findpeaksWorkspace *ws = malloc(sizeof(struct findpeaksWorkspace));
+	if (ws == NULL){
+		return NULL;
+	}
+	ws->length = length;
+	ws->maxPeaks = N;
+	ws->d = malloc(sizeof(float)*length);
+	ws->smoothed[0] = malloc(sizeof(float)*length);
+	ws->smoothed[1] = malloc(sizeof(float)*length);
+	ws->smoothed[2] = malloc(sizeof(float)*length);
+	ws->peaks = malloc(sizeof(struct peak)*N);
+	if ((ws->d == NULL) || (ws->smoothed[0] == NULL) ||
+	    (ws->smoothed[1] == NULL) || (ws->smoothed[2] == NULL) ||
+	    (ws->peaks == NULL)){
+		findpeaksWorkspaceDestroy(ws);
+		return NULL;
+	}
+	return ws;
+}
+
+void findpeaksWorkspaceDestroy(struct findpeaksWorkspace *ws)
+{
+	if (ws != NULL){
+		free(ws->d);
+		free(ws->smoothed[0]);
+		free(ws->smoothed[1]);
+		free(ws->smoothed[2]);
+		free(ws->peaks);
+		free(ws);
+	}
 }
 
 int sign(float x)
@@ -143,6 +181,20 @@ int sign(float x)
 	}
 }
 
+/* Returns the index of the kth (1-indexed) entry of the group of peakgroup
+ * entries around index j, clamped to the bounds of the array */
+static inline long groupIndex(long j, int k, int n, long length)
+{
+	long groupindex = (j+(long)k-(long)n);
+	if (groupindex < 0) {
+		groupindex = 0;
+	}
+	if (groupindex >= length) {
+		groupindex = length-1;
+	}
+	return groupindex;
+}
+
 void findpeaksHelper(float* x, float* y, long length, int peakgroup,
 		     float* peakX, float* peakY, long j, int n)
 {
@@ -155,85 +207,57 @@ void findpeaksHelper(float* x, float* y, long length, int peakgroup,
 		// comparison to the matlab code but I think its actually
 		// correct)
 		for (k=1;k<=peakgroup;k++){
-			groupindex = (j+(long)k-(long)n);
-			if (groupindex < 0) {
-				groupindex = 0;
-			}
-			if (groupindex >= length) {
-				groupindex = length-1;
-			}
+			groupindex = groupIndex(j, k, n, length);
 			if (y[groupindex]>*peakY) {
 				*peakY = y[groupindex];
 				*peakX = x[groupindex];
 			}
 		}
 	} else {
-		float* xx = malloc(sizeof(float)*peakgroup);
-		float* yy = malloc(sizeof(float)*peakgroup);
 		float mean, std;
-		float *coef;
-		// At a glance the following for loop seems wrong (especiall
-		// in comparison to the matlab code), but I think its actually
-		// correct)
-		for (k=1;k<=peakgroup;k++){
-			groupindex = (j+(long)k-(long)n);
-			if (groupindex < 0) {
-				groupindex = 0;
-			}
-			if (groupindex >= length) {
-				groupindex = length-1;
-			}
-			xx[k-1]=x[groupindex];
-			yy[k-1]=(float)log(fabs((double)(y[groupindex])));
-		}
-		
-		// fit parabola to log10 of sub-group with centering and scaling
-		coef = quadFit(xx, yy, peakgroup, &mean, &std);
+		float coef[3];
+
+		// fit parabola to log10 of sub-group with centering and
+		// scaling. The sub-group is read directly out of x and y
+		// (rather than copied) by quadFit.
+		quadFit(x, y, length, j, n, peakgroup, &mean, &std, coef);
 		
 		*peakX = -((std*coef[1]/(2.*coef[2]))-mean);
 		// check that we are correctly squaring
 		*peakY = (float)exp((double)(coef[0] - coef[2] *
 					     pow((coef[1]/(2.*coef[2])),2)));
-		free(xx);
-		free(yy);
-		free(coef);
 	}
 }
 
-float* quadFit(float* x, float* y, long length, float* mean, float *std)
+void quadFit(float* x, float* y, long length, long j, int n, int peakgroup,
+	     float* mean, float *std, float* coef)
 {
-	// Fits a Quadratic to data using least square fitting, like matlab's
-	// polyfit function
+	// Fits a Quadratic to the sub-group of peakgroup points around index
+	// j using least square fitting, like matlab's polyfit function
 	// https://www.mathworks.com/help/matlab/ref/polyfit.html
+	// The fit is made to (x, log(abs(y))) of the sub-group and the 3
+	// coefficients are stored in coef.
 	
 	// Like polyfit, we center x at zero and scale it to have 1 unit
 	// standard deviation
 	// xp = (x-mean)/std
 	// Here mean is the average x value and std is the stamdard deviation
 
-	float* coef = malloc(sizeof(float)*3);
-	long i;
+	int k;
 	*mean=0.0;
-	for (i=0;i<length;i++){
-		*mean+=x[i];
+	for (k=1;k<=peakgroup;k++){
+		*mean+=x[groupIndex(j, k, n, length)];
 	}
-	*mean/=(float)length;
+	*mean/=(float)peakgroup;
 
 	float temp;
 	// assuming that all values of x are real
 	*std=0.0;
-	for (i=0;i<length;i++){
-		temp=(x[i]-*mean);
+	for (k=1;k<=peakgroup;k++){
+		temp=(x[groupIndex(j, k, n, length)]-*mean);
 		*std+=temp*temp;
 	}
-	*std = sqrtf(*std/((float)(length-1)));
-
-	// now determine xp
-
-	float* xp = malloc(sizeof(float)*length);
-	for (i=0;i<length;i++){
-		xp[i]=(x[i]-*mean) / *std;
-	}
+	*std = sqrtf(*std/((float)(peakgroup-1)));
 
 	// fit the actual polynomial to xp and y, we a method equivalent 
 	// to the one used by matlab. Instructions for that kind of fitting 
@@ -250,6 +274,7 @@ float* quadFit(float* x, float* y, long length, float* mean, float *std)
 	// S_y2 -> sx2y
 	float sxx, sxx2, sx2x2, sxy, sx2y, sumx, sumx2, sumy, cur_x, cur_x2;
 	float cur_y;
+	long groupindex;
 	sumx = 0;
 	sumx2 = 0;
 	sumy = 0;
@@ -258,10 +283,11 @@ float* quadFit(float* x, float* y, long length, float* mean, float *std)
         sxy = 0;
 	sx2y = 0;
 
-	for (i=0;i<length;i++){
-		cur_x = xp[i];
+	for (k=1;k<=peakgroup;k++){
+		groupindex = groupIndex(j, k, n, length);
+		cur_x = (x[groupindex]-*mean) / *std;
 		cur_x2 = cur_x * cur_x;
-		cur_y = y[i];
+		cur_y = (float)log(fabs((double)(y[groupindex])));
 		sumx += cur_x;
 		sumx2 += cur_x2;
 		sumy += cur_y;
@@ -271,38 +297,34 @@ float* quadFit(float* x, float* y, long length, float* mean, float *std)
 		sx2y += (cur_x2 * cur_y);
 	}
 
-	sxx = sumx2 - ((sumx*sumx)/((float)length));
-	sxx2 -= ((sumx*sumx2)/((float)length));
-	sx2x2 -= ((sumx2*sumx2)/((float)length));
-	sxy -= ((sumx*sumy)/((float)length));
-	sx2y -= ((sumx2*sumy)/((float)length));
+	sxx = sumx2 - ((sumx*sumx)/((float)peakgroup));
+	sxx2 -= ((sumx*sumx2)/((float)peakgroup));
+	sx2x2 -= ((sumx2*sumx2)/((float)peakgroup));
+	sxy -= ((sumx*sumy)/((float)peakgroup));
+	sx2y -= ((sumx2*sumy)/((float)peakgroup));
 
 	coef[2] = ((sx2y * sxx)-(sxy * sxx2))/((sxx * sx2x2)-(sxx2 * sxx2));
 	coef[1] = ((sxy * sx2x2)-(sx2y * sxx2))/((sxx * sx2x2)-(sxx2 * sxx2));
-	coef[0] = (sumy - (coef[1]*sumx)-(coef[2]*sumx2))/((float)length);
-
-	free(xp);
-	return coef;
+	coef[0] = (sumy - (coef[1]*sumx)-(coef[2]*sumx2))/((float)peakgroup);
 }
 
 
-float* deriv(float* a, long length)
+void deriv(float* a, float* d, long length)
 {
 	// First derivative of vector using 2-point central difference.
 	// Transcribed from matlab code of T. C. O'Haver, 1988.
 	// I am very confident that I transcribed the indices of the 
 	// arrays properly
+	// The derivative is stored in d, which has length entries
 	long i;
-	float* d = malloc( sizeof(float) * length);
 	d[0] = a[1]-a[0];
 	d[length-1] = a[length-1]-a[length-2];
 	for(i=1;i<length-1;i++){
 		d[i] = (a[i+1]-a[i-1])/2.;
 	}
-	return d;
 }
 
-float* fastsmooth(float* y, long length, float w, int type)
+float* fastsmooth(float* y, float* scratch, long length, float w, int type)
 {
 	// Transcribed from matlab code of T. C. O'Haver, 1988 Version 2.0, 
 	// May 2008.
@@ -310,26 +332,27 @@ float* fastsmooth(float* y, long length, float w, int type)
 	//  If type=1, rectangular (sliding-average or boxcar)
 	//  If type=2, triangular (2 passes of sliding-average)
 	//  If type=3, pseudo-Gaussian (3 passes of sliding-average)
-	float* smoothY;
+	// The passes alternate between y and scratch (both of which have
+	// length entries and are overwritten). Returns whichever of the 2
+	// holds the result.
 	switch (type){
 	case 1 :
-		smoothY = sa(y,length,w);
-		break;
+		sa(y,scratch,length,w);
+		return scratch;
 	case 2 :
-		smoothY = sa(sa(y,length,w),length,w);
-		break;
+		sa(y,scratch,length,w);
+		sa(scratch,y,length,w);
+		return y;
 	case 3 :
-		smoothY = sa(sa(sa(y,length,w),length,w),length,w);
-		break;
 	default:
-		smoothY = sa(sa(sa(y,length,w),length,w),length,w);
-		break;
-
+		sa(y,scratch,length,w);
+		sa(scratch,y,length,w);
+		sa(y,scratch,length,w);
+		return scratch;
 	}
-	return smoothY;
 }
 
-float* sa(float* y, long length, float smoothwidth)
+void sa(float* y, float* s, long length, float smoothwidth)
 {
 	// should probably check that smooth width is>=1
 
@@ -342,6 +365,9 @@ float* sa(float* y, long length, float smoothwidth)
 	// uncertainty boils down to whether or not matlab's 
 	// round function returns a int data type. If that is 
 	// the case, then this function is wrong.
+
+	// The sliding average of y is stored in s (which must not overlap
+	// y). Both have length entries.
 	if(smoothwidth < 1.0f){
 		smoothwidth = 1.0f;
 	}
@@ -353,13 +379,11 @@ float* sa(float* y, long length, float smoothwidth)
 		sumPoints += y[k];
 	}
 
-	// create s which is an array of zeros
-	float* s = malloc(sizeof(float)*length);
-	for(k=0;k<length;k++){
+	long halfw = (long)round(((float)w)/2.);
+	// only the entries that aren't written below are zeroed
+	for(k=0;k<halfw-1;k++){
 		s[k]=0;
 	}
-
-	long halfw = (long)round(((float)w)/2.);
 	for(k=0;k<length-w;k++){
 		s[k+halfw-1]=sumPoints/((float)w);
 		sumPoints = sumPoints-y[k]+y[k+w];
@@ -367,32 +391,161 @@ float* sa(float* y, long length, float smoothwidth)
 
 	k = length - w - 1 + halfw;
 	long i;
+	s[k] = 0;
+	for (i=(length-w);i<length;i++){
+		s[k] += y[i];
+	}
+	s[k]/=((float)w);
+	for(i=k+1;i<length;i++){
+		s[i]=0;
+	}
+}
+
+// The steps of a sliding-average pass, split out of sa so that smoothDeriv
+// can interleave the passes. Each performs exactly the same operations as the
+// corresponding part of sa.
+static inline float saInitialSum(const float* y, long w)
+{
+	float sumPoints = 0;
+	long k;
+	for(k=0;k<w;k++){
+		sumPoints += y[k];
+	}
+	return sumPoints;
+}
+
+static inline void saStep(const float* y, float* s, long k, long w,
+			  long halfw, float* sumPoints)
+{
+	s[k+halfw-1]=(*sumPoints)/((float)w);
+	*sumPoints = (*sumPoints)-y[k]+y[k+w];
+}
+
+static void saTail(const float* y, float* s, long length, long w, long halfw)
+{
+	long k = length - w - 1 + halfw;
+	long i;
+	s[k] = 0;
 	for (i=(length-w);i<length;i++){
 		s[k] += y[i];
 	}
 	s[k]/=((float)w);
-	return s;
+	for(i=k+1;i<length;i++){
+		s[i]=0;
+	}
+}
+
+// The number of entries that each pass of smoothDeriv lags behind the
+// earliest step allowed by its input. Without it, each pass loads the entry
+// that the previous pass stored in the same iteration, whose address only
+// resolves after a division; the CPU then stalls on the memory ordering, and
+// the sweep was ~1.6x slower than the separate passes.
+#define SA_PASS_SLACK 8
+
+float* smoothDeriv(float* a, long length, float w,
+		   int type, struct findpeaksWorkspace *ws)
+{
+	// Computes fastsmooth(deriv(a)) in a single sweep over the data. Step
+	// k of a pass needs entry k+w of its input, which the previous pass
+	// writes at its own step k+w-halfw+1. So at index i of the sweep
+	// (where the derivative of entry i is computed), pass p performs step
+	// i - lag[p], with lag[p] = (p+1)*w - p*(halfw-1) + p*SA_PASS_SLACK.
+	// The result is identical to calling deriv and fastsmooth.
+	float* in[3];
+	float* out[3];
+	float sums[3];
+	long lag[3];
+	long i, k, width, halfw;
+	int numPasses, p;
+
+	if(w < 1.0f){
+		w = 1.0f;
+	}
+	width = (long)round(w);
+	halfw = (long)round(((float)width)/2.);
+	numPasses = ((type == 1) || (type == 2)) ? type : 3;
+	for (p = 0; p < numPasses; p++){
+		in[p] = (p == 0) ? ws->d : ws->smoothed[p-1];
+		out[p] = ws->smoothed[p];
+		lag[p] = (p+1)*width - p*(halfw-1) + p*SA_PASS_SLACK;
+		for(k=0;k<halfw-1;k++){
+			out[p][k]=0;
+		}
+	}
+
+	ws->d[0] = a[1]-a[0];
+	for (i = 0; (i < length) && (i <= lag[numPasses-1]); i++){
+		if ((i > 0) && (i < length-1)){
+			ws->d[i] = (a[i+1]-a[i-1])/2.;
+		} else if (i == length-1){
+			ws->d[i] = a[length-1]-a[length-2];
+		}
+		for (p = 0; p < numPasses; p++){
+			k = i - lag[p];
+			if (k == 0){
+				sums[p] = saInitialSum(in[p], width);
+			}
+			if ((k >= 0) && (k < length - width)){
+				saStep(in[p], out[p], k, width, halfw,
+				       &sums[p]);
+			}
+		}
+	}
+	// from here on, every pass is between its first and last step. The
+	// running sums of the passes are independent, so they overlap.
+	if (numPasses == 3){
+		for (; i < length-1; i++){
+			ws->d[i] = (a[i+1]-a[i-1])/2.;
+			saStep(in[0], out[0], i - lag[0], width, halfw,
+			       &sums[0]);
+			saStep(in[1], out[1], i - lag[1], width, halfw,
+			       &sums[1]);
+			saStep(in[2], out[2], i - lag[2], width, halfw,
+			       &sums[2]);
+		}
+	}
+	for (; i < length; i++){
+		if (i < length-1){
+			ws->d[i] = (a[i+1]-a[i-1])/2.;
+		} else {
+			ws->d[i] = a[length-1]-a[length-2];
+		}
+		for (p = 0; p < numPasses; p++){
+			saStep(in[p], out[p], i - lag[p], width, halfw,
+			       &sums[p]);
+		}
+	}
+
+	// The last entries of each pass depend on the tail of the previous
+	// pass, which is only written once its input is complete
+	for (p = 0; p < numPasses; p++){
+		k = length - lag[p];
+		if (k <= 0){
+			k = 0;
+			sums[p] = saInitialSum(in[p], width);
+		}
+		for (; k < length - width; k++){
+			saStep(in[p], out[p], k, width, halfw, &sums[p]);
+		}
+		saTail(in[p], out[p], length, width, halfw);
+	}
+	return out[numPasses-1];
 }
 
 // Implementing a minimum priority queue based on a peak's amplitude (value of
 // peakY)
 
-struct peakQueue peakQueueNew(int max_size)
+struct peakQueue peakQueueNew(struct peak* array, int max_size)
 {
-	// constructor for peakQueue
+	// constructor for peakQueue. The queue stores its peaks in array,
+	// which has room for max_size peaks and is owned by the caller
 	struct peakQueue peakQ;
-	peakQ.array = malloc(max_size*sizeof(struct peak));
+	peakQ.array = array;
 	peakQ.max_size = max_size;
 	peakQ.cur_size = 0;
 	return peakQ;
 }
 
-void peakQueueDestroy(struct peakQueue peakQ)
-{
-	// destructor for peakQueue
-	free(peakQ.array);
-}
-
 
 void peakQueueSwapPeaks(struct peakQueue *peakQ, int index1, int index2)
 {
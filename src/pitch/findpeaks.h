@@ -11,22 +11,39 @@ struct peakQueue{
 	int cur_size;
 };
 
+// Holds all of the intermediate arrays used by findpeaks, so that it can be
+// called repeatedly (e.g. once per frame) without allocating memory. Each
+// thread calling findpeaks needs its own workspace.
+struct findpeaksWorkspace{
+	long length;    // max number of entries of the input arrays
+	int maxPeaks;   // max number of returned peaks
+	float* d;       // the derivative of y
+	float* smoothed[3]; // the outputs of the smoothing passes
+	struct peak* peaks;
+};
+
 #endif /*FINDPEAKS_H*/
 
 int findpeaks(float* x, float* y, long length,float slopeThreshold, 
 	      float ampThreshold, float smoothwidth, int peakgroup,
 	      int smoothtype, int N, int first, float* peakX, float* peakY,
-	      float* firstPeakX);
+	      float* firstPeakX, struct findpeaksWorkspace *ws);
+// returns NULL if the memory can't be allocated
+struct findpeaksWorkspace* findpeaksWorkspaceNew(long length, int N);
+void findpeaksWorkspaceDestroy(struct findpeaksWorkspace *ws);
 int sign(float x);
 void findpeaksHelper(float* x, float* y, long length, int peakgroup, 
 		     float* peakX, float* peakY, long j, int n);
-float* quadFit(float* x, float* y, long length, float* mean, float *std);
-float* deriv(float* a, long length);
-float* fastsmooth(float* y, long length, float w, int type);
-float* sa(float* y, long length, float smoothwidth);
+void quadFit(float* x, float* y, long length, long j, int n, int peakgroup,
+	     float* mean, float *std, float* coef);
+void deriv(float* a, float* d, long length);
+float* fastsmooth(float* y, float* scratch, long length, float w, int type);
+// fastsmooth(deriv(a)) fused into one pass. Returns one of the arrays of ws.
+float* smoothDeriv(float* a, long length, float w,
+		   int type, struct findpeaksWorkspace *ws);
+void sa(float* y, float* s, long length, float smoothwidth);
 
-struct peakQueue peakQueueNew(int max_size);
-void peakQueueDestroy(struct peakQueue peakQ);
+struct peakQueue peakQueueNew(struct peak* array, int max_size);
 void peakQueueSwapPeaks(struct peakQueue *peakQ, int index1, int index2);
 void peakQueueBubbleUp(struct peakQueue *peakQ,int index);
 void peakQueueBubbleDown(struct peakQueue *peakQ, int index);
@@ -37,24 +37,27 @@ PitchStrategyFunc choosePitchStrategy(char* name)
 
 int HPSDetectionStrategy(float* spectrogram, int size, int dftBlocksize,
 			 int hpsOvr, int fftSize, int samplerate,
-			 float *pitches)
+			 int numThreads, float *pitches)
 {
+	// HPS is computed in a single thread
+	(void)numThreads;
 	return HarmonicProductSpectrum(&spectrogram, size, dftBlocksize, hpsOvr,
 				       fftSize, samplerate, pitches);
 }
 
 int BaNaDetectionStrategy(float* spectrogram, int size, int dftBlocksize,
 			  int hpsOvr, int fftSize, int samplerate,
-			  float *pitches)
+			  int numThreads, float *pitches)
 {
 	return BaNa(&spectrogram, size, dftBlocksize, 5, 50, 600, 10.0,
-		    fftSize, samplerate, 1, pitches);
+		    fftSize, samplerate, 1, numThreads, pitches);
 }
 
 int BaNaMusicDetectionStrategy(float* spectrogram, int size,
 			       int dftBlocksize, int hpsOvr, int fftSize,
-			       int samplerate, float *pitches)
+			       int samplerate, int numThreads,
+			       float *pitches)
 {
 	return BaNa(&spectrogram, size, dftBlocksize, 5, 50, 3000, 3.0,
-		    fftSize, samplerate, 0, pitches);
+		    fftSize, samplerate, 0, numThreads, pitches);
 }
@@ -24,6 +24,9 @@
 /// @param[in] fftSize The number of samples of the input audio used to compute
 ///            a single DFT.
 /// @param[in] samplerate The sampling rate of the audio stream
+/// @param[in] numThreads The number of threads the strategy may use. Values
+///            smaller than 2 indicate that everything is computed on the
+///            calling thread. Strategies are free to ignore this.
 /// @param[out] pitches A pre-allocate array of `size/dftBlocksize` entries
 ///             that will be filled with the frequencies of the identified
 ///             pitches
@@ -40,14 +43,16 @@
 
 typedef int (*PitchStrategyFunc)(float* spectrogram, int size,
 				 int dftBlocksize, int hpsOvr,
-				 int fftSize, int samplerate, float *pitches);
+				 int fftSize, int samplerate, int numThreads,
+				 float *pitches);
 PitchStrategyFunc choosePitchStrategy(char* name);
 int HPSDetectionStrategy(float* spectrogram, int size, int dftBlocksize,
 			 int hpsOvr, int fftSize, int samplerate,
-			 float* pitches);
+			 int numThreads, float* pitches);
 int BaNaDetectionStrategy(float* spectrogram, int size, int dftBlocksize,
 			  int hpsOvr, int fftSize, int samplerate,
-			  float* pitches);
+			  int numThreads, float* pitches);
 int BaNaMusicDetectionStrategy(float* spectrogram, int size,
 			       int dftBlocksize, int hpsOvr, int fftSize,
-			       int samplerate, float *pitches);
+			       int samplerate, int numThreads,
+			       float *pitches);
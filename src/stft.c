@@ -2,6 +2,17 @@
 #include <math.h>
 #include "fftw3.h"
 #include "melodyextraction.h"
+#include "fftPlanCache.h"
+
+#if defined(__SSE2__)
+#define STFT_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define STFT_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
 
 float* WindowFunction(int size)
 {
@@ -25,92 +36,327 @@ int NumSTFTBlocks(audioInfo info, int unpaddedSize, int interval)
 	return numBlocks;
 }
 
+/* Computes sqrt(re*re + im*im) of size entries of arr in single precision,
+ * 4 entries at a time where SIMD is available. */
+static void complexMagnitude(fftwf_complex* arr, float* magArr, int size)
+{
+	float* x = (float*)arr;
+	int i = 0;
+#if defined(STFT_HAVE_SSE2)
+	for(; i + 3 < size; i += 4){
+		__m128 a = _mm_loadu_ps(x + 2 * i);
+		__m128 b = _mm_loadu_ps(x + 2 * i + 4);
+		a = _mm_mul_ps(a, a);
+		b = _mm_mul_ps(b, b);
+		__m128 re = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 im = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		_mm_storeu_ps(magArr + i, _mm_sqrt_ps(_mm_add_ps(re, im)));
+	}
+#elif defined(STFT_HAVE_NEON) && defined(__aarch64__)
+	for(; i + 3 < size; i += 4){
+		float32x4x2_t v = vld2q_f32(x + 2 * i);
+		float32x4_t sq = vmlaq_f32(vmulq_f32(v.val[0], v.val[0]),
+					   v.val[1], v.val[1]);
+		vst1q_f32(magArr + i, vsqrtq_f32(sq));
+	}
+#endif
+	for(; i < size; i++){
+		magArr[i] = sqrtf(arr[i][0] * arr[i][0] + arr[i][1] * arr[i][1]);
+	}
+}
+
 float* Magnitude(fftwf_complex* arr, int size)
 {
-	int i;
 	float* magArr = malloc( sizeof(float) * size);
 	if (magArr != NULL){
-		for(i = 0; i < size; i++){
-			magArr[i] = hypot(arr[i][0], arr[i][1]);
-		}
+		complexMagnitude(arr, magArr, size);
 	}
 	return magArr;
 }
 
+/* STFT_r2c windows a batch of frames at a time into a single buffer and
+ * transforms the whole batch with one call to fftwf_execute_dft_r2c. The
+ * buffer holds at most STFT_BATCH_FLOATS floats (1 MB). */
+#define STFT_BATCH_FLOATS 262144
+
+/* Copies the blocks firstBlock, firstBlock+1, ..., firstBlock+count-1 of
+ * input into consecutive frames of winSize entries, applying the window and
+ * padding with zeros. */
+static void windowFrames(float* input, long numFrames, int unpaddedSize,
+			 int winSize, int interval, float* window,
+			 int firstBlock, int count, float* frames)
+{
+	for(int i = 0; i < count; i++){
+		long blockoffset = (long)(firstBlock + i) * interval;
+		float* frame = frames + (long)i * winSize;
+		float* x = input + blockoffset;
+		long remaining = numFrames - blockoffset;
+		int valid = unpaddedSize < remaining ? unpaddedSize : (int)remaining;
+		if (valid < 0){
+			valid = 0;
+		}
+		int j;
+		for(j = 0; j < valid; j++){
+			frame[j] = x[j] * window[j];
+		}
+		//reached end of non-padded input
+		//Pad the rest with 0
+		for(; j < winSize; j++){
+			frame[j] = 0.0f;
+		}
+	}
+}
+
+/* A real DFT of winSize entries has winSize/2 + 1 complex outputs, but every
+ * block of fft_data only holds the first realWinSize = winSize/2 of them. If
+ * consecutive blocks were transformed in a single batch writing directly into
+ * fft_data, the (discarded) Nyquist entry of each transform would overlap the
+ * first entry of the next block.
+ *
+ * To avoid this, a batch of frames is transformed as 2 interleaved halves:
+ * the "even" plan transforms frames 0, 2, 4, ... of the batch into blocks
+ * 0, 2, 4, ... and the "odd" plan transforms frames 1, 3, 5, ... into blocks
+ * 1, 3, 5, ... . Within each half, the outputs don't overlap. The Nyquist
+ * entries of the even half land on the first entries of the odd blocks,
+ * which are then overwritten by the odd half. The Nyquist entries of the odd
+ * half land on the first entries of the following even blocks, which are
+ * saved before executing the odd half and restored afterwards (the one
+ * following the batch is overwritten by the next batch). The final Nyquist
+ * entry lands in one spare entry allocated at the end of fft_data. */
+struct stftBatchPlans{
+	fftwf_plan even;
+	fftwf_plan odd;
+	int numEven;
+	int numOdd;
+};
+
+/* The plans are owned by the process-wide plan cache, so they are created
+ * (and measured) only once for each batch layout. */
+static int planBatch(struct stftBatchPlans* plans, int count, int winSize,
+		     float* frames, fftwf_complex* out)
+{
+	int realWinSize = winSize/2;
+	plans->numEven = (count + 1) / 2;
+	plans->numOdd = count / 2;
+	plans->even = fftPlanCacheR2C(winSize, plans->numEven, 2 * winSize,
+				      2 * realWinSize, frames, out);
+	plans->odd = NULL;
+	if(plans->numOdd > 0){
+		plans->odd = fftPlanCacheR2C(winSize, plans->numOdd,
+					     2 * winSize, 2 * realWinSize,
+					     frames + winSize,
+					     out + realWinSize);
+	}
+	return (plans->even != NULL && (plans->numOdd == 0 || plans->odd != NULL));
+}
+
+/* Transforms the windowed frames of the batch starting with firstBlock.
+ * savedDC must have room for plans->numEven entries. */
+static void executeBatch(struct stftBatchPlans* plans, int firstBlock,
+			 int winSize, float* frames, fftwf_complex* fft_data,
+			 fftwf_complex* savedDC)
+{
+	int realWinSize = winSize/2;
+	fftwf_complex* out = fft_data + (long)firstBlock * realWinSize;
+	int k;
+
+	fftwf_execute_dft_r2c(plans->even, frames, out);
+	if(plans->numOdd == 0){
+		return;
+	}
+	for(k = 1; k < plans->numEven; k++){
+		savedDC[k][0] = out[2 * k * realWinSize][0];
+		savedDC[k][1] = out[2 * k * realWinSize][1];
+	}
+	fftwf_execute_dft_r2c(plans->odd, frames + winSize, out + realWinSize);
+	for(k = 1; k < plans->numEven; k++){
+		out[2 * k * realWinSize][0] = savedDC[k][0];
+		out[2 * k * realWinSize][1] = savedDC[k][1];
+	}
+}
+
 //reads in .wav, returns FFT by reference through fft_data, returns size of fft_data
 int STFT_r2c(float** input, audioInfo info, int unpaddedSize, int winSize, int interval, fftwf_complex** fft_data)
 {
-	//printf("\n\ninput size %ld\nsamplerate %d\nunpadded %d\npadded %d\ninterval %d\n", info.frames, info.samplerate, unpaddedSize, winSize, interval);
-	//fflush(NULL);
-    int i;
-    int j;
-
-    //malloc space for result fft_data
 	int numBlocks = NumSTFTBlocks(info, unpaddedSize, interval);
-	//printf("numblocks %d\n", numBlocks);
-	//fflush(NULL);
 
 	//allocate winSize/2 for each block, taking the real component 
 	//and dropping the symetrical component and nyquist frequency.
+	//One extra entry is allocated for the last (discarded) nyquist
+	//frequency, see the explanation of struct stftBatchPlans
 	int realWinSize = winSize/2;
 
-    (*fft_data) = malloc( sizeof(fftwf_complex) * numBlocks * realWinSize );
-    if((*fft_data) == NULL){
-    	printf("malloc failed\n");
-		return -1;
-    }
+	// choose an even number of frames per batch. The batch size only
+	// depends on winSize, so the batch plans are shared by inputs of any
+	// length; the blocks that don't fill a whole batch are transformed one
+	// at a time with a single-frame plan.
+	int batchSize = 2 * (STFT_BATCH_FLOATS / (2 * winSize));
+	if (batchSize < 2){
+		batchSize = 2;
+	}
+	int numFullBatches = numBlocks / batchSize;
+	int framesSize = (numFullBatches > 0) ? batchSize : 1;
 
-    //set up fftw plan
-    float* fftw_in = fftwf_malloc( sizeof( float ) * winSize);
-    fftwf_complex* fftw_out = fftwf_malloc( sizeof( fftwf_complex ) * winSize );
-    fftwf_plan plan  = fftwf_plan_dft_r2c_1d( winSize, fftw_in, fftw_out, FFTW_MEASURE );
-
-    float* window = WindowFunction(winSize);
-    if(window == NULL){
-    	printf("windowFunc error\n");
-    	fflush(NULL);
-    	free((*fft_data));
-    	fftwf_destroy_plan( plan );
-		fftwf_free( fftw_in );
-		fftwf_free( fftw_out );
+	(*fft_data) = malloc( sizeof(fftwf_complex)
+			      * ((long)numBlocks * realWinSize + 1) );
+	float* frames = fftwf_malloc( sizeof(float) * (long)framesSize * winSize );
+	fftwf_complex* savedDC = malloc( sizeof(fftwf_complex) * framesSize );
+	float* window = WindowFunction(winSize);
+	if((*fft_data) == NULL || frames == NULL || savedDC == NULL || window == NULL){
+		printf("malloc failed\n");
+		fflush(NULL);
+		free((*fft_data));
+		(*fft_data) = NULL;
+		fftwf_free(frames);
+		free(savedDC);
+		free(window);
 		return -1;
-    }
+	}
 
- 	//printf("resultsize %ld\nresultWinSize %d\n", sizeof(fftwf_complex) * numBlocks * realWinSize, realWinSize);
-	//fflush(NULL);
-	int blockoffset;
-    //run fft on each block
-    for(i = 0; i < numBlocks; i++){
-		// Copy the chunk into our buffer
-		blockoffset = i*interval;
-		for(j = 0; j < winSize; j++) {
-
-			if(j < unpaddedSize && blockoffset + j < info.frames) {
-				fftw_in[j] = (*input)[blockoffset + j] * window[j]; 
-			} else {
-				//reached end of non-padded input
-				//Pad the rest with 0
-				fftw_in[j] = 0.0; 
-			}
+	struct stftBatchPlans fullPlans = {NULL, NULL, 0, 0};
+	int planned = 1;
+	if(numFullBatches > 0){
+		planned = planBatch(&fullPlans, batchSize, winSize, frames,
+				    (*fft_data));
+	}
+
+	// Every batch starts at an even block, so the alignment of the
+	// arrays passed to fftwf_execute_dft_r2c matches the planned arrays
+	int block = 0;
+	for(int i = 0; planned && i < numFullBatches; i++){
+		windowFrames((*input), info.frames, unpaddedSize, winSize,
+			     interval, window, block, batchSize, frames);
+		executeBatch(&fullPlans, block, winSize, frames,
+			     (*fft_data), savedDC);
+		block += batchSize;
+	}
+	// The remaining blocks are transformed in increasing order, so the
+	// Nyquist entry of each one is overwritten by the next block (or lands
+	// in the spare entry). The plan is looked up for every block, since the
+	// alignment of the output depends on the block.
+	for(; planned && block < numBlocks; block++){
+		fftwf_complex* out = (*fft_data) + (long)block * realWinSize;
+		fftwf_plan plan = fftPlanCacheR2C(winSize, 1, winSize,
+						  realWinSize + 1, frames, out);
+		if(plan == NULL){
+			planned = 0;
+			break;
 		}
+		windowFrames((*input), info.frames, unpaddedSize, winSize,
+			     interval, window, block, 1, frames);
+		fftwf_execute_dft_r2c(plan, frames, out);
+	}
+	if(!planned){
+		printf("fftw planning failed\n");
+		fflush(NULL);
+		free((*fft_data));
+		(*fft_data) = NULL;
+		fftwf_free(frames);
+		free(savedDC);
+		free(window);
+		return -1;
+	}
 
-		fftwf_execute( plan );
+	free(window);
+	fftwf_free(frames);
+	free(savedDC);
 
-		for (j = 0; j < realWinSize; j++) {
-			(*fft_data)[i*realWinSize + j][0] = fftw_out[j][0];
-			(*fft_data)[i*realWinSize + j][1] = fftw_out[j][1];
-		}	
+	return numBlocks * realWinSize;
+}
+
+//computes the magnitudes of numBlocks (at least 1) consecutive blocks of the
+//STFT of input, starting with the block at index firstBlock, without storing
+//the complex spectrogram. Returns the magnitudes by reference through
+//spectrum and returns the size of spectrum
+int STFT_magnitudeBlocks(float** input, audioInfo info, int unpaddedSize, int winSize, int interval, int firstBlock, int numBlocks, float** spectrum)
+{
+	int realWinSize = winSize/2;
+
+	// Each batch is transformed into a scratch buffer (keeping the Nyquist
+	// entries), so consecutive frames never overlap. As in STFT_r2c, the
+	// batch size only depends on winSize and the blocks that don't fill a
+	// whole batch are transformed one at a time, so that the plans are
+	// shared by every range of blocks.
+	int batchSize = STFT_BATCH_FLOATS / winSize;
+	if (batchSize < 1){
+		batchSize = 1;
+	}
+	int numFullBatches = numBlocks / batchSize;
+	int framesSize = (numFullBatches > 0) ? batchSize : 1;
+
+	(*spectrum) = malloc( sizeof(float) * (long)numBlocks * realWinSize );
+	float* frames = fftwf_malloc( sizeof(float) * (long)framesSize * winSize );
+	fftwf_complex* scratch = fftwf_malloc( sizeof(fftwf_complex)
+					       * (long)framesSize
+					       * (realWinSize + 1) );
+	float* window = WindowFunction(winSize);
+	if((*spectrum) == NULL || frames == NULL || scratch == NULL || window == NULL){
+		printf("malloc failed\n");
+		fflush(NULL);
+		free((*spectrum));
+		(*spectrum) = NULL;
+		fftwf_free(frames);
+		fftwf_free(scratch);
+		free(window);
+		return -1;
+	}
+
+	fftwf_plan fullPlan = NULL;
+	fftwf_plan framePlan = NULL;
+	if(numFullBatches > 0){
+		fullPlan = fftPlanCacheR2C(winSize, batchSize, winSize,
+					   realWinSize + 1, frames, scratch);
+	}
+	if(numBlocks % batchSize > 0){
+		framePlan = fftPlanCacheR2C(winSize, 1, winSize,
+					    realWinSize + 1, frames, scratch);
+	}
+	if((numFullBatches > 0 && fullPlan == NULL)
+	   || (numBlocks % batchSize > 0 && framePlan == NULL)){
+		printf("fftw planning failed\n");
+		fflush(NULL);
+		free((*spectrum));
+		(*spectrum) = NULL;
+		fftwf_free(frames);
+		fftwf_free(scratch);
+		free(window);
+		return -1;
 	}
 
+	int block = 0;
+	while(block < numBlocks){
+		int count = (block + batchSize <= numBlocks) ? batchSize : 1;
+		fftwf_plan plan = (count == batchSize) ? fullPlan : framePlan;
+		windowFrames((*input), info.frames, unpaddedSize, winSize,
+			     interval, window, firstBlock + block, count,
+			     frames);
+		fftwf_execute_dft_r2c(plan, frames, scratch);
+		for(int k = 0; k < count; k++){
+			complexMagnitude(scratch + (long)k * (realWinSize + 1),
+					 (*spectrum) + (long)(block + k) * realWinSize,
+					 realWinSize);
+		}
+		block += count;
+	}
 
 	free(window);
-	fftwf_destroy_plan( plan );
-	fftwf_free( fftw_in );
-	fftwf_free( fftw_out );
+	fftwf_free(frames);
+	fftwf_free(scratch);
 
 	return numBlocks * realWinSize;
 }
 
+//computes the magnitude of the STFT of input without storing the complex
+//spectrogram. Returns the magnitudes by reference through spectrum and
+//returns the size of spectrum (the same size as STFT_r2c's fft_data)
+int STFT_magnitude(float** input, audioInfo info, int unpaddedSize, int winSize, int interval, float** spectrum)
+{
+	return STFT_magnitudeBlocks(input, info, unpaddedSize, winSize,
+				    interval, 0,
+				    NumSTFTBlocks(info, unpaddedSize, interval),
+				    spectrum);
+}
+
 int STFTinverse_c2r(fftwf_complex** input, audioInfo info, int winSize, int interval, float** output)
 {
 	//length of input is numBlocks * (winSize/2 + 1)
@@ -122,16 +368,17 @@ int STFTinverse_c2r(fftwf_complex** input, audioInfo info, int winSize, int inte
     fftwf_complex* fftw_in = fftwf_malloc( sizeof( fftwf_complex ) * winSize );
 	float* fftw_out = fftwf_malloc( sizeof( float ) * winSize );
 
-    fftwf_plan plan  = fftwf_plan_dft_c2r_1d( winSize, fftw_in, fftw_out, FFTW_MEASURE );
+    fftwf_plan plan  = fftPlanCacheC2R( winSize, 1, winSize/2 + 1, winSize, fftw_in, fftw_out );
 
     //float* window = WindowFunction(winSize+1);
 
  	//malloc space for output
     (*output) = calloc( info.frames, sizeof(float));
-        if((*output) == NULL){
+        if((*output) == NULL || plan == NULL){
     	printf("malloc failed\n");
     	//free(window);
-		fftwf_destroy_plan( plan );
+		free((*output));
+		(*output) = NULL;
 		fftwf_free( fftw_in );
 		fftwf_free( fftw_out );
 		return -1;
@@ -152,7 +399,7 @@ int STFTinverse_c2r(fftwf_complex** input, audioInfo info, int winSize, int inte
 			fftw_in[j][1] = (*input)[inputoffset + j][1]; 
 		}
 
-		fftwf_execute( plan );
+		fftwf_execute_dft_c2r( plan, fftw_in, fftw_out );
 
 		outputoffset = i*interval;
 
@@ -163,7 +410,6 @@ int STFTinverse_c2r(fftwf_complex** input, audioInfo info, int winSize, int inte
 		}	
 	}
 
-	fftwf_destroy_plan( plan );
 	fftwf_free( fftw_in );
 	fftwf_free( fftw_out );
 
@@ -5,4 +5,6 @@ float* WindowFunction(int size);
 int NumSTFTBlocks(audioInfo info, int unpaddedSize, int interval);
 float* Magnitude(fftwf_complex* arr, int size);
 int STFT_r2c(float** input, audioInfo info, int unpaddedSize, int winSize, int interval, fftwf_complex** fft_data);
+int STFT_magnitude(float** input, audioInfo info, int unpaddedSize, int winSize, int interval, float** spectrum);
+int STFT_magnitudeBlocks(float** input, audioInfo info, int unpaddedSize, int winSize, int interval, int firstBlock, int numBlocks, float** spectrum);
 int STFTinverse_c2r(fftwf_complex** input, audioInfo info, int winSize, int interval, float** output);
\ No newline at end of file
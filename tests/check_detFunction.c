@@ -1,8 +1,14 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
 #include <check.h>
 #include "../src/onset/simpleDetFunc.h"
+#include "../src/onset/psmKernel.h"
+#include "../src/onset/pairTransientDetection.h"
 #include "doubleArrayTesting.h"
+#include "testSignals.h"
 
 void float_to_double_array(float* array, int length, double** dblarray){
 	(*dblarray) = malloc(sizeof(double)*length);
@@ -108,6 +114,805 @@ START_TEST (check_roll_sigma_table)
 }
 END_TEST
 
+/* rollSigma is compared against the variance computed directly (in two
+ * passes) over every window. The configurations are {sigWindowSize, interval,
+ * startIndex, numWindows, offset} and cover even and odd windows, intervals
+ * longer than the window, windows that extend past either end of the array,
+ * and a mean far from zero. */
+START_TEST (check_roll_sigma_reference)
+{
+	const int configs[][5] = {{13, 5, 0, 10, 0},
+				  {12, 1, 3, 200, 0},
+				  {101, 7, 50, 150, 0},
+				  {20, 37, 10, 25, 0},
+				  {64, 16, 0, 70, 1000},
+				  {1, 3, 0, 30, 0}};
+	const int dataLength = 1000;
+	int winSize = configs[_i][0], interval = configs[_i][1];
+	int numWindows = configs[_i][3];
+	float scaleFactor = powf(4.f/3.f, 0.2f);
+	int sizeLeft = winSize/2 - ((winSize % 2 == 0) ? 1 : 0);
+	int sizeRight = winSize/2 + 1;
+
+	float *buffer = malloc(sizeof(float)*dataLength);
+	float *sigmas = malloc(sizeof(float)*numWindows);
+	for (int i = 0; i < dataLength; i++){
+		buffer[i] = (configs[_i][4] + 0.5f * sinf(0.71f * i) +
+			     sinf(0.013f * i) * (1.f + 0.002f * i));
+	}
+	rollSigma(configs[_i][2], interval, scaleFactor, winSize, dataLength,
+		  numWindows, buffer, sigmas);
+
+	for (int i = 0; i < numWindows; i++){
+		int center = configs[_i][2] + i * interval;
+		int start = (center > sizeLeft) ? center - sizeLeft : 0;
+		int stop = ((center + sizeRight < dataLength) ?
+			    center + sizeRight : dataLength);
+		int nobs = stop - start;
+		double mean = 0, ssqdm = 0, expected = 0;
+		if (nobs >= 2){
+			for (int j = start; j < stop; j++){
+				mean += buffer[j];
+			}
+			mean /= nobs;
+			for (int j = start; j < stop; j++){
+				ssqdm += (buffer[j] - mean) * (buffer[j] - mean);
+			}
+			expected = (scaleFactor * sqrt(ssqdm / (nobs - 1))
+				    / pow(nobs, 0.2));
+		}
+		ck_assert_float_eq_tol(sigmas[i], expected,
+				       1.e-5 * expected + 1.e-6);
+	}
+	free(buffer);
+	free(sigmas);
+}
+END_TEST
+
+/* Computes the detection function of a short synthetic signal with the given
+ * settings. The signal is a pair of decaying tones, the second of which
+ * starts halfway through. The caller is responsible for freeing the returned
+ * array. */
+float* settingsDetFunction(const struct detFuncSettings *settings,
+			   int *detFunctionLength){
+	int sampleRate = 11025;
+	int dataLength = sampleRate/2;
+	int correntropyWinSize = sampleRate/80;
+	int interval = sampleRate/200;
+	float scaleFactor = powf(4./3.,0.2);
+
+	float *data = malloc(sizeof(float)*dataLength);
+	for (int i = 0; i < dataLength; i++){
+		float t = (float)i/sampleRate;
+		data[i] = expf(-4.f*t) * sinf(2.f * M_PI * 220.f * t);
+		if (i >= dataLength/2){
+			float t2 = t - 0.25f;
+			data[i] += expf(-8.f*t2) * sinf(2.f * M_PI * 330.f * t2);
+		}
+	}
+
+	(*detFunctionLength) = computeDetFunctionLength(dataLength,
+							correntropyWinSize,
+							interval);
+	float *detFunction = malloc(sizeof(float)*(*detFunctionLength));
+
+	int rslt = detFunctionCalculation(correntropyWinSize, interval,
+					  scaleFactor, sampleRate/4, 7, 80.f,
+					  4000.f, sampleRate, dataLength, data,
+					  (*detFunctionLength), detFunction,
+					  settings);
+	free(data);
+	ck_assert_int_eq(rslt, 1);
+	return detFunction;
+}
+
+START_TEST (check_threaded_det_function)
+{
+	/* the threaded calculation must be bitwise identical to the serial
+	 * calculation. _i+2 threads are used (_i+2 > number of channels is
+	 * included to check the clamping of the number of threads). */
+	int serialLength, threadedLength;
+	struct detFuncSettings settings;
+	detFuncSettingsInit(&settings);
+	float *serial = settingsDetFunction(&settings, &serialLength);
+	settings.numThreads = 2 + 3*_i;
+	float *threaded = settingsDetFunction(&settings, &threadedLength);
+
+	ck_assert_int_eq(serialLength, threadedLength);
+	ck_assert_int_eq(memcmp(serial, threaded,
+				sizeof(float)*serialLength), 0);
+	free(serial);
+	free(threaded);
+}
+END_TEST
+
+/* The settings of a backend of detFunctionCalculation that is compared
+ * against the default settings by check_backend_det_function */
+struct backendConfig{
+	enum gammatoneFilterType filterType;
+	enum psmMethod psmMethod;
+	enum expPrecision expPrecision;
+	/* the smallest accepted correlation with the default detection
+	 * function */
+	double minCorrelation;
+	/* if positive, the largest accepted difference from the default
+	 * detection function, relative to its largest magnitude */
+	float tol;
+};
+
+/* The backends whose detection functions deviate from the default */
+static const struct backendConfig backend_configs[] = {
+	/* the APGF and OZGF filterbanks have the same poles as the SOS
+	 * filterbank, so the detection functions are strongly correlated
+	 * (about 0.98 for APGF and 0.92 for OZGF on this signal) */
+	{GAMMATONE_APGF, PSM_DIRECT, EXP_PRECISION_SCHRAUDOLPH, 0.9, 0.f},
+	{GAMMATONE_OZGF, PSM_DIRECT, EXP_PRECISION_SCHRAUDOLPH, 0.9, 0.f},
+	/* every entry of the PSM_INCREMENTAL detection function is the
+	 * difference of two pooled summary matrix entries, so the tolerance is
+	 * relative to the largest magnitude */
+	{GAMMATONE_SOS, PSM_INCREMENTAL, EXP_PRECISION_SCHRAUDOLPH, 0.999,
+	 1.e-3f},
+	/* the default kernel uses a cruder approximation of the gaussian than
+	 * PSM_FGT, so they are only required to be strongly correlated */
+	{GAMMATONE_SOS, PSM_FGT, EXP_PRECISION_SCHRAUDOLPH, 0.99, 0.f},
+	/* PSM_HISTOGRAM and the default kernel approximate the exact sum with
+	 * errors of the same order */
+	{GAMMATONE_SOS, PSM_HISTOGRAM, EXP_PRECISION_SCHRAUDOLPH, 0.99, 0.f},
+	/* the more accurate approximations of the gaussian differ from the
+	 * default by the error of the default approximation */
+	{GAMMATONE_SOS, PSM_DIRECT, EXP_PRECISION_POLY3, 0.999, 0.f},
+	{GAMMATONE_SOS, PSM_DIRECT, EXP_PRECISION_ACCURATE, 0.999, 0.f},
+};
+
+/* Compares the detection function computed with each entry of
+ * backend_configs against the one computed with the default settings. The
+ * threaded calculation must be bitwise identical to the serial one. */
+START_TEST (check_backend_det_function)
+{
+	const struct backendConfig *config = backend_configs + _i;
+	int defaultLength, length, threadedLength;
+	struct detFuncSettings settings;
+	detFuncSettingsInit(&settings);
+	float *reference = settingsDetFunction(&settings, &defaultLength);
+	settings.filterType = config->filterType;
+	settings.psmMethod = config->psmMethod;
+	settings.expPrecision = config->expPrecision;
+	float *other = settingsDetFunction(&settings, &length);
+	settings.numThreads = 3;
+	float *threaded = settingsDetFunction(&settings, &threadedLength);
+	ck_assert_int_eq(defaultLength, length);
+	ck_assert_int_eq(threadedLength, length);
+
+	double dot = 0, referenceNorm = 0, otherNorm = 0;
+	float maxMagnitude = 0;
+	for (int i = 0; i < length; i++){
+		dot += (double)reference[i] * other[i];
+		referenceNorm += (double)reference[i] * reference[i];
+		otherNorm += (double)other[i] * other[i];
+		maxMagnitude = fmaxf(maxMagnitude, fabsf(reference[i]));
+	}
+	double correlation = dot / sqrt(referenceNorm * otherNorm);
+	ck_assert(correlation > config->minCorrelation);
+	if (config->tol > 0){
+		for (int i = 0; i < length; i++){
+			ck_assert_float_eq_tol(other[i], reference[i],
+					       config->tol * maxMagnitude);
+		}
+	}
+	ck_assert_int_eq(memcmp(other, threaded, sizeof(float)*length), 0);
+
+	free(reference);
+	free(other);
+	free(threaded);
+}
+END_TEST
+
+/* detFunctionCalculation must reject a psmMethod outside of enum psmMethod
+ * rather than index past its tables */
+START_TEST (check_invalid_psm_method)
+{
+	const enum psmMethod invalid[] = {(enum psmMethod)-1,
+					  (enum psmMethod)(PSM_HISTOGRAM + 1)};
+	int sampleRate = 11025, dataLength = 2000;
+	int correntropyWinSize = sampleRate/80, interval = sampleRate/200;
+	int detFunctionLength = computeDetFunctionLength(dataLength,
+							 correntropyWinSize,
+							 interval);
+	float *data = calloc(dataLength, sizeof(float));
+	float *detFunction = malloc(sizeof(float)*detFunctionLength);
+	struct detFuncSettings settings;
+	detFuncSettingsInit(&settings);
+
+	for (int i = 0; i < 2; i++){
+		settings.psmMethod = invalid[i];
+		ck_assert_int_eq(detFunctionCalculation(correntropyWinSize,
+							interval, 1.f,
+							sampleRate/4, 7, 80.f,
+							4000.f, sampleRate,
+							dataLength, data,
+							detFunctionLength,
+							detFunction,
+							&settings), -1);
+	}
+
+	// PSM_INCREMENTAL only implements EXP_PRECISION_SCHRAUDOLPH
+	settings.psmMethod = PSM_INCREMENTAL;
+	for (int i = 0; i < 2; i++){
+		settings.expPrecision = (i == 0) ? EXP_PRECISION_POLY3
+			: EXP_PRECISION_ACCURATE;
+		ck_assert_int_eq(detFunctionCalculation(correntropyWinSize,
+							interval, 1.f,
+							sampleRate/4, 7, 80.f,
+							4000.f, sampleRate,
+							dataLength, data,
+							detFunctionLength,
+							detFunction,
+							&settings), -1);
+	}
+	free(data);
+	free(detFunction);
+}
+END_TEST
+
+/* pSMContribution must use exactly the 2*correntropyWinSize+1 entries that
+ * follow the first entry of each window, even when buffer has exactly the
+ * documented length. The first entry of the buffer is NaN, so the result is
+ * only finite if it is skipped. The sum is compared against a direct
+ * evaluation with exp (the kernel approximates the exponential, so the
+ * tolerance is a few percent). */
+START_TEST (check_psm_contribution_window)
+{
+	const int winSize = 20, interval = 5, numWindows = 3;
+	const int bufferLength = (numWindows-1)*interval + 2*winSize + 2;
+	float *buffer = malloc(sizeof(float)*bufferLength);
+	float sigmas[3] = {0.8f, 0.5f, 1.1f};
+	float pSMatrix[3] = {0.f, 0.f, 0.f};
+
+	buffer[0] = NAN;
+	for (int i = 1; i < bufferLength; i++){
+		buffer[i] = sinf(0.3f * i) + 0.4f * sinf(1.7f * i);
+	}
+	pSMContribution(winSize, interval, numWindows, buffer, sigmas,
+			pSMatrix);
+
+	for (int k = 0; k < numWindows; k++){
+		const float *x = buffer + k*interval + 1;
+		double expected = 0;
+		for (int i = 0; i < winSize; i++){
+			for (int j = 1; j <= winSize; j++){
+				double diff = (double)x[i] - x[i+j];
+				expected += exp(-diff * diff /
+						(2. * sigmas[k] * sigmas[k]));
+			}
+		}
+		expected /= sqrt(2. * M_PI) * sigmas[k];
+		ck_assert(isfinite(pSMatrix[k]));
+		ck_assert_float_eq_tol(pSMatrix[k], expected, 6.e-2 * expected);
+	}
+	free(buffer);
+}
+END_TEST
+
+/* The incremental method is compared against pSMContribution for each entry
+ * of {correntropyWinSize, interval}. They include an interval larger than the
+ * window (no rows are shared), intervals that divide the window and the
+ * default parameters at 11025 Hz. The buffer has exactly the documented
+ * length, so reads past it are caught when the tests run with ASan. */
+static const int incremental_configs[][2] = {
+	{137, 55},
+	{55, 137},
+	{55, 55},
+	{137, 137},
+	{8, 8},
+	{7, 3},
+};
+
+START_TEST (check_psm_incremental)
+{
+	int correntropyWinSize = incremental_configs[_i][0];
+	int interval = incremental_configs[_i][1];
+	int numWindows = 60;
+	int bufferLength = (numWindows-1)*interval + 2*correntropyWinSize + 2;
+
+	float *buffer = malloc(sizeof(float)*bufferLength);
+	float *sigmas = malloc(sizeof(float)*numWindows);
+	float *direct = calloc(numWindows, sizeof(float));
+	float *incremental = calloc(numWindows, sizeof(float));
+	slowSinesSignal(buffer, bufferLength);
+	for (int i = 0; i < bufferLength; i++){
+		buffer[i] *= expf(-0.001f * i);
+	}
+	for (int i = 0; i < numWindows; i++){
+		sigmas[i] = 0.05f + 0.01f * (i % 7);
+	}
+
+	pSMContribution(correntropyWinSize, interval, numWindows, buffer,
+			sigmas, direct);
+	ck_assert_int_eq(pSMContributionIncremental(correntropyWinSize,
+						    interval, numWindows,
+						    buffer, sigmas,
+						    incremental), 1);
+	for (int i = 0; i < numWindows; i++){
+		ck_assert_float_eq_tol(incremental[i], direct[i],
+				       1.e-4f * fabsf(direct[i]));
+	}
+
+	free(buffer);
+	free(sigmas);
+	free(direct);
+	free(incremental);
+}
+END_TEST
+
+/* The sum approximated by fgtPSMEntryContrib, evaluated in double precision
+ * with the exact gaussian */
+static double exactEntryContrib(float *x, int winSize, float sigma)
+{
+	double out = 0;
+	for (int i = 0; i < winSize; i++){
+		for (int j = 1; j <= winSize; j++){
+			double diff = (double)x[i] - x[i+j];
+			out += exp(-diff*diff / (2. * sigma * sigma));
+		}
+	}
+	return out / (sqrt(2. * M_PI) * sigma);
+}
+
+/* fgtPSMEntryContrib is compared against the exact sum for each entry of
+ * {winSize, numCenters, order, sigma*1000, tolerance*1e6}. The error falls as
+ * the number of centers and the order increase. The last entries have boxes
+ * wider than sqrt(2)*sigma, so they are evaluated directly (with the
+ * approximate gaussian of psmKernel.h) and have the largest tolerance. */
+static const int fgt_configs[][5] = {
+	{137, 32, 1, 100, 20000},
+	{137, 32, 3, 100, 1000},
+	{137, 32, 4, 100, 100},
+	{137, 64, 4, 100, 20},
+	{276, 32, 3, 300, 100},
+	{55, 8, 2, 50, 20000},
+	{137, 32, 3, 10, 40000},
+	{7, 1, 8, 10, 40000},
+};
+
+START_TEST (check_fgt_entry)
+{
+	int winSize = fgt_configs[_i][0];
+	float sigma = fgt_configs[_i][3] * 1.e-3f;
+	float tol = fgt_configs[_i][4] * 1.e-6f;
+	struct fgtPSM *fgt = fgtPSMNew(winSize, fgt_configs[_i][1],
+				       fgt_configs[_i][2]);
+	ck_assert_ptr_nonnull(fgt);
+
+	float *x = malloc(sizeof(float)*(2*winSize+1));
+	slowSinesSignal(x, 2*winSize+1);
+	double exact = exactEntryContrib(x, winSize, sigma);
+	float approx = fgtPSMEntryContrib(fgt, x, sigma);
+	ck_assert_float_eq_tol(approx, exact, tol * exact);
+
+	// a constant window (all of the targets are in one box)
+	for (int i = 0; i < 2*winSize+1; i++){
+		x[i] = 0.25f;
+	}
+	exact = exactEntryContrib(x, winSize, sigma);
+	approx = fgtPSMEntryContrib(fgt, x, sigma);
+	ck_assert_float_eq_tol(approx, exact, 1.e-5f * exact);
+
+	// the same targets, but the first source is sigma away from them
+	x[0] = 0.25f + sigma;
+	exact = exactEntryContrib(x, winSize, sigma);
+	approx = fgtPSMEntryContrib(fgt, x, sigma);
+	ck_assert_float_eq_tol(approx, exact, 1.e-5f * exact);
+
+	free(x);
+	fgtPSMDestroy(fgt);
+}
+END_TEST
+
+START_TEST (check_fgt_invalid)
+{
+	ck_assert_ptr_null(fgtPSMNew(0, 32, 3));
+	ck_assert_ptr_null(fgtPSMNew(137, 0, 3));
+	ck_assert_ptr_null(fgtPSMNew(137, 32, 0));
+	ck_assert_ptr_null(fgtPSMNew(137, 32, FGT_MAX_ORDER + 1));
+}
+END_TEST
+
+/* Each vectorized histogram dot product is compared against the scalar
+ * reference. Lengths that are not a multiple of the vector width are included
+ * to exercise the scalar tail. */
+START_TEST (check_psm_hist_dot)
+{
+	enum psmSimdLevel levels[] = {PSM_SIMD_SSE2, PSM_SIMD_AVX2,
+				      PSM_SIMD_NEON};
+	int lengths[] = {1, 7, 8, 17, 64, 255};
+	psmHistDotFunc simdFunc = psmHistDotGet(levels[_i]);
+	if (simdFunc == NULL){
+		// the level isn't supported by this build or CPU
+		return;
+	}
+
+	float *counts = malloc(sizeof(float)*255);
+	float *gauss = malloc(sizeof(float)*255);
+	for (int k = 0; k < 255; k++){
+		counts[k] = (float)((k * 7) % 13);
+		gauss[k] = expf(-0.001f * (k - 127) * (k - 127));
+	}
+	for (int k = 0; k < 6; k++){
+		float ref = psmHistDotScalar(counts, gauss, lengths[k]);
+		float simd = simdFunc(counts, gauss, lengths[k]);
+		ck_assert_float_eq_tol(simd, ref, 1.e-5f * fabsf(ref));
+	}
+	free(counts);
+	free(gauss);
+}
+END_TEST
+
+/* histPSMEntryContrib is compared against the exact sum for each entry of
+ * {winSize, numBins, sigma*1000, tolerance*1e4}. The error must be within the
+ * bound documented in histogramPSM.h. In practice it is far smaller, so it is
+ * also required to be within the (relative) tolerance, which shrinks as the
+ * bins get narrower relative to sigma. The last entries have so few bins that
+ * only the bound is meaningful. */
+static const int hist_configs[][4] = {
+	{137, 64, 150, 100},
+	{137, 16, 50, 5000},
+	{137, 512, 150, 20},
+	{276, 64, 300, 50},
+	{7, 1, 100, 20000},
+	{1, 3, 100, 10000},
+};
+
+START_TEST (check_hist_entry)
+{
+	int winSize = hist_configs[_i][0];
+	int numBins = hist_configs[_i][1];
+	float sigma = hist_configs[_i][2] * 1.e-3f;
+	float tol = hist_configs[_i][3] * 1.e-4f;
+	struct histPSM *hist = histPSMNew(winSize, numBins);
+	ck_assert_ptr_nonnull(hist);
+
+	float *x = malloc(sizeof(float)*(2*winSize+1));
+	float lo = FLT_MAX, hi = -FLT_MAX;
+	slowSinesSignal(x, 2*winSize+1);
+	for (int i = 0; i < 2*winSize+1; i++){
+		lo = fminf(lo, x[i]);
+		hi = fmaxf(hi, x[i]);
+	}
+	double exact = exactEntryContrib(x, winSize, sigma);
+	float approx = histPSMEntryContrib(hist, x, sigma);
+	double width = (hi - lo) / numBins;
+	double bound = (width / (sigma * sqrt(M_E)) * winSize * winSize /
+			(sqrt(2. * M_PI) * sigma));
+	ck_assert_float_eq_tol(approx, exact, bound);
+	ck_assert_float_eq_tol(approx, exact, tol * exact);
+
+	// a constant window (all of the entries are in one bin)
+	for (int i = 0; i < 2*winSize+1; i++){
+		x[i] = 0.25f;
+	}
+	exact = exactEntryContrib(x, winSize, sigma);
+	approx = histPSMEntryContrib(hist, x, sigma);
+	ck_assert_float_eq_tol(approx, exact, 1.e-5f * exact);
+
+	free(x);
+	histPSMDestroy(hist);
+}
+END_TEST
+
+START_TEST (check_hist_invalid)
+{
+	ck_assert_ptr_null(histPSMNew(0, 64));
+	ck_assert_ptr_null(histPSMNew(137, 0));
+}
+END_TEST
+
+/* Each vectorized pooled summary matrix kernel is compared against the scalar
+ * reference. The vectorized kernels evaluate every term identically and only
+ * differ in the order of summation, so the results are required to agree to a
+ * relative tolerance of 1e-4 (the rounding error of the scalar running sum
+ * grows with the number of terms, reaching ~1e-5 for the largest window).
+ * Window sizes that are not a multiple of the vector width are included to
+ * exercise the scalar tail, and the input spans a wide enough range that some
+ * differences exceed EXP_UPPER_BOUND. */
+START_TEST (check_psm_kernel_simd)
+{
+	enum psmSimdLevel levels[] = {PSM_SIMD_SSE2, PSM_SIMD_AVX2,
+				      PSM_SIMD_NEON};
+	int winSizes[] = {1, 7, 8, 55, 137, 276};
+	psmEntryContribFunc simdFunc = psmEntryContribGet(levels[_i]);
+	if (simdFunc == NULL){
+		// the level isn't supported by this build or CPU
+		return;
+	}
+
+	float *x = malloc(sizeof(float)*(2*276+1));
+	unsigned int state = 12345;
+	for (int i = 0; i < 2*276+1; i++){
+		x[i] = 24.f * (lcgUniform(&state) - 0.5f);
+	}
+
+	for (int k = 0; k < 6; k++){
+		float ref = psmEntryContribScalar(x, winSizes[k], 0.7f);
+		float simd = simdFunc(x, winSizes[k], 0.7f);
+		ck_assert_float_eq_tol(simd, ref, 1.e-4f * fabsf(ref));
+	}
+	free(x);
+}
+END_TEST
+
+/* Each approximation of fastExp.h is compared against the double precision
+ * exp over 0 <= y < FASTEXP_MAX_ARG, and over the part of the range that
+ * matters for the pooled summary matrix (y < 8). The tolerances are the
+ * relative errors documented in fastExp.h. */
+START_TEST (check_fast_exp)
+{
+	const double tolerances[][2] = {{0.41, 5.5e-2},
+					{8.e-5, 8.e-5},
+					{1.e-7, 1.e-7}};
+	double worst = 0, worstSmall = 0;
+	for (int i = 0; i < 1000000; i++){
+		float y = (float)i * (FASTEXP_MAX_ARG / 1000000.f);
+		double exact = exp(-(double)y);
+		double err = fabs(fastExp(y, _i) - exact) / exact;
+		worst = (err > worst) ? err : worst;
+		if (y < 8.f){
+			worstSmall = (err > worstSmall) ? err : worstSmall;
+		}
+	}
+	ck_assert(worst < tolerances[_i][0]);
+	ck_assert(worstSmall < tolerances[_i][1]);
+}
+END_TEST
+
+/* The pooled summary matrix kernels of every precision and level are compared
+ * against the exact sum. The errors of the pairs of a window don't cancel, so
+ * the tolerances are the relative errors documented in fastExp.h. */
+START_TEST (check_psm_precision)
+{
+	enum psmSimdLevel levels[] = {PSM_SIMD_SCALAR, PSM_SIMD_SSE2,
+				      PSM_SIMD_AVX2, PSM_SIMD_NEON};
+	const float tolerances[] = {5.e-2f, 1.e-4f, 1.e-5f};
+	enum expPrecision precision = _i % 3;
+	int winSizes[] = {1, 7, 55, 137};
+	psmEntryContribFunc func = psmEntryContribPrecisionGet(levels[_i / 3],
+							       precision);
+	if (func == NULL){
+		// the level isn't supported by this build or CPU
+		return;
+	}
+
+	float *x = malloc(sizeof(float)*(2*137+1));
+	slowSinesSignal(x, 2*137+1);
+	for (int i = 0; i < 2*137+1; i++){
+		x[i] *= 1.5f;
+	}
+	for (int k = 0; k < 4; k++){
+		int w = winSizes[k];
+		double exact = 0;
+		for (int i = 0; i < w; i++){
+			for (int j = 1; j <= w; j++){
+				double diff = (double)x[i] - x[i+j];
+				exact += exp(-diff*diff);
+			}
+		}
+		exact /= sqrt(2. * M_PI) * 0.7;
+		float approx = func(x, w, 0.7f);
+		ck_assert_float_eq_tol(approx, exact,
+				       tolerances[precision] * exact);
+	}
+	ck_assert_ptr_null(psmEntryContribPrecisionGet(levels[_i / 3], 3));
+	free(x);
+}
+END_TEST
+
+/* Each implementation of the cached kernel is compared against
+ * psmEntryContribScalar evaluated on the same window. The arguments of the
+ * approximation are rounded differently (see psmCachedContribGet), which
+ * occasionally changes the truncated exponent bits of a term. */
+START_TEST (check_psm_cached_kernel)
+{
+	enum psmSimdLevel levels[] = {PSM_SIMD_SCALAR, PSM_SIMD_SSE2,
+				      PSM_SIMD_AVX2, PSM_SIMD_NEON};
+	int winSizes[] = {1, 7, 8, 55, 137, 276};
+	psmCachedContribFunc cachedFunc = psmCachedContribGet(levels[_i]);
+	if (cachedFunc == NULL){
+		// the level isn't supported by this build or CPU
+		return;
+	}
+
+	float sigma = 0.7f, denom = M_SQRT1_2/sigma;
+	float *x = malloc(sizeof(float)*(2*276+1));
+	float *scaled = malloc(sizeof(float)*(2*276+1));
+	float *sqDiffs = malloc(sizeof(float)*276*276);
+	unsigned int state = 12345;
+	for (int i = 0; i < 2*276+1; i++){
+		x[i] = 24.f * (lcgUniform(&state) - 0.5f);
+		scaled[i] = x[i] * denom;
+	}
+
+	for (int k = 0; k < 6; k++){
+		int w = winSizes[k];
+		for (int i = 0; i < w; i++){
+			for (int j = 1; j <= w; j++){
+				float diff = x[i] - x[i+j];
+				sqDiffs[i*w + j-1] = diff*diff;
+			}
+		}
+		float ref = psmEntryContribScalar(scaled, w, sigma);
+		float cached = cachedFunc(sqDiffs, w*w, denom*denom, sigma);
+		ck_assert_float_eq_tol(cached, ref, 1.e-3f * fabsf(ref));
+	}
+	free(x);
+	free(scaled);
+	free(sqDiffs);
+}
+END_TEST
+
+/* Checks the layout and the values of the shared kernel bank against a
+ * direct evaluation of the kernel formula. */
+START_TEST (check_kernel_bank)
+{
+	const struct kernelBank *bank = sharedKernelBank();
+	ck_assert_ptr_ne(bank, NULL);
+	ck_assert_ptr_eq(bank, sharedKernelBank());
+	ck_assert_int_eq(bank->minK, MIN_KERNEL_LEN);
+	ck_assert_int_eq(bank->numKernels, MAX_KERNEL_LEN - MIN_KERNEL_LEN + 1);
+
+	for (int len = MIN_KERNEL_LEN; len <= MAX_KERNEL_LEN; len++){
+		const float *kernel = kernelBankKernel(bank, len);
+		ck_assert_int_eq((size_t)kernel % KERNEL_BANK_ALIGN, 0);
+		for (int j = 0; j < len; j++){
+			float z = ((1.99998f * j) / (len-1)) - 0.99999f;
+			ck_assert(kernel[j] == (float)(z/(1.15f - fabs(z))));
+		}
+		if (len < MAX_KERNEL_LEN){
+			// the padding must be zeroed
+			const float *next = kernelBankKernel(bank, len + 1);
+			for (const float *p = kernel + len; p < next; p++){
+				ck_assert(*p == 0.f);
+			}
+		}
+	}
+}
+END_TEST
+
+/* Reference implementation of detectTransients' kernel search, which
+ * evaluates the fitness of every kernel length. */
+int bruteForceKernelLength(float (*fitness)(const float*, float*, int, int),
+			   const struct kernelBank *bank, float* detection_func,
+			   int start, int minK, int maxK)
+{
+	float bestFitness = FLT_MAX;
+	int bestInd = 0;
+	for(int i = minK; i < maxK; ++i){
+		float curFitness = fitness(kernelBankKernel(bank, i),
+					   detection_func, start, i);
+		if(curFitness < bestFitness){
+			bestFitness = curFitness;
+			bestInd = i;
+		}
+	}
+	return bestInd;
+}
+
+/* Checks that the transients found by detectTransients match the transients
+ * found by an exhaustive kernel search. The detection function is a noisy
+ * sequence of note-like bumps; _i seeds the noise and picks the spacing. */
+START_TEST (check_detect_transients)
+{
+	int len = 1800 + 700 * _i;
+	float *detFunc = malloc(sizeof(float)*len);
+	unsigned int state = 2017u + 31u * _i;
+	int period = 90 + 45 * _i;
+	for (int i = 0; i < len; i++){
+		float noise = lcgUniform(&state) - 0.5f;
+		float phase = (float)(i % period) / period;
+		detFunc[i] = (sinf(2.f * M_PI * phase) * expf(-3.f * phase)
+			      + 0.3f * noise);
+	}
+
+	intList* transients = intListCreate(20);
+	int numTransients = detectTransients(detFunc, len, transients);
+	ck_assert_int_gt(numTransients, 0);
+
+	/* detectTransients normalized detFunc in place, so we can directly
+	 * repeat the search */
+	int minK = MIN_KERNEL_LEN, maxK = MAX_KERNEL_LEN;
+	const struct kernelBank *bank = sharedKernelBank();
+	ck_assert_ptr_ne(bank, NULL);
+	intList* ref = intListCreate(20);
+	int index = 0;
+	while (index < len - 8){
+		int tmpMax = maxK < (len - index) ? maxK : (len - index);
+		index += bruteForceKernelLength(&FitnessOnset, bank, detFunc,
+						index, minK, tmpMax);
+		if (index >= len - 4){
+			break;
+		}
+		intListAppend(ref, index);
+		tmpMax = maxK < (len - index) ? maxK : (len - index);
+		index += bruteForceKernelLength(&FitnessOffset, bank, detFunc,
+						index, minK, tmpMax);
+		intListAppend(ref, index);
+	}
+
+	ck_assert_int_eq(numTransients, ref->length - 2);
+	for (int i = 0; i < numTransients; i++){
+		ck_assert_int_eq(transients->array[i], ref->array[i]);
+	}
+	intListDestroy(transients);
+	intListDestroy(ref);
+	free(detFunc);
+}
+END_TEST
+
+/* Checks that detectTransientsInRanges only searches within the ranges and
+ * matches an exhaustive kernel search of each range. */
+START_TEST (check_detect_transients_in_ranges)
+{
+	int len = 4000;
+	float *detFunc = malloc(sizeof(float)*len);
+	unsigned int state = 4099u + 17u * _i;
+	int period = 100 + 40 * _i;
+	for (int i = 0; i < len; i++){
+		float noise = lcgUniform(&state) - 0.5f;
+		float phase = (float)(i % period) / period;
+		detFunc[i] = (sinf(2.f * M_PI * phase) * expf(-3.f * phase)
+			      + 0.3f * noise);
+	}
+	int ranges[6] = {150, 1400, 1400 + 300 * _i, 2700, 3100, len};
+
+	intList* transients = intListCreate(20);
+	int numTransients = detectTransientsInRanges(detFunc, len, ranges, 6,
+						     transients);
+	ck_assert_int_gt(numTransients, 0);
+
+	int minK = MIN_KERNEL_LEN, maxK = MAX_KERNEL_LEN;
+	const struct kernelBank *bank = sharedKernelBank();
+	ck_assert_ptr_ne(bank, NULL);
+	intList* ref = intListCreate(20);
+	for (int r = 0; r < 6; r += 2){
+		int stop = ranges[r+1];
+		int rangeFirst = ref->length;
+		int index = ranges[r];
+		while (index < stop - 8){
+			int tmpMax = maxK < (stop - index) ? maxK : (stop - index);
+			index += bruteForceKernelLength(&FitnessOnset, bank,
+							detFunc, index, minK,
+							tmpMax);
+			if (index >= stop - 4){
+				break;
+			}
+			intListAppend(ref, index);
+			tmpMax = maxK < (stop - index) ? maxK : (stop - index);
+			index += bruteForceKernelLength(&FitnessOffset, bank,
+							detFunc, index, minK,
+							tmpMax);
+			intListAppend(ref, index);
+		}
+		ref->length = (ref->length - 2 < rangeFirst ?
+			       rangeFirst : ref->length - 2);
+	}
+
+	ck_assert_int_eq(numTransients, ref->length);
+	for (int i = 0; i < numTransients; i++){
+		ck_assert_int_eq(transients->array[i], ref->array[i]);
+	}
+	// every onset and its offset lie within the same range
+	for (int i = 0; i < numTransients; i += 2){
+		int inRange = 0;
+		for (int r = 0; r < 6; r += 2){
+			inRange |= (transients->array[i] >= ranges[r] &&
+				    transients->array[i+1] <= ranges[r+1]);
+		}
+		ck_assert(inRange);
+	}
+	intListDestroy(transients);
+	intListDestroy(ref);
+	free(detFunc);
+}
+END_TEST
+
 Suite *detFunction_suite()
 {
 	Suite *s = suite_create("detFunction");
@@ -119,7 +924,39 @@ Suite *detFunction_suite()
 		printf("Cannot add rollSigma tests because the tests are not \n"
 		       "presently equipped to run on Big Endian machines\n");
 	}
+	tcase_add_loop_test(tc_rollSigma, check_roll_sigma_reference, 0, 6);
 	suite_add_tcase(s, tc_rollSigma);
+
+	TCase *tc_pSMContribution = tcase_create("pSMContribution");
+	tcase_add_test(tc_pSMContribution, check_psm_contribution_window);
+	suite_add_tcase(s, tc_pSMContribution);
+
+	TCase *tc_psmKernel = tcase_create("psmKernel");
+	tcase_add_loop_test(tc_psmKernel, check_psm_kernel_simd, 0, 3);
+	tcase_add_loop_test(tc_psmKernel, check_psm_cached_kernel, 0, 4);
+	tcase_add_loop_test(tc_psmKernel, check_fast_exp, 0, 3);
+	tcase_add_loop_test(tc_psmKernel, check_psm_precision, 0, 12);
+	tcase_add_loop_test(tc_psmKernel, check_psm_incremental, 0, 6);
+	tcase_add_loop_test(tc_psmKernel, check_fgt_entry, 0, 8);
+	tcase_add_test(tc_psmKernel, check_fgt_invalid);
+	tcase_add_loop_test(tc_psmKernel, check_psm_hist_dot, 0, 3);
+	tcase_add_loop_test(tc_psmKernel, check_hist_entry, 0, 6);
+	tcase_add_test(tc_psmKernel, check_hist_invalid);
+	suite_add_tcase(s, tc_psmKernel);
+
+	TCase *tc_transients = tcase_create("detectTransients");
+	tcase_add_test(tc_transients, check_kernel_bank);
+	tcase_add_loop_test(tc_transients, check_detect_transients, 0, 3);
+	tcase_add_loop_test(tc_transients, check_detect_transients_in_ranges,
+			    0, 3);
+	suite_add_tcase(s, tc_transients);
+
+	TCase *tc_threaded = tcase_create("threadedDetFunction");
+	tcase_add_loop_test(tc_threaded, check_threaded_det_function, 0, 3);
+	tcase_add_test(tc_threaded, check_invalid_psm_method);
+	tcase_add_loop_test(tc_threaded, check_backend_det_function, 0,
+			    sizeof(backend_configs) / sizeof(backend_configs[0]));
+	suite_add_tcase(s, tc_threaded);
 	return s;
 }
 
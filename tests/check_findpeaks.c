@@ -0,0 +1,156 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <check.h>
+#include "../src/pitch/findpeaks.h"
+#include "testSignals.h"
+
+// This test is linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,
+// so that every allocation made by the library is counted
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static long numAllocations = 0;
+
+void *__wrap_malloc(size_t size)
+{
+	numAllocations++;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+	numAllocations++;
+	return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	numAllocations++;
+	return __real_realloc(ptr, size);
+}
+
+#define NUM_BINS 2048
+#define NUM_PEAKS 5
+
+// Fills y with 5 gaussian peaks centered on harmonics of f0
+static void harmonicSpectrum(float *x, float *y, float f0)
+{
+	for (int i = 0; i < NUM_BINS; i++){
+		x[i] = i * 44100.f / 4096.f;
+		y[i] = 0.01f;
+		for (int h = 1; h <= NUM_PEAKS; h++){
+			float diff = x[i] - h * f0;
+			y[i] += expf(-diff * diff / 800.f) / h;
+		}
+	}
+}
+
+START_TEST(test_findpeaks_harmonics)
+{
+	float x[NUM_BINS], y[NUM_BINS];
+	float peakX[NUM_PEAKS], peakY[NUM_PEAKS], firstPeakX;
+	struct findpeaksWorkspace *ws = findpeaksWorkspaceNew(NUM_BINS,
+							      NUM_PEAKS);
+	ck_assert_ptr_nonnull(ws);
+
+	harmonicSpectrum(x, y, 220.f);
+	int numPeaks = findpeaks(x, y, NUM_BINS, 0.0, 0.05, 5., 5, 3,
+				 NUM_PEAKS, 1, peakX, peakY, &firstPeakX, ws);
+	ck_assert_int_eq(numPeaks, NUM_PEAKS);
+	ck_assert_float_eq_tol(firstPeakX, 220.f, 1.f);
+
+	// sort the peaks by frequency (they're returned in order of
+	// increasing amplitude)
+	for (int i = 1; i < NUM_PEAKS; i++){
+		for (int j = i; j > 0 && peakX[j-1] > peakX[j]; j--){
+			float temp = peakX[j];
+			peakX[j] = peakX[j-1];
+			peakX[j-1] = temp;
+		}
+	}
+	for (int i = 0; i < NUM_PEAKS; i++){
+		ck_assert_float_eq_tol(peakX[i], 220.f * (i + 1), 1.f);
+	}
+	findpeaksWorkspaceDestroy(ws);
+}
+END_TEST
+
+START_TEST(test_findpeaks_no_allocations)
+{
+	float x[NUM_BINS], y[NUM_BINS];
+	float peakX[NUM_PEAKS], peakY[NUM_PEAKS], firstPeakX;
+	struct findpeaksWorkspace *ws = findpeaksWorkspaceNew(NUM_BINS,
+							      NUM_PEAKS);
+	ck_assert_ptr_nonnull(ws);
+
+	long before = numAllocations;
+	for (int frame = 0; frame < 50; frame++){
+		harmonicSpectrum(x, y, 100.f + 7.f * frame);
+		findpeaks(x, y, NUM_BINS, 0.0, 0.05, 5., 5, 3, NUM_PEAKS,
+			  frame % 2, peakX, peakY, &firstPeakX, ws);
+	}
+	ck_assert_int_eq(numAllocations - before, 0);
+	findpeaksWorkspaceDestroy(ws);
+}
+END_TEST
+
+// smoothDeriv must match deriv followed by fastsmooth bitwise, for every
+// number of passes and for widths that are odd, even, and wider than half of
+// the array
+START_TEST(test_smooth_deriv_fused)
+{
+	const long lengths[] = {40, 257, NUM_BINS};
+	float a[NUM_BINS], d[NUM_BINS], scratch[NUM_BINS];
+	struct findpeaksWorkspace *ws = findpeaksWorkspaceNew(NUM_BINS,
+							      NUM_PEAKS);
+	ck_assert_ptr_nonnull(ws);
+
+	unsigned int state = 777;
+	for (int i = 0; i < NUM_BINS; i++){
+		a[i] = lcgUniform(&state);
+	}
+	for (int l = 0; l < 3; l++){
+		long length = lengths[l];
+		for (int w = 1; w <= 25; w++){
+			for (int type = 1; type <= 3; type++){
+				deriv(a, d, length);
+				float *ref = fastsmooth(d, scratch, length,
+							(float)w, type);
+				float *fused = smoothDeriv(a, length, (float)w,
+							   type, ws);
+				for (long i = 0; i < length; i++){
+					ck_assert_float_eq(fused[i], ref[i]);
+				}
+			}
+		}
+	}
+	findpeaksWorkspaceDestroy(ws);
+}
+END_TEST
+
+Suite *findpeaks_suite(void)
+{
+	Suite *s = suite_create("findpeaks");
+	TCase *tc_core = tcase_create("Core");
+	tcase_add_test(tc_core, test_findpeaks_harmonics);
+	tcase_add_test(tc_core, test_findpeaks_no_allocations);
+	tcase_add_test(tc_core, test_smooth_deriv_fused);
+	suite_add_tcase(s, tc_core);
+	return s;
+}
+
+int main(void){
+	SRunner *sr = srunner_create(findpeaks_suite());
+
+	srunner_run_all(sr, CK_NORMAL);
+	int number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	if (number_failed == 0){
+		return EXIT_SUCCESS;
+	} else {
+		return EXIT_FAILURE;
+	}
+}
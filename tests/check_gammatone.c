@@ -1,9 +1,13 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
 #include <check.h>
 #include "../src/onset/gammatoneFilter.h"
+#include "../src/onset/filterBank.h"
+#include "../src/onset/gammatoneKernel.h"
 #include "doubleArrayTesting.h"
+#include "testSignals.h"
 
 
 void stepFunction(double **array,int length, double start, double increment,
@@ -41,6 +45,27 @@ void testSOSGammatoneFramework(float centralFreq, int samplerate,
 	free(result);
 }
 
+/* sosGammatoneFast works in single precision, so the input is converted to 
+ * floats and the output is converted back to doubles */
+void testSOSGammatoneFastFramework(float centralFreq, int samplerate,
+				   double *input, int length, double *ref,
+				   double tol, int rel, double abs_zero_tol){
+	float *finput = malloc(sizeof(float)*length);
+	float *fresult = malloc(sizeof(float)*length);
+	double *result = malloc(sizeof(double)*length);
+	for (int i = 0; i < length; i++){
+		finput[i] = (float)input[i];
+	}
+	sosGammatoneFast(finput, fresult, centralFreq, samplerate, length);
+	for (int i = 0; i < length; i++){
+		result[i] = (double)fresult[i];
+	}
+	compareArrayEntries(ref, result, length, tol, rel, abs_zero_tol);
+	free(finput);
+	free(fresult);
+	free(result);
+}
+
 START_TEST(test_sos_coefficients_1)
 {
 	double ref[] = {6.1031107e-02, -1.2118071e-01, 0., 1., -1.5590685e+00,
@@ -136,6 +161,88 @@ START_TEST(test_sos_performance_2)
 }
 END_TEST
 
+START_TEST(test_sos_fast_performance_1)
+{
+	double *impulse_input = calloc(1000,sizeof(double));
+	impulse_input[0] = 1.;
+	int length;
+	double *ref1;
+	length = readDoubleArray(("tests/test_files/gammatone/"
+				  "sos_gammatone_response1"),
+				 isLittleEndian(), &ref1);
+
+	// single precision coefficients make the relative error large where the
+	// response is close to 0, so compare the absolute error instead
+	int rel = 0;
+	double tol = 1.e-5;
+	double abs_zero_tol = 1.e-5;
+
+	testSOSGammatoneFastFramework(1000, 11025, impulse_input, 100,
+				      ref1, tol, rel, abs_zero_tol);
+
+	free(impulse_input);
+	free(ref1);
+}
+END_TEST
+
+START_TEST(test_sos_fast_performance_2)
+{
+	double *input2 = calloc(100,sizeof(double));
+	stepFunction(&input2,100, -2.0, 3.0,17);
+
+	int length;
+	double *ref2;
+	length = readDoubleArray(("tests/test_files/gammatone/"
+				  "sos_gammatone_response2"),
+				 isLittleEndian(), &ref2);
+
+	// single precision coefficients make the relative error large where the
+	// response is close to 0, so compare the absolute error instead
+	int rel = 0;
+	double tol = 1.e-4;
+	double abs_zero_tol = 1.e-5;
+
+	testSOSGammatoneFastFramework(115, 8000, input2, 100,
+				      ref2, tol, rel, abs_zero_tol);
+	free(input2);
+	free(ref2);
+}
+END_TEST
+
+START_TEST(test_sos_fast_matches_cascade)
+{
+	/* the fused kernel should agree with 4 separate passes of the generic 
+	 * biquad filter, including when the state is carried across chunks */
+	int length = 20000;
+	int samplerate = 11025;
+	float centralFreq = 440.f;
+	float coef[24];
+	float cascadeState[8] = {0};
+	float fusedState[8] = {0};
+	float *input = malloc(sizeof(float)*length);
+	float *cascade = malloc(sizeof(float)*length);
+	float *fused = malloc(sizeof(float)*length);
+	twoToneSignal(input, length, samplerate);
+
+	sosCoeff(centralFreq, samplerate, coef);
+	cascadeBiquadfState(4, coef, cascadeState, input, cascade, length);
+	sosGammatoneFastChunk(input, fused, coef, fusedState, 7001);
+	sosGammatoneFastChunk(input + 7001, fused + 7001, coef, fusedState,
+			      length - 7001);
+
+	for (int i = 0; i < length; i++){
+		ck_assert_float_eq_tol(fused[i], cascade[i], 1.e-5f);
+	}
+	for (int i = 0; i < 8; i++){
+		ck_assert_float_eq_tol(fusedState[i], cascadeState[i], 1.e-5f);
+	}
+
+	free(input);
+	free(cascade);
+	free(fused);
+}
+END_TEST
+
 
 int buildInputArray(int *intInput, int intInputLen, int intInputStart,
 		    double *dblInput, int dblInputLen, int dblInputStart,
@@ -363,6 +470,180 @@ START_TEST (check_cascade_biquad_filter_table)
 }
 END_TEST
 
+/* Each entry holds {datalen, lenChannels, overlap}. They cover input that
+ * ends partway through a chunk, input that exactly fills the chunks, and input
+ * shorter than the first chunk. */
+static const int filter_bank_configs[][3] = {
+	{10000, 1024, 256},
+	{1024 + 3*768, 1024, 256},
+	{500, 1024, 256},
+};
+
+START_TEST (check_filter_bank_chunks)
+{
+	int datalen = filter_bank_configs[_i][0];
+	int lenChannels = filter_bank_configs[_i][1];
+	int overlap = filter_bank_configs[_i][2];
+	int samplerate = 11025;
+	int numChannels = 4;
+
+	float *input = malloc(sizeof(float) * datalen);
+	twoToneSignal(input, datalen, samplerate);
+
+	struct filterBank *fB = filterBankNew(numChannels, lenChannels, overlap,
+					      samplerate, 80., 4000.);
+	ck_assert_ptr_nonnull(fB);
+
+	float *ref = malloc(sizeof(float) * numChannels * datalen);
+	for (int c = 0; c < numChannels; c++){
+		sosGammatoneFast(input, ref + c * datalen, fB->cDArray[c].cf,
+				 samplerate, datalen);
+	}
+
+	float *leading = malloc(sizeof(float) * numChannels * lenChannels);
+	float *trailing = malloc(sizeof(float) * numChannels * lenChannels);
+
+	/* feed the chunks, comparing the newly filtered samples of every row
+	 * against the one-shot response */
+	int nsamples = (datalen < lenChannels) ? datalen : lenChannels;
+	filterBankFirstChunk(fB, input, nsamples, &leading);
+	int rowStart = 0, consumed = nsamples;
+	while (1){
+		for (int c = 0; c < numChannels; c++){
+			float *row = leading + c * lenChannels;
+			for (int j = 0; j < lenChannels; j++){
+				int k = rowStart + j;
+				if (k < consumed){
+					ck_assert_float_eq(row[j],
+							   ref[c*datalen + k]);
+				} else {
+					ck_assert_float_eq(row[j], 0.f);
+				}
+			}
+		}
+		if (consumed == datalen){
+			break;
+		}
+		rowStart += lenChannels - overlap;
+		nsamples = lenChannels - overlap;
+		if (consumed + nsamples < datalen){
+			filterBankUpdateChunk(fB, input + consumed, nsamples,
+					      &leading, &trailing);
+		} else {
+			nsamples = datalen - consumed;
+			filterBankFinalChunk(fB, input + consumed, nsamples,
+					     &leading, &trailing);
+		}
+		consumed += nsamples;
+	}
+
+	free(leading);
+	free(trailing);
+	free(ref);
+	free(input);
+	filterBankDestroy(fB);
+}
+END_TEST
+
+/* Each vectorized gammatone filterbank is compared against the scalar kernel
+ * (sosGammatoneFast for the SOS filterbank, apGammatoneChunk for the APGF).
+ * Partial groups of channels and a length that is not a multiple of the tile
+ * size are included. The lanes perform the same operations as the scalar
+ * kernels, so the tolerance only covers fused multiply-adds the compiler may
+ * introduce in the scalar kernels. */
+START_TEST (check_gammatone_bank_simd)
+{
+	enum psmSimdLevel levels[] = {PSM_SIMD_SCALAR, PSM_SIMD_SSE2,
+				      PSM_SIMD_AVX2, PSM_SIMD_NEON};
+	enum gammatoneFilterType filterType = (_i < 4) ? GAMMATONE_SOS :
+		GAMMATONE_APGF;
+	gammatoneBankFunc bankFunc = gammatoneBankGet(levels[_i % 4],
+						      filterType);
+	if (bankFunc == NULL){
+		// the level isn't supported by this build or CPU
+		return;
+	}
+	int lanes = gammatoneBankLanes(levels[_i % 4]);
+	int datalen = 5000 + 37;
+	int samplerate = 11025;
+	int numChannels = 8;
+	float centralFreq[8];
+	centralFreqMapper(numChannels, 80., 4000., centralFreq);
+
+	float *input = malloc(sizeof(float) * datalen);
+	twoToneSignal(input, datalen, samplerate);
+	float *coef = malloc(sizeof(float) * 24 * numChannels);
+	float *ref = malloc(sizeof(float) * datalen * numChannels);
+	float *result = malloc(sizeof(float) * datalen * numChannels);
+	float *outputs[8];
+	for (int c = 0; c < numChannels; c++){
+		if (filterType == GAMMATONE_SOS){
+			sosCoeff(centralFreq[c], samplerate, coef + 24*c);
+			sosGammatoneFast(input, ref + c*datalen, centralFreq[c],
+					 samplerate, datalen);
+		} else {
+			apgfCoeff(centralFreq[c], samplerate, 0, coef + 24*c);
+			apGammatone(input, ref + c*datalen, centralFreq[c],
+				    samplerate, datalen);
+		}
+	}
+
+	/* filter groups of every size up to the number of lanes */
+	for (int groupSize = 1; groupSize <= lanes; groupSize++){
+		for (int first = 0; first < numChannels; first += groupSize){
+			int n = numChannels - first;
+			n = (n < groupSize) ? n : groupSize;
+			for (int c = 0; c < n; c++){
+				outputs[c] = result + (first + c)*datalen;
+			}
+			bankFunc(input, datalen, n, coef + 24*first, outputs);
+		}
+		for (int i = 0; i < datalen * numChannels; i++){
+			ck_assert_float_eq_tol(result[i], ref[i], 1.e-5f);
+		}
+	}
+
+	free(input);
+	free(coef);
+	free(ref);
+	free(result);
+}
+END_TEST
+
+/* The APGF and OZGF are normalized to have 0 dB gain at the central
+ * frequency, so the steady state response to a sinusoid at the central
+ * frequency should have unit amplitude. */
+START_TEST (check_all_pole_gain)
+{
+	float centralFreqs[] = {115.f, 1000.f, 3500.f};
+	int samplerate = 11025;
+	int datalen = samplerate;
+	float *input = malloc(sizeof(float) * datalen);
+	float *output = malloc(sizeof(float) * datalen);
+
+	for (int k = 0; k < 3; k++){
+		float cf = centralFreqs[k];
+		for (int i = 0; i < datalen; i++){
+			input[i] = sinf(2.f * M_PI * cf * i / samplerate);
+		}
+		if (_i == 0){
+			apGammatone(input, output, cf, samplerate, datalen);
+		} else {
+			ozGammatone(input, output, cf, samplerate, datalen);
+		}
+		// the filters have settled by the second half of the output
+		float peak = 0;
+		for (int i = datalen/2; i < datalen; i++){
+			peak = fmaxf(peak, fabsf(output[i]));
+		}
+		ck_assert_float_eq_tol(peak, 1.f, 0.02f);
+	}
+
+	free(input);
+	free(output);
+}
+END_TEST
+
 Suite *gammatone_suite()
 {
 	Suite *s = suite_create("Gammatone");
@@ -370,6 +651,7 @@ Suite *gammatone_suite()
 	TCase *tc_performance = tcase_create("Performance");
 	TCase *tc_biquad = tcase_create("Biquad Filter");
 	TCase *tc_cascadeBiquad = tcase_create("cascadeBiquad");
+	TCase *tc_filterBank = tcase_create("filterBank");
 
 	tcase_add_test(tc_coef,test_sos_coefficients_1);
 	tcase_add_test(tc_coef,test_sos_coefficients_2);
@@ -377,6 +659,9 @@ Suite *gammatone_suite()
 
 	tcase_add_test(tc_performance,test_sos_performance_1);
 	tcase_add_test(tc_performance,test_sos_performance_2);
+	tcase_add_test(tc_performance,test_sos_fast_performance_1);
+	tcase_add_test(tc_performance,test_sos_fast_performance_2);
+	tcase_add_test(tc_performance,test_sos_fast_matches_cascade);
 
 	if (isLittleEndian() == 1){
 		tcase_add_loop_test(tc_biquad,check_biquad_filter_table,0,
@@ -394,6 +679,11 @@ Suite *gammatone_suite()
 	
 	suite_add_tcase(s, tc_coef);
 	suite_add_tcase(s, tc_performance);
+
+	tcase_add_loop_test(tc_filterBank, check_filter_bank_chunks, 0, 3);
+	tcase_add_loop_test(tc_filterBank, check_gammatone_bank_simd, 0, 8);
+	tcase_add_loop_test(tc_filterBank, check_all_pole_gain, 0, 2);
+	suite_add_tcase(s, tc_filterBank);
 	return s;
 }
 
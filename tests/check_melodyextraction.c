@@ -0,0 +1,225 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <check.h>
+#include "../src/melodyextraction.h"
+
+#define SAMPLERATE 11025
+// the segment length of the streams, in ms
+#define STREAM_SEGMENT 14000
+
+// The frequencies, durations (in ms) and amplitudes of the parts of the test
+// signals. An amplitude of 0 is silence.
+struct signalPart{
+	float freq;
+	int ms;
+	float amp;
+};
+
+// tones separated by silences, which are shorter than a segment
+static const struct signalPart separated[] = {
+	{0.f, 500, 0.f}, {440.f, 800, 1.f}, {0.f, 1200, 0.f},
+	{523.25f, 800, 1.f}, {0.f, 1200, 0.f}, {659.26f, 800, 1.f},
+	{0.f, 1500, 0.f}, {392.f, 1000, 1.f}, {0.f, 1000, 0.f},
+	{493.88f, 800, 1.f}, {0.f, 1200, 0.f}, {587.33f, 800, 1.f},
+	{0.f, 1500, 0.f}, {440.f, 1000, 1.f}, {0.f, 1200, 0.f},
+	{349.23f, 800, 1.f}, {0.f, 1300, 0.f}, {523.25f, 800, 1.f},
+	{0.f, 2000, 0.f},
+};
+// tones separated by the same tones at 2% of the amplitude, which the silence
+// detection doesn't consider silent, so that the stream has to split the
+// buffer between two notes
+#define QUIET_TONE(f) {f, 800, 1.f}, {f, 400, 0.02f}
+static const struct signalPart continuous[] = {
+	{0.f, 500, 0.f},
+	QUIET_TONE(392.f), QUIET_TONE(493.88f), QUIET_TONE(587.33f),
+	QUIET_TONE(440.f), QUIET_TONE(523.25f), QUIET_TONE(349.23f),
+	QUIET_TONE(392.f), QUIET_TONE(493.88f), QUIET_TONE(587.33f),
+	QUIET_TONE(440.f), QUIET_TONE(523.25f), QUIET_TONE(349.23f),
+	QUIET_TONE(392.f), QUIET_TONE(493.88f),
+	{0.f, 1000, 0.f},
+};
+
+// Allocates and fills the signal made of numParts parts and returns the
+// number of frames
+static int partsSignal(const struct signalPart* parts, int numParts,
+		       float** x)
+{
+	int length = 0;
+	for (int p = 0; p < numParts; p++){
+		length += parts[p].ms * SAMPLERATE / 1000;
+	}
+	(*x) = malloc(sizeof(float) * length);
+	ck_assert_ptr_nonnull(*x);
+	float* y = *x;
+	for (int p = 0; p < numParts; p++){
+		int n = parts[p].ms * SAMPLERATE / 1000;
+		for (int i = 0; i < n; i++){
+			float t = (float)i / SAMPLERATE;
+			y[i] = parts[p].amp
+				* (0.5f * sinf(2.f * M_PI * parts[p].freq * t)
+				   + 0.25f * sinf(4.f * M_PI * parts[p].freq
+						  * t));
+		}
+		y += n;
+	}
+	return length;
+}
+
+static struct me_data* streamData(void)
+{
+	audioInfo info = {0, SAMPLERATE};
+	struct me_settings* settings = me_settings_new();
+	char segment[16];
+	snprintf(segment, sizeof(segment), "%dms", STREAM_SEGMENT);
+	settings->stream_segment = strdup(segment);
+	struct me_data* inst = NULL;
+	ck_assert_str_eq(me_data_init(&inst, settings, info), "");
+	me_settings_free(settings);
+	return inst;
+}
+
+// Streams x in chunks of chunkSize frames (single frames for the first
+// second, if chunkSize is 1) and returns the midi
+static struct Midi* streamMidi(struct me_data* inst, float* x, int length,
+			       int chunkSize)
+{
+	struct me_stream* stream = me_stream_open(inst, SAMPLERATE);
+	ck_assert_ptr_nonnull(stream);
+	int i = 0;
+	if (chunkSize == 1){
+		for (; i < SAMPLERATE; i++){
+			ck_assert_int_ne(me_stream_push(stream, x + i, 1), -1);
+		}
+		chunkSize = length;
+	}
+	for (; i < length; i += chunkSize){
+		int count = (length - i < chunkSize) ? length - i : chunkSize;
+		ck_assert_int_ne(me_stream_push(stream, x + i, count), -1);
+	}
+	return me_stream_finish(stream);
+}
+
+// Decodes the note on and note off events of the track of midi into the
+// absolute time (in ticks) and the midi value of each event. Returns the
+// number of events
+static int midiEvents(struct Midi* midi, int* ticks, int* values,
+		      int capacity)
+{
+	ck_assert_ptr_nonnull(midi);
+	ck_assert_int_eq(midi->numTracks, 1);
+	const unsigned char* data = midi->tracks[0]->data;
+	int len = midi->tracks[0]->len;
+	int n = 0, time = 0, i = 0;
+	while (i < len){
+		int delta = 0;
+		do {
+			delta = (delta << 7) | (data[i] & 0x7f);
+		} while (data[i++] & 0x80);
+		time += delta;
+		if (data[i] == 0xff){
+			// end of track
+			break;
+		}
+		ck_assert_int_lt(n, capacity);
+		ticks[n] = time;
+		values[n] = data[i+1];
+		n++;
+		i += 3;
+	}
+	return n;
+}
+
+#define MAX_EVENTS 64
+// the tolerance of the note boundaries, in ticks (of about 10ms). It applies
+// to every note, including the notes next to the splits of a stream
+#define TICK_TOL 2
+
+// Checks that the notes of a and b have the same pitches and about the same
+// boundaries
+static void assertNotesEqual(struct Midi* a, struct Midi* b)
+{
+	int aTicks[MAX_EVENTS], aValues[MAX_EVENTS];
+	int bTicks[MAX_EVENTS], bValues[MAX_EVENTS];
+	int aSize = midiEvents(a, aTicks, aValues, MAX_EVENTS);
+	int bSize = midiEvents(b, bTicks, bValues, MAX_EVENTS);
+	ck_assert_int_gt(aSize, 0);
+	ck_assert_int_eq(aSize, bSize);
+	for (int i = 0; i < aSize && i < bSize; i++){
+		ck_assert_int_eq(aValues[i], bValues[i]);
+		ck_assert_int_le(abs(aTicks[i] - bTicks[i]), TICK_TOL);
+	}
+}
+
+static const int chunkSizes[] = {1, 160, 4093};
+
+START_TEST (check_stream_separated_tones)
+{
+	// the stream finds the notes of the extraction of the whole signal. The
+	// window grids of the segments are offset from the grid of the whole
+	// signal, so the boundaries of the notes may differ slightly
+	float* x = NULL;
+	int length = partsSignal(separated, sizeof(separated)
+				 / sizeof(separated[0]), &x);
+	audioInfo info = {length, SAMPLERATE};
+	struct me_data* inst = streamData();
+
+	struct Midi* whole = me_process(&x, info, inst);
+	struct Midi* streamed = streamMidi(inst, x, length, chunkSizes[_i]);
+	assertNotesEqual(streamed, whole);
+
+	freeMidi(whole);
+	freeMidi(streamed);
+	me_data_free(inst);
+	free(x);
+}
+END_TEST
+
+START_TEST (check_stream_continuous_tones)
+{
+	// the segments hold no silence, so the buffer is split between the
+	// last two notes it holds. The note preceding the split and the note
+	// following it must both be found, with the same boundaries as in the
+	// extraction of the whole signal (within TICK_TOL)
+	float* x = NULL;
+	int length = partsSignal(continuous, sizeof(continuous)
+				 / sizeof(continuous[0]), &x);
+	audioInfo info = {length, SAMPLERATE};
+	struct me_data* inst = streamData();
+
+	struct Midi* whole = me_process(&x, info, inst);
+	struct Midi* streamed = streamMidi(inst, x, length, chunkSizes[_i]);
+	assertNotesEqual(streamed, whole);
+
+	freeMidi(whole);
+	freeMidi(streamed);
+	me_data_free(inst);
+	free(x);
+}
+END_TEST
+
+Suite *melodyextraction_suite(void)
+{
+	Suite *s = suite_create("melodyextraction");
+	TCase *tc_stream = tcase_create("me_stream");
+	tcase_add_loop_test(tc_stream, check_stream_separated_tones, 0, 3);
+	tcase_add_loop_test(tc_stream, check_stream_continuous_tones, 0, 3);
+	tcase_set_timeout(tc_stream, 120);
+	suite_add_tcase(s, tc_stream);
+	return s;
+}
+
+int main(void){
+	Suite *s = melodyextraction_suite();
+	SRunner *sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_NORMAL);
+	int number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	if (number_failed == 0){
+		return EXIT_SUCCESS;
+	} else {
+		return EXIT_FAILURE;
+	}
+}
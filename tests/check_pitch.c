@@ -0,0 +1,444 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <float.h>
+#include <check.h>
+#include "../src/extractMelodyProcedure.h"
+#include "../src/fftPlanCache.h"
+#include "../src/stft.h"
+#include "../src/pitch/pitchStrat.h"
+#include "../src/pitch/candidateSelection.h"
+#include "../src/pitch/findCandidates.h"
+#include "testSignals.h"
+
+#define SAMPLERATE 11025
+
+// Each pair of entries is the first sample and the sample following one of
+// the tones of gappySignal. The second and third tones are separated by a
+// gap shorter than a window, so their blocks are analyzed together.
+static int tones[] = {3000, 14000, 20000, 31000, 31500, 40000};
+#define NUM_TONES 3
+#define GAPPY_LENGTH 50000
+
+// Fills x with tones of increasing frequency separated by exact silence
+static void gappySignal(float* x)
+{
+	for (int i = 0; i < GAPPY_LENGTH; i++){
+		x[i] = 0.f;
+	}
+	for (int t = 0; t < NUM_TONES; t++){
+		float f = 220.f * (t + 1);
+		for (int i = tones[2*t]; i < tones[2*t+1]; i++){
+			x[i] = (sinf(2.f * M_PI * f * i / SAMPLERATE)
+				+ 0.5f * sinf(4.f * M_PI * f * i / SAMPLERATE));
+		}
+	}
+}
+
+START_TEST (check_voiced_pitch_matches_full)
+{
+	int unpaddedSize = 1024, winSize = 1024, interval = 512;
+	audioInfo info = {GAPPY_LENGTH, SAMPLERATE};
+	int numBlocks = NumSTFTBlocks(info, unpaddedSize, interval);
+	float* input = malloc(sizeof(float) * GAPPY_LENGTH);
+	float* full = malloc(sizeof(float) * numBlocks);
+	float* voiced = malloc(sizeof(float) * numBlocks);
+	gappySignal(input);
+
+	ck_assert_int_eq(ExtractPitch(input, full, info, unpaddedSize,
+				      winSize, interval, &HPSDetectionStrategy,
+				      1, 1, 0, NULL), numBlocks);
+	ck_assert_int_eq(ExtractVoicedPitch(input, voiced, info, unpaddedSize,
+					    winSize, interval,
+					    &HPSDetectionStrategy, 1, 1,
+					    tones, 2 * NUM_TONES, 0),
+			 numBlocks);
+
+	// HPS analyzes every block independently, so the voiced blocks get the
+	// same pitches as in the full extraction
+	for (int i = 0; i < numBlocks; i++){
+		int start = i * interval, stop = start + unpaddedSize;
+		int overlaps = 0;
+		for (int t = 0; t < NUM_TONES; t++){
+			overlaps |= (start < tones[2*t+1] && tones[2*t] < stop);
+		}
+		if (overlaps){
+			ck_assert_float_eq(voiced[i], full[i]);
+		} else {
+			ck_assert_float_eq(voiced[i], 0.f);
+		}
+	}
+
+	// every range of blocks is transformed with the same cached plans
+	int size = fftPlanCacheSize();
+	int shifted[2 * NUM_TONES];
+	for (int t = 0; t < 2 * NUM_TONES; t++){
+		shifted[t] = tones[t] + 3 * interval;
+	}
+	ExtractVoicedPitch(input, voiced, info, unpaddedSize, winSize,
+			   interval, &HPSDetectionStrategy, 1, 1, shifted,
+			   2 * NUM_TONES, 0);
+	ck_assert_int_eq(fftPlanCacheSize(), size);
+
+	free(input);
+	free(full);
+	free(voiced);
+}
+END_TEST
+
+/* Checks that BaNa finds the same pitches when the frames are distributed
+ * among several threads. gappySignal holds enough blocks for every thread to
+ * claim some of them, and its silent blocks have no candidates. */
+START_TEST (check_bana_threads_match_serial)
+{
+	PitchStrategyFunc strategies[] = {&BaNaDetectionStrategy,
+					  &BaNaMusicDetectionStrategy};
+	int unpaddedSize = 1024, winSize = 2048, interval = 256;
+	audioInfo info = {GAPPY_LENGTH, SAMPLERATE};
+	int numBlocks = NumSTFTBlocks(info, unpaddedSize, interval);
+	float* input = malloc(sizeof(float) * GAPPY_LENGTH);
+	float* serial = malloc(sizeof(float) * numBlocks);
+	float* parallel = malloc(sizeof(float) * numBlocks);
+	gappySignal(input);
+
+	ck_assert_int_eq(ExtractPitch(input, serial, info, unpaddedSize,
+				      winSize, interval, strategies[_i], 1, 1,
+				      0, NULL), numBlocks);
+	for (int numThreads = 2; numThreads <= 5; numThreads++){
+		ck_assert_int_eq(ExtractPitch(input, parallel, info,
+					      unpaddedSize, winSize, interval,
+					      strategies[_i], 1, numThreads, 0,
+					      NULL), numBlocks);
+		for (int i = 0; i < numBlocks; i++){
+			ck_assert_float_eq(parallel[i], serial[i]);
+		}
+	}
+
+	free(input);
+	free(serial);
+	free(parallel);
+}
+END_TEST
+
+/* The lowest cost path through frames start to final of lattice, computed
+ * with a plain scan over every pair of candidates. Equal costs are resolved
+ * in favor of the lower index, like candidateSelection. */
+static void referenceSelection(struct candidateLattice *lattice, long start,
+			       long final, float *fundamentals)
+{
+	long *offsets = lattice->offsets;
+	for (long c = offsets[start]; c < offsets[start + 1]; c++){
+		lattice->cost[c] = 0;
+	}
+	for (long frame = start + 1; frame <= final; frame++){
+		for (long c = offsets[frame]; c < offsets[frame + 1]; c++){
+			float minCost = FLT_MAX;
+			int argmin = -1;
+			for (long p = offsets[frame - 1]; p < offsets[frame]; p++){
+				float exitCost = lattice->cost[p]
+					+ (0.4f * lattice->invConfidence[p]);
+				float total = exitCost + fabsf(lattice->log2Freq[p]
+							       - lattice->log2Freq[c]);
+				if (total < minCost){
+					minCost = total;
+					argmin = (int)(p - offsets[frame - 1]);
+				}
+			}
+			lattice->cost[c] = minCost;
+			lattice->backpointer[c] = argmin;
+		}
+	}
+	int index = -1;
+	float minCost = FLT_MAX;
+	for (long c = offsets[final]; c < offsets[final + 1]; c++){
+		if (lattice->cost[c] < minCost){
+			minCost = lattice->cost[c];
+			index = (int)(c - offsets[final]);
+		}
+	}
+	for (long frame = final; frame >= start; frame--){
+		fundamentals[frame] = lattice->frequency[offsets[frame] + index];
+		index = lattice->backpointer[offsets[frame] + index];
+	}
+}
+
+/* Checks candidateSelection against referenceSelection on random lattices.
+ * The frequencies are powers of 2 and the confidences are 1, 2 or 4, so the
+ * costs are exact and paths of equal cost are common. The frames hold up to
+ * 11 candidates, which covers both the vector and the scalar part of the
+ * transition search, and empty frames split the lattice into segments. */
+START_TEST (check_candidate_selection_random)
+{
+	unsigned int state = 4099u + 17u * _i;
+	for (int trial = 0; trial < 200; trial++){
+		long length = 2 + trial % 37;
+		distinctList **windowList = malloc(sizeof(distinctList*)
+						   * length);
+		for (long f = 0; f < length; f++){
+			windowList[f] = distinctListCreate(12);
+			int width = (lcgNext(&state) >> 16) % 12;
+			for (int c = 0; c < width; c++){
+				int octave = (lcgNext(&state) >> 16) % 6;
+				float freq = ldexpf(1.f, 5 + octave);
+				int confidence = 1 << ((lcgNext(&state) >> 16) % 3);
+				distinctListAppend(windowList[f],
+						   (struct distinctCandidate){
+							   freq, confidence,
+							   0., -1});
+			}
+		}
+
+		float *fundamentals = malloc(sizeof(float) * length);
+		float *expected = malloc(sizeof(float) * length);
+		ck_assert_int_eq(candidateSelection(windowList, length,
+						    fundamentals), 1);
+
+		struct candidateLattice *lattice =
+			candidateLatticeCreate(windowList, length);
+		ck_assert_ptr_nonnull(lattice);
+		long start = -1;
+		for (long f = 0; f <= length; f++){
+			int width = (f < length) ? windowList[f]->length : 0;
+			if (width != 0 && start == -1){
+				start = f;
+			} else if (width == 0 && start != -1){
+				if (f - 1 == start){
+					expected[start] = lattice->frequency[
+						lattice->offsets[start]];
+				} else {
+					referenceSelection(lattice, start,
+							   f - 1, expected);
+				}
+				start = -1;
+			}
+			if (f < length && width == 0){
+				expected[f] = 0.f;
+			}
+		}
+		for (long f = 0; f < length; f++){
+			ck_assert_float_eq(fundamentals[f], expected[f]);
+		}
+
+		candidateLatticeDestroy(lattice);
+		for (long f = 0; f < length; f++){
+			distinctListDestroy(windowList[f]);
+		}
+		free(windowList);
+		free(fundamentals);
+		free(expected);
+	}
+}
+END_TEST
+
+/* The distinct candidates of the n sorted candidates in a, found by
+ * recomputing the confidence of every remaining candidate after each pick.
+ * Returns the number of distinct candidates written to freq and
+ * confidence. */
+static int referenceDistinct(float *a, int n, float xi, float f0Min,
+			     float f0Max, float *freq, int *confidence)
+{
+	int *conf = malloc(sizeof(int) * (n + 1));
+	int numDistinct = 0;
+	while (n > 0){
+		for (int i = 0; i < n; i++){
+			conf[i] = 1;
+		}
+		for (int i = 0; i < n - 1; i++){
+			for (int j = i + 1; j < n && (a[j] - a[i]) <= xi; j++){
+				conf[i]++;
+				conf[j]++;
+			}
+		}
+		// ties are broken in favor of the lower frequency
+		int maxIndex = 0;
+		for (int i = 1; i < n; i++){
+			if (conf[i] > conf[maxIndex]){
+				maxIndex = i;
+			}
+		}
+		if (a[maxIndex] >= f0Min && a[maxIndex] <= f0Max){
+			freq[numDistinct] = a[maxIndex];
+			confidence[numDistinct] = conf[maxIndex];
+			numDistinct++;
+		}
+		int first = maxIndex, last = maxIndex;
+		while (first > 0 && (a[maxIndex] - a[first - 1]) <= xi){
+			first--;
+		}
+		while (last < n - 1 && (a[last + 1] - a[maxIndex]) <= xi){
+			last++;
+		}
+		for (int i = last + 1; i < n; i++){
+			a[i - (last + 1 - first)] = a[i];
+		}
+		n -= last + 1 - first;
+	}
+	free(conf);
+	return numDistinct;
+}
+
+/* Checks distinctCandidates against referenceDistinct on random sorted
+ * lists. The candidates lie on a grid of 0.25 Hz and xi is a multiple of
+ * the grid, so candidates at a distance of exactly xi and equal
+ * confidences are common. */
+START_TEST (check_distinct_candidates_random)
+{
+	float a[64], copy[64], freq[64];
+	int confidence[64];
+	unsigned int state = 8191u;
+	for (int trial = 0; trial < 20000; trial++){
+		int n = (lcgNext(&state) >> 16) % 64;
+		float xi = 0.25f * (1 + (lcgNext(&state) >> 16) % 12);
+		float value = 40.f;
+		for (int i = 0; i < n; i++){
+			value += 0.25f * ((lcgNext(&state) >> 16) % 8);
+			a[i] = value;
+			copy[i] = value;
+		}
+		float f0Min = 42.f, f0Max = 60.f;
+
+		struct orderedList candidates = orderedListCreate(64);
+		for (int i = 0; i < n; i++){
+			candidates.array[i] = a[i];
+		}
+		candidates.length = n;
+		distinctList *distinct = distinctCandidates(&candidates,
+							    n + 2, xi, f0Min,
+							    f0Max);
+		ck_assert_ptr_nonnull(distinct);
+		int numDistinct = referenceDistinct(copy, n, xi, f0Min, f0Max,
+						    freq, confidence);
+		ck_assert_int_eq(distinct->length, numDistinct);
+		for (int i = 0; i < numDistinct && i < distinct->length; i++){
+			ck_assert_float_eq(distinct->array[i].frequency,
+					   freq[i]);
+			ck_assert_int_eq(distinct->array[i].confidence,
+					 confidence[i]);
+		}
+		ck_assert_int_eq(candidates.length, 0);
+
+		distinctListDestroy(distinct);
+		orderedListDestroy(candidates);
+	}
+}
+END_TEST
+
+// the tables of calcM
+static float ratioRanges[15] = {1.15f, 1.29f, 1.42f, 1.59f, 1.8f, 1.9f, 2.1f,
+				2.4f, 2.6f, 2.8f, 3.2f, 3.8f, 4.2f, 4.8f,
+				5.2f};
+static float mRanges[15] = {4, 3, 2, 3, -1, 1, -1, 2, -1, 1, -1, 1, -1, 1,
+			    -1};
+
+/* The candidates of calcCandidates, found by bisecting ratioRanges for m
+ * and inserting each candidate into its sorted position */
+static void referenceCandidates(float *peaks, int numPeaks, float lowestPeak,
+				struct orderedList *candidates)
+{
+	candidates->length = 0;
+	for (int i = 0; i < numPeaks - 1; i++){
+		for (int j = i + 1; j < numPeaks; j++){
+			int k = bisectLeft(ratioRanges, peaks[j] / peaks[i], 0,
+					   15);
+			float m = (k == 0) ? -1.f : mRanges[k - 1];
+			if (m > 0){
+				orderedListInsert(candidates, peaks[i] / m);
+			}
+		}
+	}
+	orderedListInsert(candidates, lowestPeak);
+}
+
+/* Checks calcCandidates against referenceCandidates on random peaks. Up to
+ * 8 peaks are used, so that the number of candidates ranges from 1 to 29
+ * and is sorted by the sorting network as well as by qsort. Every other
+ * trial places the peaks at the lowest peak times entries of ratioRanges,
+ * so that their ratios lie exactly on the boundaries of the ranges of m. */
+START_TEST (check_calc_candidates_random)
+{
+	float peaks[8];
+	int maxPeaks = 8;
+	int capacity = calcCandidatesCapacity(maxPeaks);
+	struct orderedList candidates = orderedListCreate(capacity);
+	struct orderedList expected = orderedListCreate(capacity);
+	unsigned int state = 65537u;
+	for (int trial = 0; trial < 20000; trial++){
+		int numPeaks = (lcgNext(&state) >> 16) % (maxPeaks + 1);
+		float f = 64.f;
+		for (int i = 0; i < numPeaks; i++){
+			lcgNext(&state);
+			if (trial % 2 == 0){
+				peaks[i] = (i == 0) ? f
+					: f * ratioRanges[(state >> 16) % 15];
+			} else {
+				f += 1.f + (float)((state >> 16) % 4000) / 10.f;
+				peaks[i] = f;
+			}
+		}
+		if (trial % 2 == 0){
+			// multiples of the lowest peak, in increasing order
+			for (int i = 1; i < numPeaks; i++){
+				for (int j = i; j > 1 && peaks[j] < peaks[j-1]; j--){
+					float temp = peaks[j];
+					peaks[j] = peaks[j-1];
+					peaks[j-1] = temp;
+				}
+			}
+		}
+		float lowestPeak = (numPeaks > 0) ? peaks[0] : 50.f;
+
+		calcCandidates(peaks, numPeaks, lowestPeak, &candidates);
+		referenceCandidates(peaks, numPeaks, lowestPeak, &expected);
+		ck_assert_int_eq(candidates.length, expected.length);
+		for (int i = 0; i < expected.length && i < candidates.length;
+		     i++){
+			ck_assert_float_eq(candidates.array[i],
+					   expected.array[i]);
+		}
+	}
+	orderedListDestroy(candidates);
+	orderedListDestroy(expected);
+}
+END_TEST
+
+Suite *pitch_suite(void)
+{
+	Suite *s = suite_create("pitch");
+	TCase *tc_voiced = tcase_create("ExtractVoicedPitch");
+	tcase_add_test(tc_voiced, check_voiced_pitch_matches_full);
+	tcase_set_timeout(tc_voiced, 60);
+	suite_add_tcase(s, tc_voiced);
+
+	TCase *tc_threads = tcase_create("BaNa threads");
+	tcase_add_loop_test(tc_threads, check_bana_threads_match_serial, 0, 2);
+	tcase_set_timeout(tc_threads, 60);
+	suite_add_tcase(s, tc_threads);
+
+	TCase *tc_selection = tcase_create("candidateSelection");
+	tcase_add_loop_test(tc_selection, check_candidate_selection_random, 0,
+			    4);
+	suite_add_tcase(s, tc_selection);
+
+	TCase *tc_distinct = tcase_create("distinctCandidates");
+	tcase_add_test(tc_distinct, check_distinct_candidates_random);
+	suite_add_tcase(s, tc_distinct);
+
+	TCase *tc_candidates = tcase_create("calcCandidates");
+	tcase_add_test(tc_candidates, check_calc_candidates_random);
+	suite_add_tcase(s, tc_candidates);
+	return s;
+}
+
+int main(void){
+	Suite *s = pitch_suite();
+	SRunner *sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_NORMAL);
+	int number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	if (number_failed == 0){
+		return EXIT_SUCCESS;
+	} else {
+		return EXIT_FAILURE;
+	}
+}
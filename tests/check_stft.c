@@ -0,0 +1,296 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <check.h>
+#include "../src/stft.h"
+#include "../src/fftPlanCache.h"
+#include "testSignals.h"
+
+/* Reference implementation of STFT_r2c, which plans and executes one
+ * transform per block and copies the results out. */
+int referenceSTFT(float* input, audioInfo info, int unpaddedSize, int winSize,
+		  int interval, fftwf_complex** fft_data)
+{
+	int numBlocks = NumSTFTBlocks(info, unpaddedSize, interval);
+	int realWinSize = winSize/2;
+	(*fft_data) = malloc(sizeof(fftwf_complex) * numBlocks * realWinSize);
+	float* fftw_in = fftwf_malloc(sizeof(float) * winSize);
+	fftwf_complex* fftw_out = fftwf_malloc(sizeof(fftwf_complex) * winSize);
+	fftwf_plan plan = fftwf_plan_dft_r2c_1d(winSize, fftw_in, fftw_out,
+						FFTW_ESTIMATE);
+	float* window = WindowFunction(winSize);
+
+	for (int i = 0; i < numBlocks; i++){
+		int blockoffset = i*interval;
+		for (int j = 0; j < winSize; j++){
+			if (j < unpaddedSize && blockoffset + j < info.frames){
+				fftw_in[j] = input[blockoffset + j] * window[j];
+			} else {
+				fftw_in[j] = 0.0;
+			}
+		}
+		fftwf_execute(plan);
+		for (int j = 0; j < realWinSize; j++){
+			(*fft_data)[i*realWinSize + j][0] = fftw_out[j][0];
+			(*fft_data)[i*realWinSize + j][1] = fftw_out[j][1];
+		}
+	}
+
+	free(window);
+	fftwf_destroy_plan(plan);
+	fftwf_free(fftw_in);
+	fftwf_free(fftw_out);
+	return numBlocks * realWinSize;
+}
+
+/* Each entry holds {frames, unpaddedSize, winSize, interval}. They cover
+ * several full batches plus a remainder, an odd number of blocks, a single
+ * batch, zero padding and input shorter than the window. */
+static const int stft_configs[][4] = {
+	{154000, 1024, 1024, 256},
+	{23541, 300, 512, 128},
+	{120, 48, 64, 16},
+	{40, 48, 64, 16},
+};
+
+START_TEST (check_stft_r2c_batched)
+{
+	audioInfo info = {stft_configs[_i][0], 11025};
+	int unpaddedSize = stft_configs[_i][1];
+	int winSize = stft_configs[_i][2];
+	int interval = stft_configs[_i][3];
+
+	float* input = malloc(sizeof(float) * info.frames);
+	twoToneSignal(input, info.frames, 11025.f);
+	for (int i = 0; i < info.frames; i++){
+		input[i] += 0.25f * cosf(0.001f * i);
+	}
+
+	fftwf_complex *ref = NULL, *batched = NULL;
+	int refSize = referenceSTFT(input, info, unpaddedSize, winSize,
+				    interval, &ref);
+	int batchedSize = STFT_r2c(&input, info, unpaddedSize, winSize,
+				   interval, &batched);
+	ck_assert_int_eq(batchedSize, refSize);
+
+	for (int i = 0; i < refSize; i++){
+		// the bins have magnitudes up to ~unpaddedSize/2
+		ck_assert_float_eq_tol(batched[i][0], ref[i][0], 1.e-3f);
+		ck_assert_float_eq_tol(batched[i][1], ref[i][1], 1.e-3f);
+	}
+
+	free(ref);
+	free(batched);
+	free(input);
+}
+END_TEST
+
+START_TEST (check_stft_magnitude)
+{
+	audioInfo info = {stft_configs[_i][0], 11025};
+	int unpaddedSize = stft_configs[_i][1];
+	int winSize = stft_configs[_i][2];
+	int interval = stft_configs[_i][3];
+
+	float* input = malloc(sizeof(float) * info.frames);
+	twoToneSignal(input, info.frames, 11025.f);
+	for (int i = 0; i < info.frames; i++){
+		input[i] += 0.25f * cosf(0.001f * i);
+	}
+
+	fftwf_complex *ref = NULL;
+	float *spectrum = NULL;
+	int refSize = referenceSTFT(input, info, unpaddedSize, winSize,
+				    interval, &ref);
+	int size = STFT_magnitude(&input, info, unpaddedSize, winSize,
+				  interval, &spectrum);
+	ck_assert_int_eq(size, refSize);
+
+	for (int i = 0; i < refSize; i++){
+		ck_assert_float_eq_tol(spectrum[i], hypot(ref[i][0], ref[i][1]),
+				       1.e-3f);
+	}
+
+	free(ref);
+	free(spectrum);
+	free(input);
+}
+END_TEST
+
+START_TEST (check_stft_magnitude_blocks)
+{
+	// a range of blocks in the middle of the spectrogram (straddling a
+	// batch boundary) and a range that ends with the final block
+	audioInfo info = {154000, 11025};
+	float* input = malloc(sizeof(float) * info.frames);
+	for (int i = 0; i < info.frames; i++){
+		input[i] = sinf(2.f * M_PI * 440.f * i / 11025.f);
+	}
+
+	float *spectrum = NULL, *middle = NULL, *end = NULL;
+	int size = STFT_magnitude(&input, info, 1024, 1024, 256, &spectrum);
+	int numBlocks = NumSTFTBlocks(info, 1024, 256);
+	int middleSize = STFT_magnitudeBlocks(&input, info, 1024, 1024, 256,
+					      200, 300, &middle);
+	int endSize = STFT_magnitudeBlocks(&input, info, 1024, 1024, 256,
+					   numBlocks - 5, 5, &end);
+	ck_assert_int_eq(size, numBlocks * 512);
+	ck_assert_int_eq(middleSize, 300 * 512);
+	ck_assert_int_eq(endSize, 5 * 512);
+
+	for (int i = 0; i < middleSize; i++){
+		ck_assert_float_eq_tol(middle[i], spectrum[200 * 512 + i], 1.e-3f);
+	}
+	for (int i = 0; i < endSize; i++){
+		ck_assert_float_eq_tol(end[i], spectrum[(numBlocks - 5) * 512 + i],
+				       1.e-3f);
+	}
+
+	free(spectrum);
+	free(middle);
+	free(end);
+	free(input);
+}
+END_TEST
+
+START_TEST (check_plan_cache_reuse)
+{
+	float* in = fftwf_malloc(sizeof(float) * 512);
+	fftwf_complex* out = fftwf_malloc(sizeof(fftwf_complex) * 257);
+
+	fftwf_plan first = fftPlanCacheR2C(512, 1, 512, 257, in, out);
+	fftwf_plan second = fftPlanCacheR2C(512, 1, 512, 257, in, out);
+	ck_assert_ptr_nonnull(first);
+	ck_assert_ptr_eq(first, second);
+
+	// a different direction or size gets its own plan
+	fftwf_plan inverse = fftPlanCacheC2R(512, 1, 257, 512, out, in);
+	fftwf_plan larger = fftPlanCacheR2C(1024, 1, 1024, 513, in, out);
+	ck_assert_ptr_nonnull(inverse);
+	ck_assert_ptr_nonnull(larger);
+	ck_assert_ptr_ne(first, inverse);
+	ck_assert_ptr_ne(first, larger);
+
+	fftwf_free(in);
+	fftwf_free(out);
+}
+END_TEST
+
+START_TEST (check_stft_r2c_cached_plans)
+{
+	// the second call reuses the plans cached by the first call, but is
+	// executed on newly allocated arrays
+	audioInfo info = {23541, 11025};
+	float* input = malloc(sizeof(float) * info.frames);
+	for (int i = 0; i < info.frames; i++){
+		input[i] = sinf(2.f * M_PI * 440.f * i / 11025.f);
+	}
+
+	fftwf_complex *first = NULL, *second = NULL;
+	int firstSize = STFT_r2c(&input, info, 512, 512, 256, &first);
+	int secondSize = STFT_r2c(&input, info, 512, 512, 256, &second);
+	ck_assert_int_eq(firstSize, secondSize);
+	for (int i = 0; i < firstSize; i++){
+		ck_assert_float_eq(first[i][0], second[i][0]);
+		ck_assert_float_eq(first[i][1], second[i][1]);
+	}
+
+	free(first);
+	free(second);
+	free(input);
+}
+END_TEST
+
+START_TEST (check_plan_cache_bounded)
+{
+	// the plans only depend on the window size, so inputs of new lengths
+	// (with and without full batches) don't add plans to the cache
+	audioInfo info = {0, 11025};
+	float* input = malloc(sizeof(float) * 90000);
+	for (int i = 0; i < 90000; i++){
+		input[i] = sinf(2.f * M_PI * 440.f * i / 11025.f);
+	}
+
+	int size = 0;
+	for (int pass = 0; pass < 2; pass++){
+		for (int length = 100 + 3001 * pass; length < 90000;
+		     length += 7919){
+			fftwf_complex *fft_data = NULL;
+			float *spectrum = NULL;
+			info.frames = length;
+			ck_assert_int_gt(STFT_r2c(&input, info, 2048, 2048, 512,
+						  &fft_data), 0);
+			ck_assert_int_gt(STFT_magnitude(&input, info, 2048, 2048,
+							512, &spectrum), 0);
+			free(fft_data);
+			free(spectrum);
+		}
+		if (pass == 0){
+			size = fftPlanCacheSize();
+		}
+	}
+	ck_assert_int_eq(fftPlanCacheSize(), size);
+
+	free(input);
+}
+END_TEST
+
+START_TEST (check_plan_cache_export_wisdom)
+{
+	const char* path = "check_stft_wisdom";
+	float* in = fftwf_malloc(sizeof(float) * 96);
+	fftwf_complex* out = fftwf_malloc(sizeof(fftwf_complex) * 49);
+
+	// measuring a new plan makes the export write the file
+	remove(path);
+	ck_assert_ptr_nonnull(fftPlanCacheR2C(96, 1, 96, 49, in, out));
+	ck_assert_int_eq(fftPlanCacheExportWisdom(path), 1);
+	ck_assert_int_eq(fftPlanCacheImportWisdom(path), 1);
+	ck_assert_int_eq(remove(path), 0);
+
+	// a path in a missing directory can't be written
+	ck_assert_ptr_nonnull(fftPlanCacheR2C(96, 1, 96, 49, in, out + 1));
+	ck_assert_int_eq(fftPlanCacheExportWisdom("missing/wisdom"), -1);
+
+	fftwf_free(in);
+	fftwf_free(out);
+}
+END_TEST
+
+Suite *stft_suite()
+{
+	Suite *s = suite_create("stft");
+	TCase *tc_r2c = tcase_create("STFT_r2c");
+	tcase_add_loop_test(tc_r2c, check_stft_r2c_batched, 0, 4);
+	tcase_set_timeout(tc_r2c, 60);
+	suite_add_tcase(s, tc_r2c);
+
+	TCase *tc_magnitude = tcase_create("STFT_magnitude");
+	tcase_add_loop_test(tc_magnitude, check_stft_magnitude, 0, 4);
+	tcase_add_test(tc_magnitude, check_stft_magnitude_blocks);
+	tcase_set_timeout(tc_magnitude, 60);
+	suite_add_tcase(s, tc_magnitude);
+
+	TCase *tc_cache = tcase_create("fftPlanCache");
+	tcase_add_test(tc_cache, check_plan_cache_reuse);
+	tcase_add_test(tc_cache, check_stft_r2c_cached_plans);
+	tcase_add_test(tc_cache, check_plan_cache_bounded);
+	tcase_add_test(tc_cache, check_plan_cache_export_wisdom);
+	tcase_set_timeout(tc_cache, 60);
+	suite_add_tcase(s, tc_cache);
+	return s;
+}
+
+int main(void){
+	Suite *s = stft_suite();
+	SRunner *sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_NORMAL);
+	int number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	if (number_failed == 0){
+		return EXIT_SUCCESS;
+	} else {
+		return EXIT_FAILURE;
+	}
+}
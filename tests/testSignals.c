@@ -0,0 +1,24 @@
+#include <math.h>
+#include "testSignals.h"
+
+unsigned int lcgNext(unsigned int *state){
+	(*state) = (*state) * 1103515245u + 12345u;
+	return (*state);
+}
+
+float lcgUniform(unsigned int *state){
+	return (float)((lcgNext(state) >> 8) & 0xFFFF) / 65535.f;
+}
+
+void twoToneSignal(float *x, int length, float samplerate){
+	for (int i = 0; i < length; i++){
+		x[i] = (sinf(2.f * M_PI * 440.f * i / samplerate)
+			+ 0.5f * sinf(2.f * M_PI * 1234.5f * i / samplerate));
+	}
+}
+
+void slowSinesSignal(float *x, int length){
+	for (int i = 0; i < length; i++){
+		x[i] = sinf(0.05f * i) + 0.3f * sinf(0.31f * i);
+	}
+}
@@ -0,0 +1,19 @@
+#ifndef TESTSIGNALS_H
+#define TESTSIGNALS_H
+
+// Advances the state of the linear congruential generator used by the tests
+// and returns the new state
+unsigned int lcgNext(unsigned int *state);
+
+// Advances state and returns a pseudo-random value in [0, 1], taken from 16
+// bits of the new state
+float lcgUniform(unsigned int *state);
+
+// Fills x with sin(2*pi*440*t) + 0.5*sin(2*pi*1234.5*t) sampled at samplerate
+void twoToneSignal(float *x, int length, float samplerate);
+
+// Fills x with sin(0.05*i) + 0.3*sin(0.31*i), a smooth signal whose values
+// are spread over [-1.3, 1.3]
+void slowSinesSignal(float *x, int length);
+
+#endif /*TESTSIGNALS_H*/